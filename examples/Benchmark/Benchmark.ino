@@ -0,0 +1,140 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ *******************************************************************************
+ *
+ * This sketch benchmarks the library against PsxControllerSim, for every
+ * supported controller type, in all relevant modes. No controller is needed,
+ * nor any other hardware, so it can run on any board, which is where CPU times
+ * mean something. The very same benchmark runs natively on a PC as part of
+ * the unit tests, see test/benchmark.cpp.
+ *
+ * For every case, it reports:
+ * - bytes: Bytes exchanged per poll.
+ * - bus_us: Time a poll takes on the bus, all delays included, as accounted
+ *   for by the virtual clock of the simulator. This is what a real controller
+ *   would take at the default clock speed without the Acknowledge line.
+ * - read_ns: CPU time taken by read(), simulator included (ns).
+ * - decode_ns: CPU time taken to decode a reply (ns).
+ *
+ * Results are printed as CSV, prefixed by a header line, so that they can be
+ * collected and compared across changes automatically. Define PSX_PROTOCOLS
+ * before including the library to see how the presets compare.
+ */
+
+#include <PsxControllerSim.h>
+
+// Decodes are way quicker than reads, so time more of them
+const unsigned int READS_NO = 200;
+const unsigned int DECODES_NO = 2000;
+
+/* Exposes the decoder, so that it can be timed on its own, on the last reply
+ * received
+ */
+class BenchController: public PsxControllerSim {
+public:
+	void decodeLast () {
+		beginState ();
+		decodePollReply (inputBuffer);
+		publishState ();
+	}
+};
+
+struct BenchCase {
+	const char *name;
+	PsxSimModel model;
+	boolean configure;
+	PsxConfigProfile profile;
+};
+
+const BenchCase cases[] = {
+	{"digital", PSSIM_DIGITAL, false, PsxConfigProfile (false)},
+	{"dualshock", PSSIM_DUALSHOCK, true, PsxConfigProfile (true)},
+	{"dualshock_rumble", PSSIM_DUALSHOCK, true, PsxConfigProfile (true, false, false, true)},
+	{"dualshock2_pressures", PSSIM_DUALSHOCK2, true, PsxConfigProfile (true, false, true)},
+	{"dualshock2_pressures_rumble", PSSIM_DUALSHOCK2, true, PsxConfigProfile (true, false, true, true)},
+	{"flightstick", PSSIM_FLIGHTSTICK, false, PsxConfigProfile (false)},
+	{"negcon", PSSIM_NEGCON, false, PsxConfigProfile (false)},
+	{"jogcon", PSSIM_JOGCON, false, PsxConfigProfile (false)},
+	{"guncon", PSSIM_GUNCON, false, PsxConfigProfile (false)}
+};
+
+BenchController psx;
+
+void runCase (const BenchCase& c) {
+	psx.setModel (c.model);
+	psx.resetStats ();
+
+	boolean ok = psx.begin ();
+	if (ok && c.configure) {
+		ok = psx.configure (c.profile);
+		psx.setRumble (true, 0xFF);
+	}
+
+	unsigned long busTime = 0;
+	unsigned long bytes = 0;
+	unsigned long readTime = 0;
+	unsigned long decodeTime = 0;
+
+	if (ok) {
+		// Bus time and bytes, from the simulator
+		unsigned long clock0 = psx.getClock ();
+		unsigned long bytes0 = psx.getBytesExchanged ();
+		unsigned long start = micros ();
+		for (unsigned int i = 0; i < READS_NO; ++i) {
+			ok = psx.read () && ok;
+		}
+		readTime = micros () - start;
+		busTime = psx.getClock () - clock0;
+		bytes = psx.getBytesExchanged () - bytes0;
+
+		// Decoder alone
+		start = micros ();
+		for (unsigned int i = 0; i < DECODES_NO; ++i) {
+			psx.decodeLast ();
+		}
+		decodeTime = micros () - start;
+	}
+
+	Serial.print (c.name);
+	Serial.print (',');
+	Serial.print (psx.getProtocol ());
+	Serial.print (',');
+	Serial.print (ok ? 1 : 0);
+	Serial.print (',');
+	Serial.print (bytes / READS_NO);
+	Serial.print (',');
+	Serial.print (busTime / READS_NO);
+	Serial.print (',');
+	Serial.print (readTime * 1000UL / READS_NO);
+	Serial.print (',');
+	Serial.println (decodeTime * 1000UL / DECODES_NO);
+}
+
+void setup () {
+	Serial.begin (115200);
+	while (!Serial)
+		;
+
+	Serial.println (F("case,protocol,ok,bytes,bus_us,read_ns,decode_ns"));
+	for (byte i = 0; i < sizeof (cases) / sizeof (cases[0]); ++i) {
+		runCase (cases[i]);
+	}
+}
+
+void loop () {
+}
@@ -0,0 +1,78 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ *******************************************************************************
+ *
+ * This sketch shows how to read several controllers sharing the hardware SPI
+ * bus. Whenever the buttons pressed on any of them change, the new button word
+ * is printed to serial, along with the controller it comes from. Every few
+ * seconds the aggregate number of polls per second is printed as well.
+ *
+ * All controllers share the CMD, DAT and CLK lines, see the DumpButtonsHwSpi
+ * example for details on the connections, while each has its own ATT line. Here
+ * these are driven by a 74HC138 decoder, see PsxAtt138Selector for details. Use
+ * PsxAttPinSelector to connect them directly to some pins instead.
+ */
+
+#include <PsxBus.h>
+
+const byte PADS_NO = 8;
+
+PsxAtt138Selector<2, 3, 4, 5> selector;
+PsxBus<PADS_NO> bus (selector);
+
+const unsigned long POLLING_INTERVAL = 1000U / 50U;
+const unsigned long STATS_INTERVAL = 5000U;
+
+void setup () {
+	Serial.begin (115200);
+
+	bus.begin ();
+
+	Serial.println (F("Ready!"));
+}
+
+void loop () {
+	static unsigned long last = 0;
+	static unsigned long lastStats = 0;
+	static PsxButtons lastButtons[PADS_NO];
+
+	if (millis () - last >= POLLING_INTERVAL) {
+		last = millis ();
+
+		bus.pollAll ();
+		for (byte i = 0; i < PADS_NO; ++i) {
+			const PsxControllerPort& pad = bus.getPad (i);
+			PsxButtons buttons = pad.isConnected () ? pad.getButtonWord () : 0;
+			if (buttons != lastButtons[i]) {
+				Serial.print (F("Controller "));
+				Serial.print (i);
+				Serial.print (F(": "));
+				Serial.println (buttons, HEX);
+				lastButtons[i] = buttons;
+			}
+		}
+	}
+
+	if (millis () - lastStats >= STATS_INTERVAL) {
+		lastStats = millis ();
+
+		Serial.print (F("Polls/s: "));
+		Serial.println (bus.getPollsPerSecond ());
+		bus.resetPollStats ();
+	}
+}
@@ -0,0 +1,80 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ *******************************************************************************
+ *
+ * This sketch polls a controller at 500 Hz from a timer interrupt and prints
+ * every button press and release, with its timestamp. loop() only checks for
+ * new events every 100 ms, to show that even quick taps in between are not
+ * lost.
+ *
+ * On AVR boards, Timer 1 is used. On other boards, polls are triggered from
+ * loop() instead.
+ *
+ * See the DumpButtonsHwSpi example for details on the connections.
+ */
+
+#include <PsxControllerHwSpi.h>
+#include <PsxPollScheduler.h>
+
+const byte PIN_PS2_ATT = 10;
+
+const unsigned long POLLING_PERIOD_US = 1000000UL / 500U;
+const unsigned long CHECK_INTERVAL = 100U;
+
+PsxControllerHwSpi<PIN_PS2_ATT> psx;
+PsxPollScheduler scheduler (psx, POLLING_PERIOD_US);
+PsxButtonEventBuffer<32> events;
+
+void setup () {
+	Serial.begin (115200);
+
+	psx.begin ();
+	psx.setEventQueue (&events);
+
+#ifdef __AVR__
+	PsxSchedulerTimer1::begin (scheduler);
+#endif
+
+	Serial.println (F("Ready!"));
+}
+
+void loop () {
+	static unsigned long lastCheck = 0;
+
+#ifndef __AVR__
+	scheduler.run ();
+#endif
+
+	if (millis () - lastCheck >= CHECK_INTERVAL) {
+		lastCheck = millis ();
+
+		PsxButtonEvent event;
+		while (events.pop (event)) {
+			Serial.print (event.time);
+			Serial.print (event.pressed ? F(": pressed ") : F(": released "));
+			Serial.println (event.button, HEX);
+		}
+
+		word lost = events.getOverflows ();
+		if (lost > 0) {
+			Serial.print (F("Events lost: "));
+			Serial.println (lost);
+			events.clearOverflows ();
+		}
+	}
+}
@@ -0,0 +1,94 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ *******************************************************************************
+ *
+ * This sketch polls a controller at a fixed rate of 250 Hz from a timer
+ * interrupt, while loop() just prints button changes. Every few seconds, the
+ * actual polling period range, the number of overruns and the latency between
+ * polls and loop() picking up their data are printed as well.
+ *
+ * On AVR boards, Timer 1 is used. On other boards, polls are triggered from
+ * loop() instead.
+ *
+ * See the DumpButtonsHwSpi example for details on the connections.
+ */
+
+#include <PsxControllerHwSpi.h>
+#include <PsxPollScheduler.h>
+
+const byte PIN_PS2_ATT = 10;
+
+const unsigned long POLLING_PERIOD_US = 1000000UL / 250U;
+const unsigned long STATS_INTERVAL = 5000U;
+
+PsxControllerHwSpi<PIN_PS2_ATT> psx;
+PsxPollScheduler scheduler (psx, POLLING_PERIOD_US);
+
+void setup () {
+	Serial.begin (115200);
+
+	psx.begin ();
+
+#ifdef __AVR__
+	PsxSchedulerTimer1::begin (scheduler);
+#endif
+
+	Serial.println (F("Ready!"));
+}
+
+void loop () {
+	static unsigned long lastStats = 0;
+	static PsxState state;
+	static PsxButtons lastButtons = PSB_NONE;
+
+#ifdef __AVR__
+	scheduler.service ();
+#else
+	scheduler.run ();
+#endif
+
+	if (scheduler.getLatest (state) && scheduler.isLatestValid ()) {
+		// Buttons are active-low in PsxState
+		PsxButtons buttons = ~state.buttonWord;
+		if (buttons != lastButtons) {
+			Serial.print (F("Buttons: "));
+			Serial.println (buttons, HEX);
+			lastButtons = buttons;
+		}
+	}
+
+	if (millis () - lastStats >= STATS_INTERVAL) {
+		lastStats = millis ();
+
+		unsigned long pmin, pmax;
+		scheduler.getPeriodRange (pmin, pmax);
+		Serial.print (F("Period: "));
+		Serial.print (pmin);
+		Serial.print (F("-"));
+		Serial.print (pmax);
+		Serial.print (F(" us, overruns: "));
+		Serial.print (scheduler.getOverruns ());
+		Serial.print (F(", latency: avg "));
+		Serial.print (scheduler.getAverageLatency ());
+		Serial.print (F(" us, max "));
+		Serial.print (scheduler.getMaxLatency ());
+		Serial.println (F(" us"));
+
+		scheduler.resetStats ();
+	}
+}
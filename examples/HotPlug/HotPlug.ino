@@ -0,0 +1,69 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ *******************************************************************************
+ *
+ * This sketch shows how to let the library deal with controllers being
+ * connected and disconnected. Analog sticks and buttons are enabled on any
+ * controller that gets connected, without any further code. Plug and unplug
+ * a DualShock 2 and watch the serial monitor.
+ *
+ * See the DumpButtonsHwSpi example for details on the connections.
+ */
+
+#include <PsxControllerHwSpi.h>
+
+const byte PIN_PS2_ATT = 10;
+
+const unsigned long POLLING_INTERVAL = 1000U / 50U;
+
+PsxControllerHwSpi<PIN_PS2_ATT> psx;
+
+void setup () {
+	Serial.begin (115200);
+
+	psx.begin ();
+
+	// Enable analog sticks and buttons on every controller we find
+	psx.setConfigProfile (PsxConfigProfile (true, false, true));
+
+	Serial.println (F("Ready!"));
+}
+
+void loop () {
+	static unsigned long last = 0;
+	static boolean wasConnected = false;
+
+	if (millis () - last >= POLLING_INTERVAL) {
+		last = millis ();
+
+		if (psx.update () && psx.buttonsChanged ()) {
+			Serial.print (F("Buttons: "));
+			Serial.println (psx.getButtonWord (), HEX);
+		}
+
+		if (psx.isConnected () != wasConnected) {
+			wasConnected = psx.isConnected ();
+			if (wasConnected) {
+				Serial.print (F("Controller connected, protocol "));
+				Serial.println (psx.getProtocol ());
+			} else {
+				Serial.println (F("Controller disconnected"));
+			}
+		}
+	}
+}
@@ -0,0 +1,72 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ *******************************************************************************
+ *
+ * This sketch shows how to read up to four controllers connected through a
+ * multitap. Whenever the buttons pressed on any of them change, the new button
+ * word is printed to serial, along with the port it comes from.
+ *
+ * This example drives the multitap through the hardware SPI port, see the
+ * DumpButtonsHwSpi example for details on the connections.
+ */
+
+#include <PsxControllerHwSpi.h>
+#include <PsxMultitap.h>
+
+const byte PIN_PS2_ATT = 10;
+
+const unsigned long POLLING_INTERVAL = 1000U / 50U;
+
+PsxMultitap<PsxControllerHwSpi<PIN_PS2_ATT> > tap;
+
+boolean haveTap = false;
+
+void setup () {
+	Serial.begin (115200);
+	Serial.println (F("Ready!"));
+}
+
+void loop () {
+	static unsigned long last = 0;
+	static PsxButtons lastButtons[MULTITAP_PORTS];
+
+	if (millis () - last >= POLLING_INTERVAL) {
+		last = millis ();
+
+		if (!haveTap) {
+			if (tap.begin ()) {
+				haveTap = true;
+			}
+		} else if (!tap.readAll ()) {
+			Serial.println (F("Controllers lost :("));
+			haveTap = false;
+		} else {
+			for (byte i = 0; i < MULTITAP_PORTS; ++i) {
+				const PsxMultitapPort& port = tap.getPort (i);
+				PsxButtons buttons = port.isConnected () ? port.getButtonWord () : 0;
+				if (buttons != lastButtons[i]) {
+					Serial.print (F("Port "));
+					Serial.print (static_cast<char> ('A' + i));
+					Serial.print (F(": "));
+					Serial.println (buttons, HEX);
+					lastButtons[i] = buttons;
+				}
+			}
+		}
+	}
+}
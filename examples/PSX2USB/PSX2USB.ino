@@ -26,6 +26,7 @@
  */
 
 #include <PsxControllerBitBang.h>
+#include <PsxStickHat.h>
 #include <Joystick.h>
 
 /* We must use the bit-banging interface, as SPI pins are only available on the
@@ -43,6 +44,12 @@ const unsigned long POLLING_INTERVAL = 1000U / 50U;
 // Send debug messages to serial port
 //~ #define ENABLE_SERIAL_DEBUG
 
+/* This gives a clock of about 25 kHz, timed with delayMicroseconds(). A fixed
+ * clock period (in ns) can be given instead, which is timed exactly and gets
+ * frame times close to those of the hardware SPI interface, i.e.:
+ *
+ * PsxControllerBitBang<PIN_PS2_ATT, PIN_PS2_CMD, PIN_PS2_DAT, PIN_PS2_CLK, PSX_NO_ACK_PIN, 4000> psx;
+ */
 PsxControllerBitBang<PIN_PS2_ATT, PIN_PS2_CMD, PIN_PS2_DAT, PIN_PS2_CLK> psx;
 
 Joystick_ usbStick (
@@ -77,11 +84,6 @@ Joystick_ usbStick (
 boolean haveController = false;
 
 
-#define	toDegrees(rad) (rad * 180.0 / PI)
-
-#define deadify(var, thres) (abs (var) > thres ? (var) : 0)
-
-
 /** \brief Dead zone for analog sticks
  *  
  * If the analog stick moves less than this value from the center position, it
@@ -91,6 +93,11 @@ boolean haveController = false;
  */
 const byte ANALOG_DEAD_ZONE = 50U;
 
+/* Turns the right analog stick into a hat switch, with no floating point math.
+ * Use PSHAT_8WAY or PSHAT_4WAY for a digital-style hat.
+ */
+PsxStickHat hat (PSHAT_360, ANALOG_DEAD_ZONE, 2);
+
 
 void setup () {
 	// Lit the builtin led whenever buttons are pressed
@@ -187,34 +194,21 @@ void loop () {
 
 				// Right analog is the hat switch
 				if (psx.getRightAnalog (x, y)) {		// [0 ... 255]
-					// We flip coordinates to avoid having to invert them in atan2()
-					int8_t rx = ANALOG_IDLE_VALUE - x - 1;	// [127 ... -128]
-					rx = deadify (rx, ANALOG_DEAD_ZONE);
-
-					int8_t ry = ANALOG_IDLE_VALUE - y - 1;
-					ry = deadify (ry, ANALOG_DEAD_ZONE);
-
-					if (rx == 0 && ry == 0) {
+					int16_t angle = hat.updateRaw (x, y);
+					if (angle == PSX_HAT_RELEASED) {
 						usbStick.setHatSwitch (0, JOYSTICK_HATSWITCH_RELEASE);
 					} else {
-						/* atan2() will yield something between -PI and +PI, so we
-						 * add 2*PI first to make it always positive, and then we
-						 * subtract PI / 2 because setHatSwitch() has 0 degrees at
-						 * north.
-						 *
-						 * Also we would need to invert the arguments to atan2()
-						 * since setHatSwitch() grows clockwise while radians go the
-						 * other way, but we have already done that when we
-						 * calculated rx and ry. Smart, huh?
-						 */
-						float angle = atan2 (ry, rx) + 2 * PI - PI / 2;
-						uint16_t intAngle = ((uint16_t) (toDegrees (angle) + 0.5)) % 360;
-						usbStick.setHatSwitch (0, intAngle);
+						usbStick.setHatSwitch (0, angle);
 					}
 				}
 
-				// All done, send data for real!
-				usbStick.sendState ();
+				/* All done, send data for real, but only if something changed,
+				 * which saves quite some USB traffic. Stick jitter can be
+				 * filtered out with psx.setAxisThresholds().
+				 */
+				if (psx.changed ()) {
+					usbStick.sendState ();
+				}
 			}
 		}
 	}
@@ -0,0 +1,83 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ *******************************************************************************
+ *
+ * This sketch polls a controller and prints some statistics about the polls
+ * every second, as a single line of comma-separated values: number of polls,
+ * bytes in last poll, shortest and longest poll (us), failures by cause,
+ * configuration mode recoveries and the poll duration histogram.
+ *
+ * See the DumpButtonsHwSpi example for details on the connections.
+ */
+
+// This must be defined before including the library
+#define PSX_COLLECT_STATS
+
+#include <PsxControllerHwSpi.h>
+
+const byte PIN_PS2_ATT = 10;
+
+const unsigned long POLLING_INTERVAL = 1000U / 50U;
+const unsigned long STATS_INTERVAL = 1000U;
+
+PsxControllerHwSpi<PIN_PS2_ATT> psx;
+
+void setup () {
+	Serial.begin (115200);
+
+	psx.begin ();
+
+	Serial.println (F("Ready!"));
+}
+
+void loop () {
+	static unsigned long last = 0;
+	static unsigned long lastStats = 0;
+
+	if (millis () - last >= POLLING_INTERVAL) {
+		last = millis ();
+
+		psx.update ();
+	}
+
+	if (millis () - lastStats >= STATS_INTERVAL) {
+		lastStats = millis ();
+
+		const PsxStats& stats = psx.getStats ();
+		Serial.print (stats.polls);
+		Serial.print (',');
+		Serial.print (stats.lastPollBytes);
+		Serial.print (',');
+		Serial.print (stats.durationMin);
+		Serial.print (',');
+		Serial.print (stats.durationMax);
+		for (byte i = 0; i < PSFAIL_MAX; ++i) {
+			Serial.print (',');
+			Serial.print (stats.failures[i]);
+		}
+		Serial.print (',');
+		Serial.print (stats.configRecoveries);
+		for (byte i = 0; i < PSX_STATS_BINS; ++i) {
+			Serial.print (',');
+			Serial.print (stats.histogram[i]);
+		}
+		Serial.println ();
+
+		psx.clearStats ();
+	}
+}
@@ -0,0 +1,92 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ *******************************************************************************
+ *
+ * This sketch measures how long it takes to poll a controller, so that the
+ * effect of connecting the Acknowledge line can be seen. It polls the
+ * controller twice, once watching ACK and once not, and prints the average
+ * time a read() takes with each, in microseconds.
+ *
+ * Analog sticks and buttons are enabled first, so that a DualShock 2 will
+ * reply with its longest (21-byte) frame.
+ *
+ * This example drives the controller through the hardware SPI port, see the
+ * DumpButtonsHwSpi example for details on the connections. ACK can be
+ * connected to any pin, just remember it needs a pull-up just like DATA.
+ */
+
+#include <PsxControllerHwSpi.h>
+
+const byte PIN_PS2_ATT = 10;
+const byte PIN_PS2_ACK = 2;
+
+const unsigned int READS_NO = 1000;
+
+PsxControllerHwSpi<PIN_PS2_ATT> psxNoAck;
+PsxControllerHwSpi<PIN_PS2_ATT, PIN_PS2_ACK> psxAck;
+
+unsigned long timeReads (PsxController& psx) {
+	unsigned int good = 0;
+
+	unsigned long start = micros ();
+	for (unsigned int i = 0; i < READS_NO; ++i) {
+		if (psx.read ()) {
+			++good;
+		}
+	}
+	unsigned long elapsed = micros () - start;
+
+	if (good < READS_NO) {
+		Serial.print (F("Warning: "));
+		Serial.print (READS_NO - good);
+		Serial.println (F(" reads failed"));
+	}
+
+	return elapsed / READS_NO;
+}
+
+void setup () {
+	Serial.begin (115200);
+	while (!Serial)
+		;
+
+	if (!psxNoAck.begin ()) {
+		Serial.println (F("No controller found"));
+		while (42)
+			;
+	}
+
+	if (psxNoAck.enterConfigMode ()) {
+		psxNoAck.enableAnalogSticks ();
+		psxNoAck.enableAnalogButtons ();
+		psxNoAck.exitConfigMode ();
+	}
+
+	psxAck.begin ();
+
+	Serial.println (F("Average read() time (us):"));
+}
+
+void loop () {
+	Serial.print (F("No ACK: "));
+	Serial.print (timeReads (psxNoAck));
+	Serial.print (F(", ACK: "));
+	Serial.println (timeReads (psxAck));
+
+	delay (1000);
+}
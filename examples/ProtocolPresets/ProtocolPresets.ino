@@ -0,0 +1,85 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ *******************************************************************************
+ *
+ * This sketch shows how to build the library with only the protocols that are
+ * actually needed, and reports what that costs. Change PSX_PROTOCOLS below to
+ * any of the PSX_PRESET_* values or to a combination of PSX_SUPPORT_* flags,
+ * then compare:
+ * - Flash and global RAM usage, as printed by the IDE when compiling.
+ * - RAM used by each controller object, as printed by this sketch.
+ * - The average time a read() takes, also printed by this sketch.
+ *
+ * This example drives the controller through the hardware SPI port, see the
+ * DumpButtonsHwSpi example for details on the connections.
+ */
+
+// This must come before including any library header
+#define PSX_PROTOCOLS PSX_PRESET_DUALSHOCK
+
+#include <PsxControllerHwSpi.h>
+
+const byte PIN_PS2_ATT = 10;
+
+const unsigned int READS_NO = 1000;
+
+PsxControllerHwSpi<PIN_PS2_ATT> psx;
+
+void setup () {
+	Serial.begin (115200);
+	while (!Serial)
+		;
+
+	Serial.print (F("Supported protocols: 0x"));
+	Serial.println (PSX_PROTOCOLS, HEX);
+	Serial.print (F("Controller object size: "));
+	Serial.print (sizeof (psx));
+	Serial.println (F(" bytes"));
+	Serial.print (F("Controller state size: "));
+	Serial.print (sizeof (PsxState));
+	Serial.println (F(" bytes, double-buffered"));
+
+	if (!psx.begin ()) {
+		Serial.println (F("No controller found"));
+		while (42)
+			;
+	}
+
+	psx.configure (PsxConfigProfile (true));
+}
+
+void loop () {
+	unsigned int good = 0;
+
+	unsigned long start = micros ();
+	for (unsigned int i = 0; i < READS_NO; ++i) {
+		if (psx.read ()) {
+			++good;
+		}
+	}
+	unsigned long elapsed = micros () - start;
+
+	Serial.print (F("Average read() time: "));
+	Serial.print (elapsed / READS_NO);
+	Serial.print (F(" us, protocol: "));
+	Serial.print (psx.getProtocol ());
+	Serial.print (F(", failed reads: "));
+	Serial.println (READS_NO - good);
+
+	delay (1000);
+}
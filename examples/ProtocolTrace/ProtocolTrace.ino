@@ -0,0 +1,74 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ *******************************************************************************
+ *
+ * This sketch records every byte exchanged with the controller to a trace
+ * buffer in RAM and prints it at every button press, together with everything
+ * that happened since the previous one: initialization, configuration and all
+ * polls in between, as far as the buffer goes.
+ *
+ * Recording only takes a few cycles per byte, so unlike printing everything
+ * while it happens, it doesn't change the timing of the exchanges. Save the
+ * output of the serial monitor to a file and run extras/psxtrace.py on it to
+ * see it as annotated frames.
+ *
+ * This example drives the controller through the hardware SPI port, see the
+ * DumpButtonsHwSpi example for details on the connections.
+ */
+
+// These must come before including any library header
+#define PSX_TRACE
+#define PSX_TRACE_SIZE 128
+
+#include <PsxControllerHwSpi.h>
+
+const byte PIN_PS2_ATT = 10;
+
+PsxControllerHwSpi<PIN_PS2_ATT> psx;
+
+boolean haveController = false;
+
+void setup () {
+	Serial.begin (115200);
+	while (!Serial)
+		;
+
+	Serial.println (F("Ready!"));
+}
+
+void loop () {
+	if (!haveController) {
+		if (psx.begin ()) {
+			Serial.println (F("Controller found!"));
+			psx.configure (PsxConfigProfile (true));
+			psx.flushTrace (Serial);
+			haveController = true;
+		}
+	} else {
+		if (!psx.read ()) {
+			Serial.println (F("Controller lost :("));
+			psx.flushTrace (Serial);
+			haveController = false;
+		} else if (psx.buttonsChanged ()) {
+			// Printing only happens here, between polls
+			psx.flushTrace (Serial);
+		}
+	}
+
+	delay (1000 / 60);
+}
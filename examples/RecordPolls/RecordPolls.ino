@@ -0,0 +1,68 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ *******************************************************************************
+ *
+ * This sketch records the raw replies of the controller to a binary stream on
+ * the serial port, so that they can be replayed later through
+ * PsxControllerReplay, i.e.: to reproduce a problem with a specific controller
+ * without having it at hand, or to feed real data to the library on a PC.
+ *
+ * Nothing else is ever printed, so that the output can just be captured to a
+ * file, i.e. on Linux:
+ *
+ * stty -F /dev/ttyACM0 115200 raw && cat /dev/ttyACM0 > recording.bin
+ *
+ * Then play with the controller for as long as needed. Note that opening the
+ * port resets most boards, which restarts the recording.
+ *
+ * This example drives the controller through the hardware SPI port, see the
+ * DumpButtonsHwSpi example for details on the connections.
+ */
+
+#include <PsxControllerHwSpi.h>
+
+const byte PIN_PS2_ATT = 10;
+
+PsxControllerHwSpi<PIN_PS2_ATT> psx;
+
+PsxFrameRecorder recorder (Serial);
+
+boolean haveController = false;
+
+void setup () {
+	Serial.begin (115200);
+	while (!Serial)
+		;
+
+	// Record from the very beginning, so that the replay can call begin() too
+	recorder.begin ();
+	psx.setRecorder (&recorder);
+}
+
+void loop () {
+	if (!haveController) {
+		if (psx.begin ()) {
+			psx.configure (PsxConfigProfile (true, false, true));
+			haveController = true;
+		}
+	} else {
+		haveController = psx.read ();
+	}
+
+	delay (1000 / 60);
+}
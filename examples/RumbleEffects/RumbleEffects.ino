@@ -0,0 +1,109 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ *******************************************************************************
+ *
+ * This sketch shows how to play rumble effects with PsxRumbleEngine, which
+ * times them on its own and sends the motor levels along with every poll, so
+ * that loop() only has to start them:
+ * - Cross: A short pulse
+ * - Circle: An impact, which plays over anything else
+ * - Square: The large motor ramping up and down
+ * - Triangle: A heartbeat, until pressed again
+ *
+ * Note that the motors need 7.5V on pin 3 of the controller connector.
+ *
+ * This example drives the controller through the hardware SPI port, see the
+ * DumpButtonsHwSpi example for details on the connections.
+ */
+
+#include <PsxControllerHwSpi.h>
+#include <PsxRumbleEffects.h>
+
+const byte PIN_PS2_ATT = 10;
+
+//! \name Effect priorities
+//! @{
+const byte PRIO_BACKGROUND = 0;
+const byte PRIO_NORMAL = 1;
+const byte PRIO_URGENT = 2;
+//! @}
+
+PsxControllerHwSpi<PIN_PS2_ATT> psx;
+
+PsxRumbleEngine<> rumble;
+
+int8_t heartbeat = PSX_RUMBLE_NONE;
+
+boolean haveController = false;
+
+void setup () {
+	Serial.begin (115200);
+	while (!Serial)
+		;
+
+	psx.setRumbleSource (&rumble);
+
+	Serial.println (F("Ready!"));
+}
+
+void loop () {
+	if (!haveController) {
+		if (psx.begin ()) {
+			Serial.println (F("Controller found!"));
+			if (!psx.configure (PsxConfigProfile (true, false, false, true))) {
+				Serial.println (F("Cannot enable rumble"));
+			}
+			haveController = true;
+		}
+	} else {
+		if (!psx.read ()) {
+			Serial.println (F("Controller lost :("));
+			rumble.stopAll ();
+			heartbeat = PSX_RUMBLE_NONE;
+			haveController = false;
+		} else {
+			if (psx.buttonJustPressed (PSB_CROSS)) {
+				Serial.println (F("Pulse"));
+				rumble.play (PSX_RUMBLE_PULSE, PRIO_NORMAL);
+			}
+
+			if (psx.buttonJustPressed (PSB_CIRCLE)) {
+				Serial.println (F("Impact"));
+				rumble.play (PSX_RUMBLE_IMPACT, PRIO_URGENT);
+			}
+
+			if (psx.buttonJustPressed (PSB_SQUARE)) {
+				Serial.println (F("Ramp"));
+				rumble.play (PSX_RUMBLE_RAMP, PRIO_NORMAL);
+			}
+
+			if (psx.buttonJustPressed (PSB_TRIANGLE)) {
+				if (rumble.isPlaying (heartbeat)) {
+					Serial.println (F("Heartbeat off"));
+					rumble.stop (heartbeat);
+					heartbeat = PSX_RUMBLE_NONE;
+				} else {
+					Serial.println (F("Heartbeat on"));
+					heartbeat = rumble.play (PSX_RUMBLE_HEARTBEAT, PRIO_BACKGROUND, 0);
+				}
+			}
+		}
+	}
+
+	delay (1000 / 60);
+}
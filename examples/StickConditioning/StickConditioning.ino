@@ -0,0 +1,104 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ *******************************************************************************
+ *
+ * This sketch shows how to turn the raw positions of the analog sticks into
+ * something more usable with PsxStickConditioner: sticks that don't rest at
+ * 128 or that don't reach the ends of their travel anymore are calibrated
+ * automatically, while a dead zone, an anti-dead zone and a response curve are
+ * applied on top.
+ *
+ * Move the sticks all around a few times, then watch the conditioned
+ * positions on the serial monitor.
+ *
+ * This example drives the controller through the hardware SPI port, see the
+ * DumpButtonsHwSpi example for details on the connections.
+ */
+
+#include <PsxControllerHwSpi.h>
+#include <PsxStickConditioner.h>
+
+const byte PIN_PS2_ATT = 10;
+
+//! \brief Dead zone, on the [0 ... 127] scale of conditioned positions
+const byte DEAD_ZONE = 20;
+
+PsxControllerHwSpi<PIN_PS2_ATT> psx;
+
+PsxStickConditioner sticks;
+
+boolean haveController = false;
+
+void printStick (const char *name, const byte rawX, const byte rawY, const int8_t x, const int8_t y) {
+	Serial.print (name);
+	Serial.print (F(": raw = ("));
+	Serial.print (rawX);
+	Serial.print (F(", "));
+	Serial.print (rawY);
+	Serial.print (F("), conditioned = ("));
+	Serial.print (x);
+	Serial.print (F(", "));
+	Serial.print (y);
+	Serial.print (F(")  "));
+}
+
+void setup () {
+	Serial.begin (115200);
+	while (!Serial)
+		;
+
+	sticks.setDeadZone (DEAD_ZONE, PSDZ_RADIAL);
+	sticks.setCurve (PSCURVE_QUADRATIC);
+
+	Serial.println (F("Ready!"));
+}
+
+void loop () {
+	if (!haveController) {
+		if (psx.begin ()) {
+			Serial.println (F("Controller found!"));
+			if (!psx.configure (PsxConfigProfile (true))) {
+				Serial.println (F("Cannot enable analog sticks"));
+			}
+
+			// Sticks are most likely at rest right now
+			sticks.recenter ();
+			haveController = true;
+		}
+	} else {
+		if (!psx.read ()) {
+			Serial.println (F("Controller lost :("));
+			haveController = false;
+		} else if (sticks.update (psx)) {
+			byte rawX, rawY;
+			int8_t x, y;
+
+			psx.getLeftAnalog (rawX, rawY);
+			sticks.getLeftStick (x, y);
+			printStick ("Left", rawX, rawY, x, y);
+
+			psx.getRightAnalog (rawX, rawY);
+			sticks.getRightStick (x, y);
+			printStick ("Right", rawX, rawY, x, y);
+
+			Serial.println ();
+		}
+	}
+
+	delay (1000 / 60);
+}
@@ -0,0 +1,256 @@
+#!/usr/bin/env python3
+###############################################################################
+# This file is part of PsxNewLib.                                             #
+#                                                                             #
+# Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               #
+#                                                                             #
+# PsxNewLib is free software: you can redistribute it and/or                  #
+# modify it under the terms of the GNU General Public License as published by #
+# the Free Software Foundation, either version 3 of the License, or           #
+# (at your option) any later version.                                         #
+#                                                                             #
+# PsxNewLib is distributed in the hope that it will be useful,                #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of              #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               #
+# GNU General Public License for more details.                                #
+#                                                                             #
+# You should have received a copy of the GNU General Public License           #
+# along with PsxNewLib. If not, see http://www.gnu.org/licenses.              #
+###############################################################################
+#
+# Decoder for the protocol traces printed by PsxController::flushTrace().
+#
+# Save whatever the sketch printed on the serial port to a file (anything
+# besides the traces is skipped) and run:
+#
+#   python3 psxtrace.py capture.txt
+#
+# or pipe it through standard input, adding -q to leave out the raw bytes.
+# Every Attention cycle is printed as a frame, with the command name, the mode
+# (ID) byte returned by the controller and, for polls, the decoded buttons,
+# sticks and pressures.
+
+import sys
+import re
+
+# Must match PsxTraceKind
+PSTR_ATTENTION_ON = 1
+PSTR_ATTENTION_OFF = 2
+PSTR_BYTE = 3
+
+# Bits of the button word, see PsxButton
+BUTTONS = [
+	"SELECT", "L3", "R3", "START", "UP", "RIGHT", "DOWN", "LEFT",
+	"L2", "R2", "L1", "R1", "TRIANGLE", "CIRCLE", "CROSS", "SQUARE"
+]
+
+# Order of the pressures in a DualShock 2 reply, see PsxAnalogButton
+PRESSURES = [
+	"RIGHT", "LEFT", "UP", "DOWN", "TRIANGLE", "CIRCLE", "CROSS", "SQUARE",
+	"L1", "R1", "L2", "R2"
+]
+
+MODES = {
+	0x41: "digital",
+	0x73: "analog",
+	0x74: "analog+pressures",
+	0x75: "analog+pressures",
+	0x76: "analog+pressures",
+	0x77: "analog+pressures",
+	0x78: "analog+pressures",
+	0x79: "analog+pressures",
+	0x53: "flightstick",
+	0x23: "neGcon",
+	0xE3: "JogCon",
+	0x63: "GunCon",
+	0xF3: "config",
+	0x80: "multitap",
+}
+
+COMMANDS = {
+	0x40: "set_pressure_cfg",
+	0x41: "pressure_mask",
+	0x42: "poll",
+	0x43: "config",
+	0x44: "set_mode",
+	0x45: "type_read",
+	0x46: "const_46",
+	0x47: "const_47",
+	0x4C: "const_4c",
+	0x4D: "rumble_map",
+	0x4F: "set_pressures",
+}
+
+# Replies of these controllers carry two analog sticks, as do all DualShock
+# ones (0x7X)
+STICKS_IDS = (0x53,)
+
+# Mask enabling all the bytes of a DualShock 2 reply, see set_pressures
+FULL_MASK = 0x3FFFF
+
+HEX_RE = re.compile (r"^[0-9A-Fa-f]{8}$")
+
+
+def parse_traces (lines):
+	"""Yield (lost, entries) for every PSXTRACE ... END block"""
+	entries = None
+	lost = 0
+	for line in lines:
+		line = line.strip ()
+		if line.startswith ("PSXTRACE"):
+			parts = line.split ()
+			lost = int (parts[1]) if len (parts) > 1 and parts[1].isdigit () else 0
+			entries = []
+		elif entries is not None:
+			if line == "END":
+				yield lost, entries
+				entries = None
+			else:
+				for tok in line.split ():
+					if HEX_RE.match (tok):
+						b = bytes.fromhex (tok)
+						entries.append ((b[0], b[1], b[2], b[3]))
+
+
+def describe_command (out):
+	"""Name of the command in a frame"""
+	if len (out) < 2:
+		return "?"
+
+	cmd = out[1]
+	name = COMMANDS.get (cmd, "cmd_%02x" % cmd)
+	if cmd == 0x42 and len (out) > 2 and out[2] == 0x01:
+		name = "poll_multitap"
+	elif cmd == 0x43 and len (out) > 3:
+		name = "enter_config" if out[3] == 0x01 else "exit_config"
+	elif cmd == 0x44 and len (out) > 4:
+		name = "set_mode(%s%s)" % ("analog" if out[3] else "digital", ",locked" if out[4] == 0x03 else "")
+	elif cmd == 0x4D and len (out) > 4:
+		name = "rumble_map(%02x,%02x)" % (out[3], out[4])
+
+	return name
+
+
+def describe_reply (out, data, mask = FULL_MASK):
+	"""Decode the controller data in the reply to a poll
+
+	mask is the last one set with 0x4F: bit n enables byte n + 3 of DualShock
+	replies.
+	"""
+	ret = []
+
+	if len (data) < 5:
+		return ret
+
+	mode = data[1]
+	buttons = ~(data[3] | (data[4] << 8)) & 0xFFFF
+	pressed = [BUTTONS[i] for i in range (16) if buttons & (1 << i)]
+	ret.append ("buttons: %s" % (" ".join (pressed) if pressed else "-"))
+
+	dualshock = mode & 0xF0 == 0x70
+	if (mode in STICKS_IDS or dualshock) and len (data) >= 9:
+		ret.append ("L(%d,%d) R(%d,%d)" % (data[7], data[8], data[5], data[6]))
+
+	if dualshock and mode & 0x0F > 3:
+		# Pressures of the enabled buttons only, in order
+		enabled = [i for i in range (12) if mask & (1 << (i + 6))] or list (range (12))
+		values = data[9:]
+		p = ["%s=%d" % (PRESSURES[i], v) for i, v in zip (enabled, values) if v > 0]
+		ret.append ("pressures: %s" % (" ".join (p) if p else "-"))
+
+	return ret
+
+
+def describe_frame (out, data, mask = FULL_MASK):
+	"""Return the annotation line for a frame"""
+	desc = [describe_command (out)]
+
+	if len (data) >= 3:
+		mode = data[1]
+		if data[2] != 0x5A and mode != 0x80:
+			desc.append ("no reply" if mode == 0xFF else "bad header")
+		else:
+			desc.append ("mode 0x%02X (%s)" % (mode, MODES.get (mode, "unknown")))
+			if len (out) > 1 and out[1] == 0x42 and mode not in (0xF3, 0x80):
+				desc += describe_reply (out, data, mask)
+	else:
+		desc.append ("truncated")
+
+	return ", ".join (desc)
+
+
+def decode (lines, outfile = sys.stdout, raw = True):
+	t_last = None
+	t_offset = 0
+	frame_no = 0
+	mask = FULL_MASK
+
+	def unwrap (e):
+		# Timestamps are 24 bits, assume less than 16.7 s between events
+		nonlocal t_last, t_offset
+		t = e[1] | (e[2] << 8) | (e[3] << 16)
+		if t_last is not None and t < t_last:
+			t_offset += 1 << 24
+		t_last = t
+		return t + t_offset
+
+	for lost, entries in parse_traces (lines):
+		if lost > 0:
+			print ("*** %d entries lost" % lost, file = outfile)
+
+			# Skip what is left of the frame that was cut
+			while entries and entries[0][0] != PSTR_ATTENTION_ON:
+				entries.pop (0)
+
+		out = []
+		data = []
+		start = None
+		for e in entries:
+			kind = e[0]
+			if kind == PSTR_ATTENTION_ON:
+				start = unwrap (e)
+				out = []
+				data = []
+			elif kind == PSTR_BYTE:
+				out.append (e[1])
+				data.append (e[2])
+			elif kind == PSTR_ATTENTION_OFF:
+				end = unwrap (e)
+				frame_no += 1
+				if start is not None:
+					header = "[%12.3f ms] #%-5d %5d us" % (start / 1000.0, frame_no, end - start)
+				else:
+					header = "[%12s   ] #%-5d" % ("?", frame_no)
+				if len (out) >= 6 and out[1] == 0x4F:
+					mask = out[3] | (out[4] << 8) | (out[5] << 16)
+				print ("%s  %s" % (header, describe_frame (out, data, mask)), file = outfile)
+				if raw:
+					print ("    CMD %s" % " ".join ("%02X" % b for b in out), file = outfile)
+					print ("    DAT %s" % " ".join ("%02X" % b for b in data), file = outfile)
+				start = None
+				out = []
+				data = []
+			else:
+				print ("*** unknown entry %02X" % kind, file = outfile)
+
+		if out:
+			# Frame still open when the trace was flushed
+			print ("%s  %s (incomplete)" % (" " * 28, describe_frame (out, data, mask)), file = outfile)
+
+
+def main ():
+	args = sys.argv[1:]
+	raw = True
+	if args and args[0] == "-q":
+		raw = False
+		args = args[1:]
+
+	if args:
+		with open (args[0]) as f:
+			decode (f, raw = raw)
+	else:
+		decode (sys.stdin, raw = raw)
+
+
+if __name__ == "__main__":
+	main ()
@@ -0,0 +1,116 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file PsxAckPin.h
+ * \brief Handling of the Acknowledge line
+ */
+
+#ifndef PSXACKPIN_H_
+#define PSXACKPIN_H_
+
+#include "PsxNewLib.h"
+#include <DigitalIO.h>
+
+/** \brief No Acknowledge pin
+ *
+ * Use this as the \a PIN_ACK template parameter of the controller classes when
+ * the \a Acknowledge line is not connected.
+ */
+const uint8_t PSX_NO_ACK_PIN = 0xFF;
+
+/** \brief Acknowledge timeout (us)
+ *
+ * Longest time to wait for the controller to acknowledge a byte. If the pulse
+ * doesn't come, we go on anyway, so a missing or broken connection on the
+ * \a Acknowledge line makes things no worse than not using it at all.
+ */
+const byte ACK_TIMEOUT = INTER_CMD_BYTE_DELAY;
+
+/** \brief Acknowledge line watcher
+ *
+ * The \a Acknowledge line is pulsed low by the controller for a few
+ * microseconds after every byte but the last of a reply, as soon as it is
+ * ready to receive the next one. This usually happens much earlier than
+ * #INTER_CMD_BYTE_DELAY.
+ *
+ * The line is open-collector, so it needs a pull-up, just like \a Data.
+ */
+template <uint8_t PIN_ACK>
+class PsxAckPin {
+private:
+	DigitalPin<PIN_ACK> ack;
+
+public:
+	//! \brief True if the \a Acknowledge line is actually watched
+	static const boolean CONNECTED = true;
+
+	void begin () {
+		ack.config (INPUT, HIGH);     // Enable pull-up
+	}
+
+	/** \brief Wait for the controller to acknowledge the last byte
+	 *
+	 * \param[in] lastByte true if the byte was the last of the reply, in which
+	 *                     case no acknowledge will come and we return at once
+	 */
+	void wait (const boolean lastByte) {
+		if (!lastByte) {
+			unsigned long start = micros ();
+			while (ack && micros () - start < ACK_TIMEOUT)
+				;
+		}
+	}
+
+	/** \brief Check if the controller is acknowledging the last byte
+	 *
+	 * This is the non-blocking counterpart of wait(), the pulse is short so it
+	 * must be called often to catch it.
+	 *
+	 * \param[in] lastByte true if the byte was the last of the reply
+	 * \return true if the controller is ready for the next byte
+	 */
+	boolean check (const boolean lastByte) {
+		return lastByte || !ack;
+	}
+};
+
+/** \brief Acknowledge line watcher, when the line is not connected
+ *
+ * This just waits for #INTER_CMD_BYTE_DELAY after every byte, as we always did.
+ */
+template <>
+class PsxAckPin<PSX_NO_ACK_PIN> {
+public:
+	static const boolean CONNECTED = false;
+
+	void begin () {
+	}
+
+	void wait (const boolean lastByte) {
+		(void) lastByte;
+		delayMicroseconds (INTER_CMD_BYTE_DELAY);
+	}
+
+	boolean check (const boolean lastByte) {
+		(void) lastByte;
+		return false;
+	}
+};
+
+#endif
@@ -0,0 +1,617 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file PsxBus.h
+ * \brief Several controllers on a single hardware SPI bus
+ */
+
+#ifndef PSXBUS_H_
+#define PSXBUS_H_
+
+#include "PsxNewLib.h"
+#include "PsxAckPin.h"
+#include "PsxControllerHwSpi.h"
+#include <SPI.h>
+#include <DigitalIO.h>
+
+/** \brief Attention Line Selector
+ *
+ * Controllers sharing a bus are told apart by their \a Attention lines. This
+ * is the interface to whatever drives them, so that they can come from plain
+ * pins, a decoder, a shift register, etc.
+ */
+class PsxAttSelector {
+public:
+	//! \brief Initialize the selector, leaving all lines deasserted
+	virtual void begin () = 0;
+
+	/** \brief Assert the Attention line of a controller
+	 *
+	 * \param[in] pad Index of the controller
+	 */
+	virtual void select (const byte pad) = 0;
+
+	//! \brief Deassert all Attention lines
+	virtual void deselect () = 0;
+};
+
+/** \brief Attention Line Selector using one pin per controller
+ *
+ * \code
+ * const byte attPins[] = {7, 8, 9, 10};
+ * PsxAttPinSelector selector (attPins, sizeof (attPins));
+ * \endcode
+ */
+class PsxAttPinSelector: public PsxAttSelector {
+private:
+	const byte *pins;
+	byte pinsNo;
+	byte selected;
+
+public:
+	/** \brief Constructor
+	 *
+	 * \param[in] attPins Array of pins the Attention lines are connected to,
+	 *                    must be valid for the whole lifetime of the object
+	 * \param[in] n Number of entries in \a attPins
+	 */
+	PsxAttPinSelector (const byte *attPins, const byte n): pins (attPins), pinsNo (n), selected (0) {
+	}
+
+	virtual void begin () override {
+		for (byte i = 0; i < pinsNo; ++i) {
+			pinMode (pins[i], OUTPUT);
+			digitalWrite (pins[i], HIGH);
+		}
+	}
+
+	virtual void select (const byte pad) override {
+		if (pad < pinsNo) {
+			selected = pad;
+			digitalWrite (pins[pad], LOW);
+		}
+	}
+
+	virtual void deselect () override {
+		digitalWrite (pins[selected], HIGH);
+	}
+};
+
+/** \brief Attention Line Selector using a 74HC138 decoder
+ *
+ * This drives up to 8 controllers with just 4 pins. The outputs of the '138
+ * are active-low, just like Attention, so they can be connected directly (with
+ * the usual level shifting). A0-A2 select the output, \a PIN_EN must be
+ * connected to the active-low G2A enable input, while G1 must be tied high and
+ * G2B low.
+ */
+template <uint8_t PIN_A0, uint8_t PIN_A1, uint8_t PIN_A2, uint8_t PIN_EN>
+class PsxAtt138Selector: public PsxAttSelector {
+private:
+	DigitalPin<PIN_A0> a0;
+	DigitalPin<PIN_A1> a1;
+	DigitalPin<PIN_A2> a2;
+	DigitalPin<PIN_EN> en;
+
+public:
+	virtual void begin () override {
+		en.config (OUTPUT, HIGH);     // HIGH -> All outputs high
+		a0.config (OUTPUT, LOW);
+		a1.config (OUTPUT, LOW);
+		a2.config (OUTPUT, LOW);
+	}
+
+	virtual void select (const byte pad) override {
+		a0.write (pad & 0x01);
+		a1.write (pad & 0x02);
+		a2.write (pad & 0x04);
+		en.low ();
+	}
+
+	virtual void deselect () override {
+		en.high ();
+	}
+};
+
+/** \brief Attention Line Selector using a 74HC595 shift register
+ *
+ * This drives up to 8 controllers with just 3 pins, through the QA-QH outputs
+ * of the '595. Selecting a controller takes a bit longer than with a '138, as
+ * 8 bits must be shifted out every time.
+ */
+template <uint8_t PIN_DATA, uint8_t PIN_CLK, uint8_t PIN_LATCH>
+class PsxAtt595Selector: public PsxAttSelector {
+private:
+	DigitalPin<PIN_DATA> data;
+	DigitalPin<PIN_CLK> clk;
+	DigitalPin<PIN_LATCH> latch;
+
+	void write (const byte outputs) {
+		for (int8_t i = 7; i >= 0; --i) {
+			data.write (bitRead (outputs, i));
+			clk.high ();
+			clk.low ();
+		}
+		latch.high ();
+		latch.low ();
+	}
+
+public:
+	virtual void begin () override {
+		data.config (OUTPUT, HIGH);
+		clk.config (OUTPUT, LOW);
+		latch.config (OUTPUT, LOW);
+		write (0xFF);
+	}
+
+	virtual void select (const byte pad) override {
+		write (~(1U << pad));
+	}
+
+	virtual void deselect () override {
+		write (0xFF);
+	}
+};
+
+/** \brief Several PSX Controllers on a Hardware SPI bus
+ *
+ * This talks to up to \a PADS_NO controllers that share the \a Command,
+ * \a Data, \a Clock (and optionally \a Acknowledge) lines of the hardware SPI
+ * port, while each has its own \a Attention line, driven through a
+ * PsxAttSelector.
+ *
+ * Compared to having one PsxControllerHwSpi per controller:
+ * - All controllers share a single communication buffer, while the data of
+ *   each is kept in a PsxControllerPort, available through getPad().
+ * - pollAll() polls all controllers within a single SPI transaction.
+ * - The time to wait after deasserting the Attention line of a controller
+ *   overlaps with the time to wait after asserting that of the next one, as
+ *   only the latter is actually needed.
+ *
+ * Configuration functions (enterConfigMode() and friends), as well as read()
+ * and configure(), are inherited from PsxController and act on the controller
+ * chosen with selectPad(), whose data is then updated in getPad(). Every
+ * controller has its own rumble settings (setRumble(), setRumbleSource(),
+ * etc.) and clock speed (calibrateClock(), etc.), which also apply to that
+ * chosen with selectPad(), but they take effect whenever it is polled.
+ *
+ * The inspection functions of the bus itself are not meaningful, use those of
+ * getPad(). The non-blocking polling functions and update() are not
+ * available.
+ */
+template <byte PADS_NO, uint8_t PIN_ACK = PSX_NO_ACK_PIN>
+class PsxBus: public PsxController {
+protected:
+	PsxAttSelector& selector;
+
+	DigitalPin<MOSI> cmd;
+	DigitalPin<MISO> dat;
+	DigitalPin<SCK> clk;
+	PsxAckPin<PIN_ACK> ack;
+
+	//! \brief Data of all controllers
+	PsxControllerPort pads[PADS_NO];
+
+	/** \brief Link State of a Controller
+	 *
+	 * What PsxController keeps about the controller it talks to, apart from
+	 * its data. That of the current controller lives in PsxController itself,
+	 * selectPad() swaps it in and out of #links.
+	 */
+	struct PadLink {
+		boolean rumbleEnabled;
+		byte motor1Level;
+		byte motor2Level;
+		PsxRumbleSource *rumbleSource;
+		byte clockLevel;
+		boolean clockCalibrated;
+		byte calibratedClockLevel;
+		byte clockErrors;
+		byte clockGoodPolls;
+		byte predictedFrameLen;
+	};
+
+	//! \brief Link state of all controllers, but the current one
+	PadLink links[PADS_NO];
+
+	//! \brief Settings for the clock speed of the current controller
+	SPISettings settings;
+
+	//! \brief Controller the Attention functions act on
+	byte currentPad;
+
+	//! \brief Controller pollNext() will poll
+	byte nextPad;
+
+	//! \brief True while pollAll() keeps an SPI transaction open
+	boolean inRound;
+
+	//! \brief Clock speed level of the transaction opened by pollAll()
+	byte roundClockLevel;
+
+	//! \brief Controller left in Configuration Mode, see isConfigStuck()
+	byte stuckPad;
+
+	//! \brief Controller whose Attention line was last deasserted
+	byte lastPad;
+
+	//! \brief Time Attention was last deasserted (us)
+	unsigned long lastRelease;
+
+	//! \name Statistics
+	//! @{
+	unsigned long pollsOk;			//!< Successful polls since resetPollStats()
+	unsigned long statsStart;		//!< Time of last resetPollStats() (ms)
+	//! @}
+
+	virtual void attention () override {
+		assertAttention ();
+		delayMicroseconds (ATTN_DELAY);
+	}
+
+	virtual void assertAttention () override {
+		traceAttention (true);
+
+		// The same controller must not be selected again too soon
+		if (currentPad == lastPad) {
+			unsigned long elapsed = micros () - lastRelease;
+			if (elapsed < ATTN_DELAY) {
+				delayMicroseconds (ATTN_DELAY - elapsed);
+			}
+		}
+
+		if (!inRound) {
+			SPI.beginTransaction (settings);
+		} else if (clockLevel != roundClockLevel) {
+			// Not all controllers go at the same speed
+			SPI.endTransaction ();
+			SPI.beginTransaction (settings);
+			roundClockLevel = clockLevel;
+		}
+		selector.select (currentPad);
+	}
+
+	/* We don't wait after deasserting Attention here: if the next controller
+	 * we talk to is a different one, there's no need to. If it's the same
+	 * one, assertAttention() will take care of it.
+	 */
+	virtual void noAttention () override {
+		releaseAttention ();
+	}
+
+	virtual void releaseAttention () override {
+		if (!inRound) {
+			SPI.endTransaction ();
+		}
+
+		// Make sure CMD and CLK sit high
+		cmd.high ();
+		clk.high ();
+		selector.deselect ();
+
+		lastPad = currentPad;
+		lastRelease = micros ();
+
+		traceAttention (false);
+	}
+
+	virtual byte shiftInOut (const byte out) override {
+		return SPI.transfer (out);
+	}
+
+	virtual void waitAck (const boolean lastByte) override {
+		ack.wait (lastByte);
+	}
+
+	virtual byte getClockLevelsNo () const override {
+		return sizeof (HWSPI_CLOCKS) / sizeof (HWSPI_CLOCKS[0]);
+	}
+
+	virtual byte getDefaultClockLevel () const override {
+		return HWSPI_DEFAULT_CLOCK;
+	}
+
+	virtual void applyClockLevel (const byte level) override {
+		settings = SPISettings (HWSPI_CLOCKS[level], LSBFIRST, SPI_MODE3);
+	}
+
+	//! \brief Save the link state of the current controller to #links
+	void saveLink () {
+		PadLink& l = links[currentPad];
+		l.rumbleEnabled = rumbleEnabled;
+		l.motor1Level = motor1Level;
+		l.motor2Level = motor2Level;
+		l.rumbleSource = rumbleSource;
+		l.clockLevel = clockLevel;
+		l.clockCalibrated = clockCalibrated;
+		l.calibratedClockLevel = calibratedClockLevel;
+		l.clockErrors = clockErrors;
+		l.clockGoodPolls = clockGoodPolls;
+		l.predictedFrameLen = predictedFrameLen;
+	}
+
+	//! \brief Restore the link state of the current controller from #links
+	void loadLink () {
+		const PadLink& l = links[currentPad];
+		rumbleEnabled = l.rumbleEnabled;
+		motor1Level = l.motor1Level;
+		motor2Level = l.motor2Level;
+		rumbleSource = l.rumbleSource;
+		clockCalibrated = l.clockCalibrated;
+		calibratedClockLevel = l.calibratedClockLevel;
+		clockErrors = l.clockErrors;
+		clockGoodPolls = l.clockGoodPolls;
+		predictedFrameLen = l.predictedFrameLen;
+		setClockLevel (l.clockLevel);
+	}
+
+	// Only the current controller is ever polled, and its data go to getPad()
+	using PsxController::beginPoll;
+	using PsxController::tick;
+	using PsxController::beginConfig;
+	using PsxController::update;
+
+	virtual boolean checkAck (const boolean lastByte) override {
+		return ack.check (lastByte);
+	}
+
+public:
+	/** \brief Constructor
+	 *
+	 * \param[in] sel The selector driving the Attention lines
+	 */
+	explicit PsxBus (PsxAttSelector& sel): selector (sel), currentPad (0), nextPad (0),
+	                                       inRound (false), roundClockLevel (0), stuckPad (0), lastPad (0xFF),
+	                                       lastRelease (0), pollsOk (0), statsStart (0) {
+		for (byte i = 0; i < PADS_NO; ++i) {
+			links[i].rumbleSource = NULL;
+		}
+	}
+
+	/** \brief Initialize library
+	 *
+	 * \return true if at least one controller was found, false otherwise
+	 */
+	virtual boolean begin () override {
+		selector.begin ();
+
+		cmd.config (OUTPUT, HIGH);
+		clk.config (OUTPUT, HIGH);
+		dat.config (INPUT, HIGH);     // Enable pull-up
+		ack.begin ();
+
+		SPI.begin ();
+
+		// Rumble sources are kept, just like PsxController does
+		saveLink ();
+		for (byte i = 0; i < PADS_NO; ++i) {
+			pads[i].reset ();
+
+			PadLink& l = links[i];
+			l.rumbleEnabled = false;
+			l.motor1Level = 0x00;
+			l.motor2Level = 0x00;
+			l.clockLevel = getDefaultClockLevel ();
+			l.clockCalibrated = false;
+			l.calibratedClockLevel = 0;
+			l.clockErrors = 0;
+			l.clockGoodPolls = 0;
+			l.predictedFrameLen = 0;
+		}
+
+		// This also gets the first controller going
+		currentPad = 0;
+		loadLink ();
+		PsxController::begin ();
+
+		// Some disposable readings to let the others know we are here
+		for (byte i = 0; i < 5; ++i) {
+			pollAll ();
+			delay (1);
+		}
+
+		resetPollStats ();
+
+		return pollAll () > 0;
+	}
+
+	/** \brief Choose the controller to act on
+	 *
+	 * All functions inherited from PsxController will talk to this controller
+	 * from now on.
+	 *
+	 * \param[in] pad Index of the controller [0 - PADS_NO-1]
+	 */
+	void selectPad (const byte pad) {
+		if (pad < PADS_NO && pad != currentPad) {
+			saveLink ();
+			currentPad = pad;
+			loadLink ();
+		}
+	}
+
+	//! \brief Get the controller chosen with selectPad()
+	byte getSelectedPad () const {
+		return currentPad;
+	}
+
+	/** \brief Poll the selected controller
+	 *
+	 * This is the same as calling pollPad() on the controller chosen with
+	 * selectPad().
+	 *
+	 * \return true if the controller replied, false otherwise
+	 */
+	virtual boolean read () override {
+		return pollPad (currentPad);
+	}
+
+	/** \brief Get a controller out of Configuration Mode
+	 *
+	 * This works on the controller that pollPad() last found stuck, rather
+	 * than on the selected one.
+	 *
+	 * \return true if the controller is out of Configuration Mode
+	 */
+	virtual boolean recoverConfig () override {
+		byte oldPad = currentPad;
+		selectPad (stuckPad);
+		boolean ret = PsxController::recoverConfig ();
+		selectPad (oldPad);
+
+		return ret;
+	}
+
+	/** \brief Configure the selected controller
+	 *
+	 * See PsxController::configure(). The controller is polled once more
+	 * afterwards, so that its data is up to date.
+	 *
+	 * \param[in] profile The configuration to apply
+	 * \return true if the controller reported the requested mode, false
+	 *         otherwise
+	 */
+	boolean configure (const PsxConfigProfile& profile) {
+		boolean ret = PsxController::configure (profile);
+		pollPad (currentPad);
+
+		return ret;
+	}
+
+	/** \brief Poll a single controller
+	 *
+	 * \param[in] pad Index of the controller [0 - PADS_NO-1]
+	 * \return true if the controller replied, false otherwise
+	 */
+	boolean pollPad (const byte pad) {
+		boolean ret = false;
+
+		if (pad < PADS_NO) {
+			byte oldPad = currentPad;
+			selectPad (pad);
+
+			updateRumble ();
+			byte out[sizeof (poll)];
+			byte *in = sendCommand (out, makePollCommand (out));
+
+			if (in == NULL) {
+				pads[pad].disconnect ();
+				clockFallback ();
+			} else if (isConfigReply (in)) {
+				// We're stuck in config mode, try to get out
+				stuckPad = pad;
+				configReplyReceived ();
+				pads[pad].disconnect ();
+			} else {
+				pads[pad].updateFromReply (in);
+				ret = pads[pad].isConnected ();
+				if (ret) {
+					clockSuccess ();
+				}
+				if (pad == stuckPad) {
+					configStuck = false;
+				}
+			}
+
+			if (ret) {
+				++pollsOk;
+			}
+
+			selectPad (oldPad);
+		}
+
+		return ret;
+	}
+
+	/** \brief Poll the next controller, round-robin
+	 *
+	 * \return true if the controller replied, false otherwise
+	 */
+	boolean pollNext () {
+		boolean ret = pollPad (nextPad);
+
+		if (++nextPad >= PADS_NO) {
+			nextPad = 0;
+		}
+
+		return ret;
+	}
+
+	/** \brief Poll all controllers
+	 *
+	 * \return The number of controllers that replied
+	 */
+	byte pollAll () {
+		byte ret = 0;
+
+		SPI.beginTransaction (settings);
+		roundClockLevel = clockLevel;
+		inRound = true;
+		for (byte i = 0; i < PADS_NO; ++i) {
+			if (pollPad (i)) {
+				++ret;
+			}
+		}
+		inRound = false;
+		SPI.endTransaction ();
+
+		return ret;
+	}
+
+	/** \brief Retrieve a controller
+	 *
+	 * \param[in] pad Index of the controller [0 - PADS_NO-1]
+	 * \return The controller, whose data is updated whenever it is polled
+	 */
+	const PsxControllerPort& getPad (const byte pad) const {
+		return pads[pad < PADS_NO ? pad : 0];
+	}
+
+	//! \brief Get the number of controllers on the bus
+	byte getPadsNo () const {
+		return PADS_NO;
+	}
+
+	/** \brief Get the number of successful polls per second
+	 *
+	 * This is the aggregate over all controllers, since the last call to
+	 * resetPollStats(), which should be called every now and then as the
+	 * count will overflow after a few million polls.
+	 *
+	 * \return The number of polls per second
+	 */
+	unsigned long getPollsPerSecond () const {
+		unsigned long ret = 0;
+
+		unsigned long elapsed = millis () - statsStart;
+		if (elapsed > 0) {
+			ret = pollsOk * 1000UL / elapsed;
+		}
+
+		return ret;
+	}
+
+	//! \brief Restart counting polls
+	void resetPollStats () {
+		pollsOk = 0;
+		statsStart = millis ();
+	}
+};
+
+#endif
@@ -1,14 +1,11 @@
+#ifndef PSXCONTROLLERBITBANG_H_
+#define PSXCONTROLLERBITBANG_H_
+
 #include "PsxNewLib.h"
+#include "PsxAckPin.h"
 #include <DigitalIO.h>
 
-/** \brief Attention Delay
- *
- * Time between attention being issued to the controller and the first clock
- * edge (us).
- */
-const byte ATTN_DELAY = 50;
-
-/** \brief Clock Period
+/** \brief Default Clock Period
  *
  * Inverse of clock frequency, i.e.: time for a *full* clock cycle, from falling
  * edge to the next falling edge.
@@ -18,33 +15,150 @@ const byte CLK_PERIOD = 40;
 // Must be < CLK_PERIOD / 2
 const byte HOLD_TIME = 2;
 
+/** \brief Clock Periods
+ *
+ * These are the clock periods PsxController::calibrateClock() can choose from,
+ * slowest first. They must all be > 2 * #HOLD_TIME.
+ */
+static const byte BITBANG_CLK_PERIODS[] = {80, CLK_PERIOD, 20, 10, 6};
+
+//! \brief Default clock period, index into #BITBANG_CLK_PERIODS
+const byte BITBANG_DEFAULT_CLOCK = 1;
+
+/** \brief Cycles spent by the bit loop in every half clock period
+ *
+ * This is roughly what toggling a pin, setting or sampling a data bit and
+ * looping take on AVR, and it is subtracted from compile-time delays.
+ */
+const byte BITBANG_LOOP_CYCLES = 4;
+
+/** \brief Compile-Time Delay
+ *
+ * On AVR, this waits for an exact number of CPU cycles, computed at compile
+ * time from \a NS and \a F_CPU, minus \a OVERHEAD cycles that the caller
+ * spends anyway. Elsewhere it falls back to delayMicroseconds(), rounding up.
+ *
+ * \tparam NS Time to wait (ns)
+ * \tparam OVERHEAD Cycles to subtract
+ */
+template <uint16_t NS, byte OVERHEAD = 0>
+struct PsxDelayNs {
+#if defined (__AVR__)
+	//! \brief Number of cycles to wait for
+	static const unsigned long CYCLES_FULL = (unsigned long) NS * (F_CPU / 1000000UL) / 1000UL;
+	static const unsigned long CYCLES = CYCLES_FULL > OVERHEAD ? CYCLES_FULL - OVERHEAD : 0;
+#endif
+
+	static void wait () {
+#if defined (__AVR__)
+		__builtin_avr_delay_cycles (CYCLES);
+#else
+		delayMicroseconds ((NS + 999U) / 1000U);
+#endif
+	}
+};
+
+
+/** \brief Bit-banged PSX Controller Interface
+ *
+ * This drives the controller through any four pins, plus an optional fifth one
+ * for the \a Acknowledge line. When \a PIN_ACK is given, every byte is sent as
+ * soon as the controller acknowledges the previous one, rather than after the
+ * fixed #INTER_CMD_BYTE_DELAY.
+ *
+ * By default, the clock is timed with delayMicroseconds(), at one of the
+ * #BITBANG_CLK_PERIODS, which calibrateClock() can pick from. This is not
+ * very accurate, particularly at short periods, so the actual clock ends up
+ * somewhat slower than nominal.
+ *
+ * Alternatively, a fixed clock period can be given in nanoseconds, in which
+ * case the delays are turned into exact cycle counts at compile time on AVR.
+ * This makes clocks up to 250-500 kHz possible, i.e.:
+ *
+ * \code
+ * // 250 kHz clock, just like PsxControllerHwSpi
+ * PsxControllerBitBang<PIN_PS2_ATT, PIN_PS2_CMD, PIN_PS2_DAT, PIN_PS2_CLK, PSX_NO_ACK_PIN, 4000> psx;
+ * \endcode
+ *
+ * calibrateClock() then has nothing to choose from.
+ *
+ * \tparam CLK_PERIOD_NS Fixed clock period (ns), 0 to use #BITBANG_CLK_PERIODS
+ * \tparam HOLD_TIME_NS Time data is held after a clock edge (ns), only used
+ *                      with \a CLK_PERIOD_NS, 0 for a quarter of the period
+ */
+template <uint8_t PIN_ATT, uint8_t PIN_CMD, uint8_t PIN_DAT, uint8_t PIN_CLK, uint8_t PIN_ACK = PSX_NO_ACK_PIN,
+          uint16_t CLK_PERIOD_NS = 0, uint16_t HOLD_TIME_NS = 0>
+class PsxControllerBitBang: public PsxControllerStatic<PsxControllerBitBang<PIN_ATT, PIN_CMD, PIN_DAT, PIN_CLK, PIN_ACK, CLK_PERIOD_NS, HOLD_TIME_NS> > {
+	friend class PsxControllerStatic<PsxControllerBitBang>;
 
-template <uint8_t PIN_ATT, uint8_t PIN_CMD, uint8_t PIN_DAT, uint8_t PIN_CLK>
-class PsxControllerBitBang: public PsxController {
 private:
 	DigitalPin<PIN_ATT> att;
 	DigitalPin<PIN_CLK> clk;
 	DigitalPin<PIN_CMD> cmd;
 	DigitalPin<PIN_DAT> dat;
+	PsxAckPin<PIN_ACK> ack;
+
+	//! \brief Current clock period, when not fixed
+	byte clkPeriod;
+
+	//! \brief Hold time, when the clock period is fixed (ns)
+	static const uint16_t HOLD_NS = HOLD_TIME_NS != 0 ? HOLD_TIME_NS : CLK_PERIOD_NS / 4;
+
+	static_assert (CLK_PERIOD_NS == 0 || HOLD_NS < CLK_PERIOD_NS / 2, "Hold time must be shorter than half the clock period");
+
+	//! \brief Wait after a clock edge, before touching data
+	void holdDelay () const {
+		if (CLK_PERIOD_NS != 0) {
+			PsxDelayNs<HOLD_NS>::wait ();
+		} else {
+			delayMicroseconds (HOLD_TIME);
+		}
+	}
+
+	//! \brief Wait for the rest of half a clock period
+	void halfPeriodDelay () const {
+		if (CLK_PERIOD_NS != 0) {
+			PsxDelayNs<CLK_PERIOD_NS / 2 - HOLD_NS, BITBANG_LOOP_CYCLES>::wait ();
+		} else {
+			delayMicroseconds (clkPeriod / 2 - HOLD_TIME);
+		}
+	}
 
 protected:
 	virtual void attention () override {
-		att.low ();
+		assertAttention ();
 		delayMicroseconds (ATTN_DELAY);
 	}
+
+	virtual void assertAttention () override {
+		this->traceAttention (true);
+		att.low ();
+	}
 	
 	virtual void noAttention () override {
 		//~ delayMicroseconds (5);
 
+		releaseAttention ();
+		delayMicroseconds (ATTN_DELAY);
+	}
+
+	virtual void releaseAttention () override {
 		cmd.high ();
 		clk.high ();
 		att.high ();
-		delayMicroseconds (ATTN_DELAY);
+
+		this->traceAttention (false);
 	}
 	
 	virtual byte shiftInOut (const byte out) override {
 		byte in = 0;
 
+		/* Bits go LSB first, shift them through rather than using bitRead()
+		 * and bitSet(), which are slow with a variable bit number and would
+		 * throw the timing off
+		 */
+		byte data = out;
+
 		// 1. The clock is held high until a byte is to be sent.
 
 		for (byte i = 0; i < 8; ++i) {
@@ -52,38 +166,68 @@ protected:
 			// change
 			clk.low ();
 
-			delayMicroseconds (HOLD_TIME);
-			
-			if (bitRead (out, i)) {
+			holdDelay ();
+
+			if (data & 0x01) {
 				cmd.high ();
 			} else {
 				cmd.low ();
 			}
+			data >>= 1;
 
-			delayMicroseconds (CLK_PERIOD / 2 - HOLD_TIME);
+			halfPeriodDelay ();
 
 			// 3. When the clock goes from low to high, value are actually read
 			clk.high ();
 
-			delayMicroseconds (HOLD_TIME);
-			
+			holdDelay ();
+
+			in >>= 1;
 			if (dat) {
-				bitSet (in, i);
+				in |= 0x80;
 			}
 
-			delayMicroseconds (CLK_PERIOD / 2 - HOLD_TIME);
+			/* If we're watching ACK, don't wait after the last bit, or we
+			 * might miss the pulse
+			 */
+			if (i < 7 || !PsxAckPin<PIN_ACK>::CONNECTED) {
+				halfPeriodDelay ();
+			}
 		}
 
 		return in;
 	}
 
+	virtual void waitAck (const boolean lastByte) override {
+		ack.wait (lastByte);
+	}
+
+	virtual boolean checkAck (const boolean lastByte) override {
+		return ack.check (lastByte);
+	}
+
+	virtual byte getClockLevelsNo () const override {
+		return CLK_PERIOD_NS != 0 ? 1 : sizeof (BITBANG_CLK_PERIODS);
+	}
+
+	virtual byte getDefaultClockLevel () const override {
+		return CLK_PERIOD_NS != 0 ? 0 : BITBANG_DEFAULT_CLOCK;
+	}
+
+	virtual void applyClockLevel (const byte level) override {
+		clkPeriod = BITBANG_CLK_PERIODS[level];
+	}
+
 public:
 	virtual boolean begin () override {
 		att.config (OUTPUT, HIGH);    // HIGH -> Controller not selected
 		cmd.config (OUTPUT, HIGH);
 		clk.config (OUTPUT, HIGH);
 		dat.config (INPUT, HIGH);     // Enable pull-up
+		ack.begin ();
 
 		return PsxController::begin ();
 	}
 };
+
+#endif
@@ -1,50 +1,96 @@
+#ifndef PSXCONTROLLERHWSPI_H_
+#define PSXCONTROLLERHWSPI_H_
+
 #include "PsxNewLib.h"
+#include "PsxAckPin.h"
 #include <SPI.h>
 #include <DigitalIO.h>
 
-/** \brief Attention Delay
+/** \brief Hardware SPI clock speeds (Hz)
  *
- * Time between attention being issued to the controller and the first clock
- * edge (us).
+ * These are the speeds PsxController::calibrateClock() can choose from,
+ * slowest first.
  */
-const byte ATTN_DELAY = 50;
+static const unsigned long HWSPI_CLOCKS[] = {125000, 250000, 500000, 1000000};
+
+//! \brief Default hardware SPI clock speed, index into #HWSPI_CLOCKS
+const byte HWSPI_DEFAULT_CLOCK = 1;
 
-// Set up the speed, data order and data mode
-static SPISettings spiSettings (250000, LSBFIRST, SPI_MODE3);
+/** \brief Hardware SPI PSX Controller Interface
+ *
+ * This drives the controller through the hardware SPI pins, plus any pin for
+ * \a Attention and an optional one for the \a Acknowledge line. When \a PIN_ACK
+ * is given, every byte is sent as soon as the controller acknowledges the
+ * previous one, rather than after the fixed #INTER_CMD_BYTE_DELAY.
+ */
+template <uint8_t PIN_ATT, uint8_t PIN_ACK = PSX_NO_ACK_PIN>
+class PsxControllerHwSpi: public PsxControllerStatic<PsxControllerHwSpi<PIN_ATT, PIN_ACK> > {
+	friend class PsxControllerStatic<PsxControllerHwSpi>;
 
-template <uint8_t PIN_ATT>
-class PsxControllerHwSpi: public PsxController {
-private:
+protected:
 	DigitalPin<PIN_ATT> att;
 	DigitalPin<MOSI> cmd;
 	DigitalPin<MISO> dat;
 	DigitalPin<SCK> clk;
+	PsxAckPin<PIN_ACK> ack;
+
+	//! \brief Settings for the current clock speed
+	SPISettings settings;
 
-protected:
 	virtual void attention () override {
-		att.low ();
+		assertAttention ();
+		delayMicroseconds (ATTN_DELAY);
+	}
 
-		SPI.beginTransaction (spiSettings);
+	virtual void assertAttention () override {
+		this->traceAttention (true);
+		att.low ();
 
-		delayMicroseconds (ATTN_DELAY);
+		SPI.beginTransaction (settings);
 	}
 	
 	virtual void noAttention () override {
 		//~ delayMicroseconds (5);
 		
+		releaseAttention ();
+		delayMicroseconds (ATTN_DELAY);
+	}
+
+	virtual void releaseAttention () override {
 		SPI.endTransaction ();
 
 		// Make sure CMD and CLK sit high
 		cmd.high ();
 		clk.high ();
 		att.high ();
-		delayMicroseconds (ATTN_DELAY);
+
+		this->traceAttention (false);
 	}
 	
 	virtual byte shiftInOut (const byte out) override {
 		return SPI.transfer (out);
 	}
 
+	virtual void waitAck (const boolean lastByte) override {
+		ack.wait (lastByte);
+	}
+
+	virtual boolean checkAck (const boolean lastByte) override {
+		return ack.check (lastByte);
+	}
+
+	virtual byte getClockLevelsNo () const override {
+		return sizeof (HWSPI_CLOCKS) / sizeof (HWSPI_CLOCKS[0]);
+	}
+
+	virtual byte getDefaultClockLevel () const override {
+		return HWSPI_DEFAULT_CLOCK;
+	}
+
+	virtual void applyClockLevel (const byte level) override {
+		settings = SPISettings (HWSPI_CLOCKS[level], LSBFIRST, SPI_MODE3);
+	}
+
 public:
 	virtual boolean begin () override {
 		att.config (OUTPUT, HIGH);    // HIGH -> Controller not selected
@@ -56,9 +102,12 @@ public:
 		cmd.config (OUTPUT, HIGH);
 		clk.config (OUTPUT, HIGH);
 		dat.config (INPUT, HIGH);     // Enable pull-up
+		ack.begin ();
 
 		SPI.begin ();
 
 		return PsxController::begin ();
 	}
 };
+
+#endif
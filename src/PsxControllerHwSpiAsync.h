@@ -0,0 +1,367 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file PsxControllerHwSpiAsync.h
+ * \brief Interrupt-driven hardware SPI PSX Controller Interface
+ *
+ * Note that this file defines the SPI and timer interrupt handlers on AVR, so
+ * it must only be included in a single source file. Define
+ * PSX_SPI_ASYNC_NO_ISR before including it in any others.
+ */
+
+#ifndef PSXCONTROLLERHWSPIASYNC_H_
+#define PSXCONTROLLERHWSPIASYNC_H_
+
+#include "PsxControllerHwSpi.h"
+
+/** \brief Interrupt Handler Interface
+ *
+ * The SPI and timer interrupt handlers forward to the object that is
+ * currently transferring a frame through this.
+ */
+class PsxSpiAsyncHandler {
+public:
+	//! \brief Called when a byte has been transferred on the SPI bus
+	virtual void onTransferComplete () = 0;
+
+	//! \brief Called when the timer started by the port expires
+	virtual void onTimer () = 0;
+
+	/** \brief Handler the interrupts are forwarded to
+	 *
+	 * \return A reference to the pointer to the current handler, which is
+	 *         NULL when no frame is being transferred
+	 */
+	static PsxSpiAsyncHandler*& current () {
+		static PsxSpiAsyncHandler *handler = NULL;
+		return handler;
+	}
+};
+
+#if defined (__AVR__)
+
+/** \brief AVR Hardware Access for PsxControllerHwSpiAsync
+ *
+ * Transfers are driven by the SPI Transfer Complete interrupt, while delays
+ * are timed through the Compare Match A interrupt of Timer 2 (or Timer 3 on
+ * the ATmega32U4, which has no Timer 2). Those timers are then no longer
+ * available to other libraries, i.e.: tone() won't work.
+ *
+ * Any other class providing the same static functions can be used in place of
+ * this, for instance to run on a different platform or on a mock peripheral,
+ * like the one in test/hwspi_async.cpp.
+ */
+struct PsxSpiAsyncAvrPort {
+	//! \brief Set up the timer
+	static void begin () {
+#if defined (TCCR2A)
+		TCCR2A = _BV (WGM21);		// CTC mode
+		TCCR2B = 0;					// Stopped
+#else
+		TCCR3A = 0;
+		TCCR3B = _BV (WGM32);		// CTC mode, stopped
+#endif
+	}
+
+	/** \brief Start the timer
+	 *
+	 * onTimer() shall be called after the given time.
+	 *
+	 * \param[in] us Time to wait (us), must fit 8 bits once converted to timer
+	 *               ticks at prescaler 8
+	 */
+	static void startTimer (const byte us) {
+		const byte ticks = us * (F_CPU / 8000000UL);
+#if defined (TCCR2A)
+		TCNT2 = 0;
+		OCR2A = ticks - 1;
+		TIFR2 = _BV (OCF2A);
+		TIMSK2 |= _BV (OCIE2A);
+		TCCR2B = _BV (CS21);		// Prescaler 8
+#else
+		TCNT3 = 0;
+		OCR3A = ticks - 1;
+		TIFR3 = _BV (OCF3A);
+		TIMSK3 |= _BV (OCIE3A);
+		TCCR3B = _BV (WGM32) | _BV (CS31);
+#endif
+	}
+
+	//! \brief Stop the timer
+	static void stopTimer () {
+#if defined (TCCR2A)
+		TCCR2B = 0;
+		TIMSK2 &= ~_BV (OCIE2A);
+#else
+		TCCR3B = _BV (WGM32);
+		TIMSK3 &= ~_BV (OCIE3A);
+#endif
+	}
+
+	/** \brief Enable or disable the SPI Transfer Complete interrupt
+	 *
+	 * This must be called after SPI.beginTransaction(), which resets it.
+	 */
+	static void enableTransferInterrupt (const boolean enabled) {
+		if (enabled) {
+			SPCR |= _BV (SPIE);
+		} else {
+			SPCR &= ~_BV (SPIE);
+		}
+	}
+
+	//! \brief Start transferring a byte
+	static void write (const byte out) {
+		SPDR = out;
+	}
+
+	//! \brief Get the byte received by the last transfer
+	static byte read () {
+		return SPDR;
+	}
+};
+
+#ifndef PSX_SPI_ASYNC_NO_ISR
+ISR (SPI_STC_vect) {
+	PsxSpiAsyncHandler *handler = PsxSpiAsyncHandler::current ();
+	if (handler != NULL) {
+		handler->onTransferComplete ();
+	}
+}
+
+#if defined (TCCR2A)
+ISR (TIMER2_COMPA_vect) {
+#else
+ISR (TIMER3_COMPA_vect) {
+#endif
+	PsxSpiAsyncHandler *handler = PsxSpiAsyncHandler::current ();
+	if (handler != NULL) {
+		handler->onTimer ();
+	}
+}
+#endif
+
+#else
+
+// Must be provided explicitly on other platforms
+struct PsxSpiAsyncAvrPort;
+
+#endif
+
+/** \brief Interrupt-driven Hardware SPI PSX Controller Interface
+ *
+ * This is a drop-in replacement for PsxControllerHwSpi, which can poll the
+ * controller in the background: beginFrame() starts a poll, which is then
+ * carried out entirely by interrupt handlers, filling a buffer provided by the
+ * caller, while the main loop is free to do anything else. When
+ * frameComplete() returns true, endFrame() interprets the reply just like
+ * read() does.
+ *
+ * \code
+ * PsxControllerHwSpiAsync<PIN_PS2_ATT> psx;
+ * byte frame[21];
+ *
+ * psx.beginFrame (frame, sizeof (frame));
+ * // Do something else...
+ * if (psx.frameComplete () && psx.endFrame ()) {
+ *     // Use psx.getButtonWord (), etc.
+ * }
+ * \endcode
+ *
+ * All the blocking functions are still available, but they shall not be called
+ * while a frame is being transferred.
+ *
+ * \a PIN_ACK is the same as for PsxControllerHwSpi, but only the blocking
+ * functions watch the \a Acknowledge line: the pulse is too short to be caught
+ * reliably from interrupt handlers, so in background frames the gap between
+ * bytes is always #INTER_CMD_BYTE_DELAY.
+ *
+ * \tparam PORT Class providing access to the SPI and timer hardware, see
+ *              PsxSpiAsyncAvrPort
+ */
+template <uint8_t PIN_ATT, uint8_t PIN_ACK = PSX_NO_ACK_PIN, typename PORT = PsxSpiAsyncAvrPort>
+class PsxControllerHwSpiAsync: public PsxControllerHwSpi<PIN_ATT, PIN_ACK>, public PsxSpiAsyncHandler {
+private:
+	typedef PsxControllerHwSpi<PIN_ATT, PIN_ACK> Base;
+
+protected:
+	//! \brief Phases of a background frame transfer
+	enum FramePhase {
+		FRAME_IDLE = 0,			//!< No frame being transferred
+		FRAME_ATTENTION,		//!< Attention asserted, waiting for #ATTN_DELAY
+		FRAME_TRANSFER,			//!< Waiting for a byte to be transferred
+		FRAME_BYTE_DELAY,		//!< Waiting for #INTER_CMD_BYTE_DELAY
+		FRAME_NO_ATTENTION,		//!< Attention released, waiting for #ATTN_DELAY
+		FRAME_DONE				//!< Frame complete, waiting for endFrame()
+	};
+
+	volatile FramePhase framePhase;		//!< Current phase
+	byte frameCommand[sizeof (poll)];	//!< Command being sent
+	byte frameCommandLen;				//!< Length of #frameCommand
+	byte *frameBuffer;					//!< Caller-owned reply buffer
+	byte frameBufferSize;				//!< Size of #frameBuffer
+	volatile byte framePos;				//!< Index of next byte to exchange
+	volatile byte frameLen;				//!< Full reply length, 0 until known
+
+	//! \brief Release the bus and wait for #ATTN_DELAY
+	void endTransfer () {
+		PORT::enableTransferInterrupt (false);
+		this->releaseAttention ();
+		framePhase = FRAME_NO_ATTENTION;
+		PORT::startTimer (ATTN_DELAY);
+	}
+
+public:
+	PsxControllerHwSpiAsync (): framePhase (FRAME_IDLE), frameBuffer (NULL) {
+	}
+
+	virtual boolean begin () override {
+		framePhase = FRAME_IDLE;
+		PORT::begin ();
+
+		return Base::begin ();
+	}
+
+	virtual void onTransferComplete () override {
+		if (framePhase == FRAME_TRANSFER) {
+			byte in = PORT::read ();
+			this->traceByte (framePos < frameCommandLen ? frameCommand[framePos] : 0x5A, in);
+			frameBuffer[framePos] = in;
+			++framePos;
+
+			if (framePos == 3) {
+				// Header received, get full length
+				if (this->isValidReply (frameBuffer)) {
+					byte len = this->getReplyLength (frameBuffer) + 3;
+					if (len >= frameCommandLen && len <= frameBufferSize) {
+						frameLen = len;
+					}
+				}
+			}
+
+			if (framePos >= 3 && (frameLen == 0 || framePos == frameLen)) {
+				// Either done or not worth going on
+				endTransfer ();
+			} else {
+				framePhase = FRAME_BYTE_DELAY;
+				PORT::startTimer (INTER_CMD_BYTE_DELAY);
+			}
+		}
+	}
+
+	virtual void onTimer () override {
+		PORT::stopTimer ();
+
+		switch (framePhase) {
+			case FRAME_ATTENTION:
+			case FRAME_BYTE_DELAY:
+				framePhase = FRAME_TRANSFER;
+				PORT::write (framePos < frameCommandLen ? frameCommand[framePos] : 0x5A);
+				break;
+			case FRAME_NO_ATTENTION:
+				framePhase = FRAME_DONE;
+				current () = NULL;
+				break;
+			default:
+				break;
+		}
+	}
+
+	//! \name Background Polling Functions
+	//! @{
+
+	/** \brief Start polling the controller in the background
+	 *
+	 * \param[out] buffer Buffer where the reply will be stored, it must stay
+	 *                    valid until the frame is complete. 21 bytes are
+	 *                    enough for any controller.
+	 * \param[in] size Size of \a buffer
+	 * \return true if the poll was started, false if a frame is already being
+	 *         transferred or the buffer is too small
+	 */
+	boolean beginFrame (byte *buffer, const byte size) {
+		boolean ret = false;
+
+		if (framePhase == FRAME_IDLE && current () == NULL && buffer != NULL && size >= sizeof (poll)) {
+			frameBuffer = buffer;
+			frameBufferSize = size;
+			framePos = 0;
+			frameLen = 0;
+			this->updateRumble ();
+			frameCommandLen = this->makeNextPollCommand (frameCommand);
+
+			current () = this;
+			this->assertAttention ();
+			PORT::enableTransferInterrupt (true);
+
+			framePhase = FRAME_ATTENTION;
+			PORT::startTimer (ATTN_DELAY);
+			ret = true;
+		}
+
+		return ret;
+	}
+
+	/** \brief Check if a background poll is complete
+	 *
+	 * \return true if the frame started with beginFrame() has been fully
+	 *         transferred and can be passed to endFrame()
+	 */
+	boolean frameComplete () const {
+		return framePhase == FRAME_DONE;
+	}
+
+	/** \brief Complete a background poll
+	 *
+	 * This interprets the reply and makes it available through all the usual
+	 * inspection functions. The buffer passed to beginFrame() is no longer
+	 * used after this returns.
+	 *
+	 * \return What read() would have returned, false if the frame is not
+	 *         complete
+	 */
+	boolean endFrame () {
+		boolean ret = false;
+
+		if (framePhase == FRAME_DONE) {
+			const byte *in = frameLen > 0 && framePos == frameLen ? frameBuffer : NULL;
+			this->recordFrame (frameCommand, in);
+
+			this->beginState ();
+			ret = this->handlePollReply (in);
+			this->publishState ();
+			framePhase = FRAME_IDLE;
+		}
+
+		return ret;
+	}
+
+	/** \brief Get the length of the last reply
+	 *
+	 * \return The number of bytes of the reply stored in the buffer, only
+	 *         meaningful when frameComplete() is true
+	 */
+	byte getFrameLength () const {
+		return framePos;
+	}
+
+	//! @}
+};
+
+#endif
@@ -0,0 +1,306 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file PsxControllerReplay.h
+ * \brief Replay of recorded polls, for testing and benchmarking the decoder
+ */
+
+#ifndef PSXCONTROLLERREPLAY_H_
+#define PSXCONTROLLERREPLAY_H_
+
+#include "PsxNewLib.h"
+
+/** \brief Recorded Poll Replay Interface
+ *
+ * This does not talk to any real hardware, rather it answers every poll with
+ * the next reply taken from a recording made with PsxFrameRecorder, so that
+ * read() and all the inspection functions behave exactly as they did when the
+ * recording was made. This allows reproducing problems that only show up with
+ * a specific controller, or feeding hours of real data through the decoder as
+ * fast as the CPU allows, i.e.: on the host, through any Arduino API emulation
+ * layer.
+ *
+ * \code
+ * PsxControllerReplay psx (file);
+ *
+ * if (psx.begin ()) {
+ *     while (!psx.isFinished ()) {
+ *         psx.read ();
+ *         // Use psx.getButtonWord (), etc.
+ *     }
+ * }
+ * \endcode
+ *
+ * Commands are answered in order from the records, so the same functions must
+ * be called as when the recording was made, i.e.: begin(), then configure(),
+ * then read() or update() over and over. If a command is found not to match
+ * the recording, isOutOfSync() returns true and the replay stops. Only polls
+ * and 0x43 (which enters and exits Configuration Mode and doubles as a poll)
+ * are recorded, any other command gets the reply a controller in
+ * Configuration Mode would give, without consuming any records. Once the
+ * recording is over, the controller appears to be disconnected.
+ *
+ * No delays are ever waited for. Time is taken from the recording instead:
+ * currentMicros() returns the time of the poll being replayed, relative to
+ * the first one, so that anything based on it (i.e.: button event timestamps)
+ * matches the live session as well. Waits only move it forward until the next
+ * record is replayed.
+ *
+ * The source Stream is read a byte at a time, and all of the recording must be
+ * readily available: any read that fails is taken as the end of it.
+ */
+class PsxControllerReplay: public PsxController {
+protected:
+	//! \brief Where the recording is read from
+	Stream& source;
+
+	//! \brief True once the header of the recording has been read
+	boolean started;
+
+	//! \brief True when the end of the recording has been reached
+	boolean finished;
+
+	//! \brief True if a command didn't match the one in the recording
+	boolean outOfSync;
+
+	//! \name Replay State
+	//! @{
+	unsigned long replayTime;		//!< Time of current record (us)
+	unsigned long waitedTime;		//!< Time waited since current record (us)
+	unsigned long framesReplayed;	//!< Records replayed since begin()
+	boolean selected;				//!< Attention is asserted
+	byte pos;						//!< Position in current transaction
+	byte frame[BUFFER_SIZE];		//!< Reply to current transaction
+	byte frameLen;					//!< Length of #frame
+	//! @}
+
+	//! \brief Read a byte from the recording, -1 at its end
+	int readByte () {
+		int ret = -1;
+
+		if (!finished) {
+			ret = source.read ();
+			if (ret < 0) {
+				finished = true;
+			}
+		}
+
+		return ret;
+	}
+
+	/** \brief Load the next record into #frame
+	 *
+	 * If the command of the record is not the one being sent, the replay
+	 * is out of sync with the recording, so it is stopped right away.
+	 *
+	 * \param[in] cmd The command byte being sent
+	 * \return true if a record was read, false at the end of the recording
+	 */
+	boolean readRecord (const byte cmd) {
+		frameLen = 0;
+
+		int recorded = readByte ();
+		if (recorded >= 0 && recorded != cmd) {
+			outOfSync = true;
+			finished = true;
+		}
+
+		int len = readByte ();
+
+		// Time since the previous record, unsigned LEB128
+		unsigned long delta = 0;
+		byte shift = 0;
+		int b;
+		do {
+			b = readByte ();
+			if (b >= 0 && shift < 32) {
+				delta |= static_cast<unsigned long> (b & 0x7F) << shift;
+			}
+			shift += 7;
+		} while (b >= 0 && (b & 0x80) != 0);
+
+		for (int i = 0; i < len; ++i) {
+			b = readByte ();
+			if (i < BUFFER_SIZE) {
+				frame[i] = b;
+			}
+		}
+
+		if (!finished) {
+			frameLen = len < BUFFER_SIZE ? len : BUFFER_SIZE;
+			replayTime += delta;
+			waitedTime = 0;
+			++framesReplayed;
+		} else {
+			frameLen = 0;
+		}
+
+		return !finished;
+	}
+
+	/** \brief Build the reply to the command in the current transaction
+	 *
+	 * \param[in] cmd The command byte, the second one of the transaction
+	 */
+	void makeReply (const byte cmd) {
+		if (cmd == poll[1] || cmd == enter_config[1]) {
+			readRecord (cmd);
+		} else {
+			// Configuration Mode acknowledgement
+			memset (frame, 0x00, sizeof (enter_config));
+			frame[0] = 0xFF;
+			frame[1] = 0xF3;
+			frame[2] = 0x5A;
+			frameLen = sizeof (enter_config);
+		}
+	}
+
+	virtual void attention () override {
+		assertAttention ();
+	}
+
+	virtual void assertAttention () override {
+		traceAttention (true);
+		selected = true;
+		pos = 0;
+		frameLen = 0;
+	}
+
+	virtual void noAttention () override {
+		releaseAttention ();
+	}
+
+	virtual void releaseAttention () override {
+		selected = false;
+		traceAttention (false);
+	}
+
+	virtual byte shiftInOut (const byte out) override {
+		byte in = 0xFF;		// DATA is pulled up
+
+		if (selected) {
+			if (pos == 1) {
+				makeReply (out);
+			}
+
+			if (pos < frameLen) {
+				in = frame[pos];
+			}
+
+			if (pos < 0xFF) {
+				++pos;
+			}
+		}
+
+		return in;
+	}
+
+	virtual void waitAck (const boolean lastByte) override {
+		(void) lastByte;
+	}
+
+	virtual boolean checkAck (const boolean lastByte) override {
+		(void) lastByte;
+		return true;
+	}
+
+	virtual unsigned long currentMicros () override {
+		return replayTime + waitedTime;
+	}
+
+	virtual unsigned long currentMillis () override {
+		return currentMicros () / 1000UL;
+	}
+
+	virtual void waitMillis (const unsigned long ms) override {
+		// Only pretend, so that timeouts still expire
+		waitedTime += ms * 1000UL;
+	}
+
+public:
+	/** \brief Constructor
+	 *
+	 * \param[in] s Where the recording will be read from
+	 */
+	PsxControllerReplay (Stream& s): source (s), started (false), finished (false), outOfSync (false),
+	                                 replayTime (0), waitedTime (0), framesReplayed (0), selected (false),
+	                                 pos (0), frameLen (0) {
+	}
+
+	/** \brief Initialize library
+	 *
+	 * The first call checks the header of the recording. Then the library is
+	 * initialized as usual, which consumes a few records, just like it polled
+	 * the controller a few times when the recording was made.
+	 *
+	 * \return true if the recording is valid and the controller was found in
+	 *         it, false otherwise
+	 */
+	virtual boolean begin () override {
+		if (!started) {
+			boolean valid = true;
+			for (byte i = 0; valid && i < sizeof (PSX_RECORDING_MAGIC); ++i) {
+				valid = readByte () == PSX_RECORDING_MAGIC[i];
+			}
+			valid = valid && readByte () == PSX_RECORDING_VERSION;
+
+			finished = !valid;
+			started = true;
+		}
+
+		return !finished && PsxController::begin ();
+	}
+
+	//! \name Replay Functions
+	//! @{
+
+	/** \brief Check if the whole recording has been replayed
+	 *
+	 * \return true if a poll found no more records
+	 */
+	boolean isFinished () const {
+		return finished;
+	}
+
+	/** \brief Check if the replay went out of sync with the recording
+	 *
+	 * This happens when the functions called differ from those called when
+	 * the recording was made, so that a command is sent where a different one
+	 * was recorded. The replay is then finished.
+	 *
+	 * \return true if a command did not match the recording
+	 */
+	boolean isOutOfSync () const {
+		return outOfSync;
+	}
+
+	//! \brief Get the number of records replayed so far
+	unsigned long getFramesReplayed () const {
+		return framesReplayed;
+	}
+
+	//! \brief Get the time of the record being replayed, relative to the first (us)
+	unsigned long getReplayTime () const {
+		return replayTime;
+	}
+
+	//! @}
+};
+
+#endif
@@ -0,0 +1,618 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file PsxControllerSim.h
+ * \brief Simulated controller, for testing and benchmarking without hardware
+ */
+
+#ifndef PSXCONTROLLERSIM_H_
+#define PSXCONTROLLERSIM_H_
+
+#include "PsxNewLib.h"
+
+/** \brief Simulated controller model
+ *
+ * \sa PsxControllerSim::setModel()
+ */
+enum PsxSimModel {
+	PSSIM_NONE = 0,			//!< Nothing plugged in
+	PSSIM_DIGITAL,			//!< Original digital controller (SCPH-1080)
+	PSSIM_DUALSHOCK,		//!< DualShock (SCPH-1200), no analog buttons
+	PSSIM_DUALSHOCK2,		//!< DualShock 2 (SCPH-10010)
+	PSSIM_FLIGHTSTICK,		//!< Analog Joystick (SCPH-1110) in green mode
+	PSSIM_NEGCON,			//!< Namco neGcon
+	PSSIM_JOGCON,			//!< Namco JogCon
+	PSSIM_GUNCON			//!< Namco GunCon
+};
+
+/** \brief Default simulated clock period (us)
+ *
+ * This corresponds to the 250 kHz used by PsxControllerHwSpi.
+ */
+const byte SIM_CLK_PERIOD = 4;
+
+/** \brief Simulated clock periods (us)
+ *
+ * These are the periods PsxController::calibrateClock() can choose from,
+ * slowest first, matching the speeds of PsxControllerHwSpi.
+ */
+static const byte SIM_CLK_PERIODS[] = {8, SIM_CLK_PERIOD, 2, 1};
+
+/** \brief Size of the emulated controller buffers
+ *
+ * Enough for the longest reply, regardless of which protocols PsxController
+ * supports.
+ */
+const byte SIM_BUFFER_SIZE = 21;
+
+/** \brief Simulated PSX Controller Interface
+ *
+ * This does not talk to any real hardware, rather it emulates a controller in
+ * software, replying to commands just like the real thing would, including
+ * Configuration Mode and mode switches. It's meant to exercise all of the
+ * library code paths on a bench without any controller, or even on the host
+ * through any Arduino API emulation layer.
+ *
+ * Time is \a virtual: it only advances when the library would wait or when
+ * bits are shifted on the (simulated) bus, so the full time a real transaction
+ * would take, delays included, is accounted for, but nothing is actually
+ * waited for. Between calls, time can be moved forward with advanceClock().
+ */
+class PsxControllerSim: public PsxController {
+protected:
+	//! \name Virtual Clock
+	//! @{
+	unsigned long clockUs;			//!< Current virtual time (us)
+	byte clockPeriod;				//!< Time to shift a single bit (us)
+	byte ackLatency;				//!< Time to ACK a byte (us), 0 if not watched
+	unsigned long lastByteUs;		//!< Time the last byte was shifted (us)
+	byte minClockPeriod;			//!< Shortest period the controller keeps up with (us)
+	//! @}
+
+	//! \name Statistics
+	//! @{
+	unsigned long transactions;		//!< Number of Attention cycles
+	unsigned long bytesExchanged;	//!< Number of bytes shifted
+	//! @}
+
+	//! \name Emulated Controller State
+	//! @{
+	PsxSimModel model;
+	boolean selected;				//!< Attention is asserted
+	byte pos;						//!< Position in current transaction
+	byte command[SIM_BUFFER_SIZE];		//!< Bytes received in current transaction
+	byte reply[SIM_BUFFER_SIZE];		//!< Reply to current transaction
+	byte replyLen;					//!< Length of #reply
+
+	boolean configMode;
+	boolean analogMode;				//!< Analog sticks enabled
+	boolean analogLocked;			//!< ANALOG button disabled
+	byte pressureMask[3];			//!< Last mask set with 0x4F, bit n enables byte n + 3
+	byte rumbleMap[6];				//!< Last mapping set with 0x4D
+
+	PsxButtons buttons;				//!< Active low, like on the wire
+	byte axes[4];					//!< Bytes 5-8 of a poll reply
+	byte pressures[PSX_ANALOG_BTN_DATA_SIZE];
+	byte motor1;					//!< Last motor 1 level received
+	byte motor2;					//!< Last motor 2 level received
+	//! @}
+
+	/** \brief Check if the emulated controller can be configured
+	 *
+	 * Of the models we emulate, only DualShocks support Configuration Mode.
+	 */
+	boolean isConfigurable () const {
+		return model == PSSIM_DUALSHOCK || model == PSSIM_DUALSHOCK2;
+	}
+
+	/** \brief Build the reply to a poll
+	 *
+	 * This is also what is sent in reply to 0x43 outside of Configuration
+	 * Mode.
+	 */
+	void makePollReply () {
+		byte id;
+		byte dataLen = 6;
+		boolean masked = false;
+
+		switch (model) {
+			case PSSIM_DUALSHOCK2:
+				if (isPressureMode ()) {
+					// Length depends on the mask, see below
+					id = 0x79;
+					masked = true;
+				} else if (analogMode) {
+					id = 0x73;
+				} else {
+					id = 0x41;
+					dataLen = 2;
+				}
+				break;
+			case PSSIM_DUALSHOCK:
+				if (analogMode) {
+					id = 0x73;
+				} else {
+					id = 0x41;
+					dataLen = 2;
+				}
+				break;
+			case PSSIM_FLIGHTSTICK:
+				id = 0x53;
+				break;
+			case PSSIM_NEGCON:
+				id = 0x23;
+				break;
+			case PSSIM_JOGCON:
+				id = 0xE3;
+				break;
+			case PSSIM_GUNCON:
+				id = 0x63;
+				break;
+			case PSSIM_DIGITAL:
+			default:
+				id = 0x41;
+				dataLen = 2;
+				break;
+		}
+
+		if (configMode) {
+			// Buttons and sticks are still reported, but always 6 bytes
+			id = 0xF3;
+			dataLen = 6;
+		}
+
+		reply[3] = buttons & 0xFF;
+		reply[4] = buttons >> 8;
+		memcpy (reply + 5, axes, sizeof (axes));
+		memcpy (reply + 9, pressures, sizeof (pressures));
+
+		if (masked && !configMode) {
+			// Only keep the bytes enabled with 0x4F, padding to an even length
+			dataLen = 0;
+			for (byte i = 0; i < SIM_BUFFER_SIZE - 3; ++i) {
+				if ((pressureMask[i / 8] & (1 << (i % 8))) != 0) {
+					reply[3 + dataLen++] = reply[3 + i];
+				}
+			}
+			if ((dataLen & 1) != 0) {
+				reply[3 + dataLen++] = 0x00;
+			}
+			id = 0x70 | (dataLen / 2);
+		}
+
+		reply[1] = id;
+		replyLen = 3 + dataLen;
+	}
+
+	/** \brief Build the reply to the command in command[1]
+	 *
+	 * This is called as soon as the command byte has been received, since the
+	 * reply starts right away.
+	 */
+	void makeReply () {
+		memset (reply, 0x00, sizeof (reply));
+		reply[0] = 0xFF;
+		reply[2] = 0x5A;
+
+		if (!configMode || command[1] == 0x42 || command[1] == 0x43) {
+			makePollReply ();
+		} else {
+			// All other config commands reply with 6 bytes
+			reply[1] = 0xF3;
+			replyLen = 9;
+
+			switch (command[1]) {
+				case 0x45:
+					// Type read
+					reply[3] = model == PSSIM_DUALSHOCK2 ? 0x03 : 0x01;
+					reply[4] = 0x02;
+					reply[5] = analogMode ? 0x01 : 0x00;
+					reply[6] = 0x02;
+					reply[7] = 0x01;
+					reply[8] = 0x00;
+					break;
+				case 0x4D:
+					// Rumble mapping, previous one is returned
+					memcpy (reply + 3, rumbleMap, sizeof (rumbleMap));
+					break;
+				case 0x4F:
+					reply[8] = 0x5A;
+					break;
+				default:
+					break;
+			}
+		}
+	}
+
+	/** \brief Apply the effects of the command just received
+	 *
+	 * Real controllers only switch modes once the whole command has been
+	 * received, which means when Attention is released.
+	 */
+	void executeCommand () {
+		if (pos < 2) {
+			return;
+		}
+
+		switch (command[1]) {
+			case 0x42:
+				if (pos >= 5) {
+					motor1 = command[3];
+					motor2 = command[4];
+				}
+				break;
+			case 0x43:
+				if (pos >= 4 && isConfigurable ()) {
+					configMode = command[3] == 0x01;
+				}
+				break;
+			case 0x44:
+				if (configMode && pos >= 5) {
+					analogMode = command[3] == 0x01;
+					analogLocked = command[4] == 0x03;
+					if (!analogMode) {
+						memset (pressureMask, 0x00, sizeof (pressureMask));
+					}
+				}
+				break;
+			case 0x4D:
+				if (configMode) {
+					for (byte i = 0; i < sizeof (rumbleMap) && i + 3 < pos; ++i) {
+						rumbleMap[i] = command[i + 3];
+					}
+				}
+				break;
+			case 0x4F:
+				if (configMode && model == PSSIM_DUALSHOCK2 && pos >= 6) {
+					memcpy (pressureMask, command + 3, sizeof (pressureMask));
+					analogMode = true;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+
+	virtual void attention () override {
+		assertAttention ();
+		clockUs += ATTN_DELAY;
+	}
+
+	virtual void assertAttention () override {
+		traceAttention (true);
+		selected = true;
+		pos = 0;
+		replyLen = 0;
+		++transactions;
+	}
+
+	virtual void noAttention () override {
+		releaseAttention ();
+		clockUs += ATTN_DELAY;
+	}
+
+	virtual void releaseAttention () override {
+		if (selected) {
+			executeCommand ();
+		}
+		selected = false;
+		traceAttention (false);
+	}
+
+	virtual byte shiftInOut (const byte out) override {
+		byte in = 0xFF;		// DATA is pulled up
+
+		clockUs += 8U * clockPeriod;
+		lastByteUs = clockUs;
+		++bytesExchanged;
+
+		if (selected && model != PSSIM_NONE && pos < SIM_BUFFER_SIZE) {
+			command[pos] = out;
+			if (pos == 0) {
+				// Controllers only answer to address 0x01
+				if (out == 0x01) {
+					in = 0xFF;
+				} else {
+					selected = false;
+				}
+			} else {
+				if (pos == 1) {
+					makeReply ();
+				}
+
+				if (pos < replyLen) {
+					in = reply[pos];
+				}
+			}
+			++pos;
+
+			if (clockPeriod < minClockPeriod) {
+				// Too fast, we sample every bit a little too late
+				in = (in << 1) | 0x01;
+			}
+		}
+
+		return in;
+	}
+
+	virtual void waitAck (const boolean lastByte) override {
+		if (ackLatency == 0) {
+			clockUs += INTER_CMD_BYTE_DELAY;
+		} else if (!lastByte) {
+			if (selected && pos < replyLen) {
+				clockUs += ackLatency;
+			} else {
+				// A controller that is not talking won't ACK, so we time out
+				clockUs += INTER_CMD_BYTE_DELAY;
+			}
+		}
+	}
+
+	virtual boolean checkAck (const boolean lastByte) override {
+		boolean ret = false;
+
+		if (ackLatency != 0) {
+			ret = lastByte || (selected && pos < replyLen && clockUs - lastByteUs >= ackLatency);
+		}
+
+		return ret;
+	}
+
+	virtual byte getClockLevelsNo () const override {
+		return sizeof (SIM_CLK_PERIODS);
+	}
+
+	virtual byte getDefaultClockLevel () const override {
+		return 1;
+	}
+
+	virtual void applyClockLevel (const byte level) override {
+		clockPeriod = SIM_CLK_PERIODS[level];
+	}
+
+	virtual unsigned long currentMicros () override {
+		return clockUs;
+	}
+
+	virtual unsigned long currentMillis () override {
+		return clockUs / 1000UL;
+	}
+
+	virtual void waitMillis (const unsigned long ms) override {
+		clockUs += ms * 1000UL;
+	}
+
+public:
+	PsxControllerSim (): clockUs (0), clockPeriod (SIM_CLK_PERIOD), ackLatency (0),
+	                     lastByteUs (0), minClockPeriod (0), transactions (0), bytesExchanged (0) {
+		setModel (PSSIM_DUALSHOCK2);
+	}
+
+	//! \name Simulation Setup Functions
+	//! @{
+
+	/** \brief Plug in a different controller
+	 *
+	 * The new controller starts up in its power-on state: not in
+	 * Configuration Mode, digital mode for DualShocks, no buttons pressed and
+	 * all axes centered.
+	 *
+	 * \param[in] m The model to emulate, PSSIM_NONE to unplug
+	 */
+	void setModel (const PsxSimModel m) {
+		model = m;
+		selected = false;
+		pos = 0;
+		replyLen = 0;
+		configMode = false;
+		analogMode = false;
+		analogLocked = false;
+		memset (pressureMask, 0x00, sizeof (pressureMask));
+		memset (rumbleMap, 0xFF, sizeof (rumbleMap));
+		buttons = ~PSB_NONE;
+		memset (axes, ANALOG_IDLE_VALUE, sizeof (axes));
+		memset (pressures, 0x00, sizeof (pressures));
+		motor1 = 0x00;
+		motor2 = 0x00;
+
+		if (m == PSSIM_NEGCON || m == PSSIM_JOGCON || m == PSSIM_GUNCON) {
+			// These report positions/pressures rather than stick axes
+			memset (axes, 0x00, sizeof (axes));
+		}
+	}
+
+	PsxSimModel getModel () const {
+		return model;
+	}
+
+	/** \brief Set the bus clock period (us)
+	 *
+	 * Note that begin() and setClockLevel() change this.
+	 *
+	 * \param[in] period Time it takes to shift out a single bit
+	 */
+	void setClockPeriod (const byte period) {
+		clockPeriod = period;
+	}
+
+	/** \brief Set the fastest clock the controller can keep up with
+	 *
+	 * With a shorter clock period, every byte read from the controller will
+	 * be corrupted.
+	 *
+	 * \param[in] period Shortest clock period (us), 0 for no limit
+	 */
+	void setMinClockPeriod (const byte period) {
+		minClockPeriod = period;
+	}
+
+	/** \brief Simulate the Acknowledge line
+	 *
+	 * \param[in] latency Time it takes the controller to acknowledge a byte
+	 *                    (us), or 0 to behave like a transport that does not
+	 *                    watch the line
+	 */
+	void setAckLatency (const byte latency) {
+		ackLatency = latency;
+	}
+
+	/** \brief Simulate the user pressing the ANALOG button
+	 *
+	 * \param[in] enabled true to turn analog mode on, false to turn it off
+	 */
+	void setAnalogMode (const boolean enabled) {
+		if (!analogLocked && isConfigurable ()) {
+			analogMode = enabled;
+		}
+	}
+
+	//! @}
+
+	//! \name Simulated Input Functions
+	//! @{
+
+	/** \brief Set the buttons that are pressed
+	 *
+	 * \param[in] pressed The pressed buttons, OR'ed together
+	 */
+	void setButtons (const PsxButtons pressed) {
+		buttons = ~pressed;
+	}
+
+	//! \brief Set the position of the left analog stick
+	void setLeftAnalog (const byte x, const byte y) {
+		axes[2] = x;
+		axes[3] = y;
+	}
+
+	//! \brief Set the position of the right analog stick
+	void setRightAnalog (const byte x, const byte y) {
+		axes[0] = x;
+		axes[1] = y;
+	}
+
+	//! \brief Set the pressure of an analog button
+	void setAnalogButton (const PsxAnalogButton button, const byte value) {
+		pressures[button] = value;
+	}
+
+	/** \brief Set neGcon data
+	 *
+	 * \param[in] twist Twist axis position
+	 * \param[in] i I button pressure
+	 * \param[in] ii II button pressure
+	 * \param[in] l L button pressure
+	 */
+	void setNegcon (const byte twist, const byte i, const byte ii, const byte l) {
+		axes[0] = twist;
+		axes[1] = i;
+		axes[2] = ii;
+		axes[3] = l;
+	}
+
+	/** \brief Set JogCon data
+	 *
+	 * \param[in] position Wheel position
+	 * \param[in] turns Number of full rotations
+	 */
+	void setJogcon (const byte position, const byte turns) {
+		axes[0] = position;
+		axes[1] = turns;
+	}
+
+	/** \brief Set the screen position the GunCon is aimed at
+	 *
+	 * See PsxController::getGunconCoordinates() for the special values.
+	 */
+	void setGunconCoordinates (const word x, const word y) {
+		axes[0] = x & 0xFF;
+		axes[1] = x >> 8;
+		axes[2] = y & 0xFF;
+		axes[3] = y >> 8;
+	}
+
+	//! @}
+
+	//! \name Inspection Functions
+	//! @{
+
+	//! \brief Check if the emulated controller is in Configuration Mode
+	boolean isInConfigMode () const {
+		return configMode;
+	}
+
+	//! \brief Check if the emulated controller has analog sticks enabled
+	boolean isAnalogMode () const {
+		return analogMode;
+	}
+
+	//! \brief Check if the emulated controller has analog buttons enabled
+	boolean isPressureMode () const {
+		return analogMode && (pressureMask[0] | pressureMask[1] | pressureMask[2]) != 0;
+	}
+
+	//! \brief Check if Attention is currently asserted
+	boolean isSelected () const {
+		return selected;
+	}
+
+	//! \brief Get the last motor levels the controller received
+	void getMotorLevels (byte& m1, byte& m2) const {
+		m1 = motor1;
+		m2 = motor2;
+	}
+
+	/** \brief Get the current virtual time (us)
+	 */
+	unsigned long getClock () const {
+		return clockUs;
+	}
+
+	/** \brief Move the virtual clock forward
+	 *
+	 * This is useful to simulate time spent elsewhere, for instance between
+	 * calls to tick().
+	 *
+	 * \param[in] us The number of microseconds to advance
+	 */
+	void advanceClock (const unsigned long us) {
+		clockUs += us;
+	}
+
+	//! \brief Get the number of Attention cycles so far
+	unsigned long getTransactions () const {
+		return transactions;
+	}
+
+	//! \brief Get the number of bytes exchanged so far
+	unsigned long getBytesExchanged () const {
+		return bytesExchanged;
+	}
+
+	//! \brief Reset clock and statistics
+	void resetStats () {
+		clockUs = 0;
+		transactions = 0;
+		bytesExchanged = 0;
+	}
+
+	//! @}
+};
+
+#endif
@@ -0,0 +1,198 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file PsxMultitap.h
+ * \brief Multitap support
+ */
+
+#ifndef PSXMULTITAP_H_
+#define PSXMULTITAP_H_
+
+#include "PsxNewLib.h"
+
+//! \brief Number of controller ports on a multitap
+const byte MULTITAP_PORTS = 4;
+
+/** \brief Size of the data returned for each multitap port
+ *
+ * This is the controller ID, 0x5A and 6 bytes of data: buttons and sticks fit,
+ * DualShock 2 analog button data does not.
+ */
+const byte MULTITAP_SLOT_SIZE = 8;
+
+//! \brief Size of the reply to #multitap_poll
+const byte MULTITAP_REPLY_SIZE = 3 + MULTITAP_PORTS * MULTITAP_SLOT_SIZE;
+
+//! \brief Multitap ID, returned in place of the controller ID
+const byte MULTITAP_ID = 0x80;
+
+/** \brief Poll all multitap ports
+ *
+ * This is #poll, but the third byte asks the multitap to return the data of
+ * all four controllers at once. Controllers not connected through a multitap
+ * just ignore it.
+ */
+static const byte multitap_poll[] = {0x01, 0x42, 0x01};
+
+/** \brief Multitap Port
+ *
+ * This represents the controller connected to a single multitap port. It can be
+ * inspected through the usual functions, i.e.: buttonPressed(),
+ * getLeftAnalog(), etc.
+ */
+class PsxMultitapPort: public PsxControllerPort {
+public:
+	/** \brief Update data from a multitap slot
+	 *
+	 * \param[in] slot The #MULTITAP_SLOT_SIZE bytes returned for this port
+	 */
+	void updateFromSlot (const byte *slot) {
+		/* Rebuild a regular reply, so that it can be decoded as usual. A
+		 * DualShock 2 in analog buttons mode only gets its first 6 bytes
+		 * through, which makes it look like a regular DualShock.
+		 */
+		byte in[MULTITAP_SLOT_SIZE + 1];
+		in[0] = 0xFF;
+		memcpy (in + 1, slot, MULTITAP_SLOT_SIZE);
+		if (isDualShock2Reply (in)) {
+			in[1] = 0x73;
+		}
+
+		updateFromReply (in);
+	}
+};
+
+/** \brief PSX Multitap Interface
+ *
+ * This adds multitap support to any other controller interface, for instance:
+ *
+ * \code
+ * PsxMultitap<PsxControllerHwSpi<PIN_PS2_ATT> > tap;
+ * \endcode
+ *
+ * readAll() polls all four controllers at once, within a single Attention
+ * cycle, and each of them can then be inspected independently through
+ * getPort(). All the functions of the underlying interface are still available
+ * and address the controller in the first port, so for instance it can be
+ * put into analog mode as usual.
+ *
+ * If no multitap is connected, readAll() still works and reports the directly
+ * connected controller on the first port.
+ *
+ * Note that analog button data and rumble are not supported through the
+ * multitap.
+ */
+template <typename T>
+class PsxMultitap: public T {
+protected:
+	//! \brief Buffer for the reply to #multitap_poll
+	byte tapBuffer[MULTITAP_REPLY_SIZE];
+
+	PsxMultitapPort ports[MULTITAP_PORTS];
+
+	//! \brief True if the multitap replied at the last call to readAll()
+	boolean multitapPresent;
+
+public:
+	virtual boolean begin () override {
+		multitapPresent = false;
+		for (byte i = 0; i < MULTITAP_PORTS; ++i) {
+			ports[i].reset ();
+		}
+
+		return T::begin ();
+	}
+
+	/** \brief Poll all controllers
+	 *
+	 * This is the multitap counterpart to read(): it polls all controllers
+	 * in a single transaction and updates the data of all ports.
+	 *
+	 * \return true if either a multitap or a single controller replied, false
+	 *         otherwise
+	 */
+	boolean readAll () {
+		boolean ret = false;
+		boolean singlePad = false;
+
+		this->attention ();
+		PsxController::shiftInOut (multitap_poll, tapBuffer, 3);
+		multitapPresent = tapBuffer[1] == MULTITAP_ID && tapBuffer[2] == 0x5A;
+		if (multitapPresent) {
+			// The multitap wants zeros here
+			for (byte i = 3; i < MULTITAP_REPLY_SIZE; ++i) {
+				tapBuffer[i] = this->shiftInOut (static_cast<byte> (0x00));
+				this->waitAck (i == MULTITAP_REPLY_SIZE - 1);
+				this->traceByte (0x00, tapBuffer[i]);
+			}
+		} else if (this->isValidReply (tapBuffer)) {
+			// No multitap, get the rest of the reply of the controller
+			byte left = this->getReplyLength (tapBuffer);
+			if (3 + left <= MULTITAP_REPLY_SIZE) {
+				PsxController::shiftInOut (NULL, tapBuffer + 3, left, true);
+				singlePad = true;
+			}
+		}
+		this->noAttention ();
+
+		if (multitapPresent) {
+			for (byte i = 0; i < MULTITAP_PORTS; ++i) {
+				ports[i].updateFromSlot (tapBuffer + 3 + i * MULTITAP_SLOT_SIZE);
+			}
+			ret = true;
+		} else if (singlePad) {
+			if (this->isConfigReply (tapBuffer)) {
+				// We're stuck in config mode, try to get out
+				this->exitConfigMode ();
+				ports[0].disconnect ();
+			} else {
+				ports[0].updateFromReply (tapBuffer);
+				ret = true;
+			}
+			for (byte i = 1; i < MULTITAP_PORTS; ++i) {
+				ports[i].disconnect ();
+			}
+		} else {
+			for (byte i = 0; i < MULTITAP_PORTS; ++i) {
+				ports[i].disconnect ();
+			}
+		}
+
+		return ret;
+	}
+
+	/** \brief Check if a multitap is connected
+	 *
+	 * \return true if a multitap replied at the last call to readAll()
+	 */
+	boolean isMultitapPresent () const {
+		return multitapPresent;
+	}
+
+	/** \brief Retrieve a multitap port
+	 *
+	 * \param[in] port Port number [0-3, A to D]
+	 * \return The port, whose data is updated at every call to readAll()
+	 */
+	const PsxMultitapPort& getPort (const byte port) const {
+		return ports[port < MULTITAP_PORTS ? port : 0];
+	}
+};
+
+#endif
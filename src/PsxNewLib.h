@@ -29,16 +29,67 @@
 #ifndef PSXNEWLIB_H_
 #define PSXNEWLIB_H_
 
-// Uncomment this to have all byte exchanges logged to serial
-//~ #define DUMP_COMMS
+/* Uncomment this to have all byte exchanges recorded to a trace buffer, see
+ * PsxController::flushTrace()
+ */
+//~ #define PSX_TRACE
+
+// Uncomment this to have statistics collected about polls, see PsxStats
+//~ #define PSX_COLLECT_STATS
+
+/** \name Supported Protocols
+ *
+ * Decoders for controllers other than plain digital pads can be left out, to
+ * save flash, RAM and some time at every poll. Define PSX_PROTOCOLS as a
+ * combination of these (either here or before including this file), or as one
+ * of the presets below. Replies from unsupported controllers are decoded as
+ * digital ones, as long as they fit the reply buffer.
+ */
+//! @{
+#define PSX_SUPPORT_DUALSHOCK	0x01	//!< DualShock analog sticks
+#define PSX_SUPPORT_DUALSHOCK2	0x02	//!< DualShock 2 analog buttons
+#define PSX_SUPPORT_FLIGHTSTICK	0x04	//!< Analog Joystick/Flightstick
+#define PSX_SUPPORT_NEGCON		0x08	//!< NeGcon
+#define PSX_SUPPORT_JOGCON		0x10	//!< JogCon
+#define PSX_SUPPORT_GUNCON		0x20	//!< GunCon
+
+//! \brief Everything, the default
+#define PSX_PRESET_ALL			0x3F
+
+//! \brief Digital pads only
+#define PSX_PRESET_DIGITAL		0x00
+
+//! \brief Digital pads and DualShocks without analog buttons
+#define PSX_PRESET_DUALSHOCK	(PSX_SUPPORT_DUALSHOCK | PSX_SUPPORT_FLIGHTSTICK)
+
+//! \brief Digital pads and DualShocks, including DualShock 2 analog buttons
+#define PSX_PRESET_DUALSHOCK2	(PSX_PRESET_DUALSHOCK | PSX_SUPPORT_DUALSHOCK2)
+//! @}
+
+//~ #define PSX_PROTOCOLS PSX_PRESET_DUALSHOCK
+
+#ifndef PSX_PROTOCOLS
+#define PSX_PROTOCOLS PSX_PRESET_ALL
+#endif
+
+//! \brief True if analog button data needs to be stored
+#define PSX_HAVE_ANALOG_BUTTONS ((PSX_PROTOCOLS & (PSX_SUPPORT_DUALSHOCK2 | PSX_SUPPORT_NEGCON)) != 0)
+
+/** \brief Attention Delay (us)
+ *
+ * Time between attention being issued to the controller and the first clock
+ * edge. The same amount of time is also waited after attention is released.
+ */
+const byte ATTN_DELAY = 50;
 
 /** \brief Command Inter-Byte Delay (us)
  * 
  * Commands are several bytes long. This is the time to wait between two
  * consecutive bytes.
  * 
- * This should actually be done by watching the \a Acknowledge line, but we are
- * ignoring it at the moment.
+ * This is only used when the \a Acknowledge line is not connected. When it is,
+ * the next byte is sent as soon as the controller acknowledges the previous
+ * one, and this becomes the longest time we will wait for that to happen.
  */
 const byte INTER_CMD_BYTE_DELAY = 50;
 
@@ -68,6 +119,35 @@ const unsigned long COMMAND_RETRY_INTERVAL = 10;
  */
 const unsigned long MODE_SWITCH_DELAY = 500;
 
+/** \brief Disconnection threshold
+ * 
+ * Number of consecutive failed polls after which update() considers the
+ * controller disconnected. This keeps a single glitch from throwing away the
+ * controller state.
+ */
+const byte DISCONNECT_THRESHOLD = 3;
+
+/** \brief Clock calibration polls
+ * 
+ * Number of polls that must all return the same header and buttons for a
+ * clock speed to be considered reliable by calibrateClock().
+ */
+const byte CLOCK_CALIBRATION_POLLS = 8;
+
+/** \brief Clock fallback threshold
+ * 
+ * Number of consecutive garbled replies after which the clock is slowed down,
+ * once calibrateClock() has been called.
+ */
+const byte CLOCK_FALLBACK_ERRORS = 3;
+
+/** \brief Clock recovery threshold
+ * 
+ * Number of consecutive good polls after which a clock that was slowed down is
+ * stepped back up towards the speed chosen by calibrateClock().
+ */
+const byte CLOCK_RECOVERY_POLLS = 250;
+
 
 /** \brief Type that is used to represent a single button in most places
  */
@@ -130,6 +210,61 @@ typedef uint16_t PsxButtons;
  */
 const byte PSX_ANALOG_BTN_DATA_SIZE = 12;
 
+/** \brief Type that is used to represent a set of analog buttons
+ *
+ * Every #PsxAnalogButton is a bit, see #PSAB_BIT.
+ */
+typedef uint16_t PsxAnalogButtons;
+
+//! \brief Bit of a #PsxAnalogButton in #PsxAnalogButtons
+#define PSAB_BIT(b) (static_cast<PsxAnalogButtons> (1U << (b)))
+
+//! \brief All analog buttons
+const PsxAnalogButtons PSAB_ALL = 0x0FFF;
+
+/** \brief Type that is used to represent a single analog stick axis
+ *
+ * \sa setAxisThreshold()
+ */
+enum PsxAxis {
+	PSAXIS_LX = 0,		//!< Horizontal axis of left stick
+	PSAXIS_LY = 1,		//!< Vertical axis of left stick
+	PSAXIS_RX = 2,		//!< Horizontal axis of right stick
+	PSAXIS_RY = 3		//!< Vertical axis of right stick
+};
+
+//! \brief Number of analog stick axes
+const byte PSX_AXES_NO = 4;
+
+/** \brief Fields that can change between polls
+ *
+ * The bit of an axis is #PSCH_LX shifted left by its #PsxAxis, that of an
+ * analog button is #PSCH_PRESSURE_FIRST shifted left by its #PsxAnalogButton.
+ * GunCon coordinates are reported through the axes they are stored in, see
+ * getGunconCoordinates().
+ *
+ * \sa getChanges()
+ */
+enum PsxChange {
+	PSCH_NONE           = 0x00000000UL,
+	PSCH_BUTTONS        = 0x00000001UL,		//!< Any digital button
+	PSCH_LX             = 0x00000002UL,
+	PSCH_LY             = 0x00000004UL,
+	PSCH_RX             = 0x00000008UL,
+	PSCH_RY             = 0x00000010UL,
+	PSCH_STICKS         = 0x0000001EUL,		//!< Any analog stick axis
+	PSCH_PROTOCOL       = 0x00000020UL,		//!< Protocol or data validity
+	PSCH_PRESSURE_FIRST = 0x00000100UL,		//!< Pressure of #PSAB_PAD_RIGHT
+	PSCH_PRESSURES      = 0x000FFF00UL,		//!< Any analog button
+	PSCH_ALL            = 0x000FFF3FUL
+};
+
+/** \brief Type that is used to report changed fields
+ *
+ * A combination of #PsxChange bits.
+ */
+typedef uint32_t PsxChanges;
+
 //! \name Controller Commands
 //! @{
 /** \brief Enter Configuration Mode
@@ -293,270 +428,2412 @@ enum GunconStatus {
 	GUNCON_OTHER_ERROR
 };
 
-/** \brief PSX Controller Interface
- * 
- * This is the base class implementing interactions with PSX controllers. It is
- * partially abstract, so it is not supposed to be instantiated directly.
+/** \brief Poll failure causes
+ *
+ * \sa PsxStats
  */
-class PsxController {
-protected:
-	/** \brief Size of internal communication buffer
-	 * 
-	 * This can be sized after the longest command reply (which is 21 bytes for
-	 * 01 42 when in DualShock 2 mode), but we're better safe than sorry.
-	 */
-	static const byte BUFFER_SIZE = 32;
-
-	/** \brief Internal communication buffer
-	 * 
-	 * This is used to hold replies received from the controller.
-	 */
-	byte inputBuffer[BUFFER_SIZE];
+enum PsxPollFailure {
+	PSFAIL_INVALID_HEADER = 0,	//!< Nobody answered, or garbage was received
+	PSFAIL_BUFFER_TOO_SMALL,	//!< Reply did not fit the communication buffer
+	PSFAIL_REPLY_TRUNCATED,		//!< Reply shorter than the command being sent
+	PSFAIL_MAX					//!< Number of failure causes
+};
 
-	/** \brief Previous (Digital) Button Status
-	 * 
-	 * The individual bits can be identified through #PsxButton.
-	 */
-	PsxButtons previousButtonWord;
+//! \brief Number of bins in the poll duration histogram
+const byte PSX_STATS_BINS = 8;
 
-	/** \brief (Digital) Button Status
-	 * 
-	 * The individual bits can be identified through #PsxButton.
-	 */
-	PsxButtons buttonWord;
+//! \brief Width of every bin of the poll duration histogram (us)
+const word PSX_STATS_BIN_WIDTH = 500;
 
-	/** \brief Controller Protocol
-	 *
-	 * The protocol controller data was interpreted with at the last call to
-	 * read()
+/** \brief Poll Statistics
+ *
+ * These are collected by PsxController when PSX_COLLECT_STATS is defined
+ * (either in PsxNewLib.h or before including it) and are available through
+ * PsxController::getStats(). Otherwise, none of the code involved is even
+ * compiled in.
+ *
+ * Durations cover whole polls, from Attention being asserted to it being
+ * deasserted, including all delays. Counters saturate rather than wrapping
+ * around.
+ */
+struct PsxStats {
+	unsigned long polls;			//!< Polls attempted
+	unsigned long bytes;			//!< Bytes exchanged during polls
+	byte lastPollBytes;				//!< Bytes exchanged during last poll
+	word durationMin;				//!< Shortest poll (us)
+	word durationMax;				//!< Longest poll (us)
+
+	/** \brief Poll duration histogram
 	 *
-	 * \sa getProtocol
-	 */
-	PsxControllerProtocol protocol;
-
-	//! \name Analog Stick Data
-	//! @{
-	byte lx;		//!< Horizontal axis of left stick [0-255, L to R]
-	byte ly;		//!< Vertical axis of left stick [0-255, U to D]
-	byte rx;		//!< Horizontal axis of right stick [0-255, L to R]
-	byte ry;		//!< Vertical axis of right stick [0-255, U to D]
-	
-	boolean analogSticksValid;	//!< True if the above were valid at the last call to read()
-	//! @}
-	
-	/** \brief Analog Button Data
-	 * 
-	 * \todo What's the meaning of every individual byte?
+	 * Bin \a i counts polls that took between <tt>i * PSX_STATS_BIN_WIDTH</tt>
+	 * and <tt>(i + 1) * PSX_STATS_BIN_WIDTH</tt> us. The last bin also counts
+	 * anything longer.
 	 */
-	byte analogButtonData[PSX_ANALOG_BTN_DATA_SIZE];
+	word histogram[PSX_STATS_BINS];
 
-	/** \brief Analog Button Data Validity
-	 * 
-	 * True if the #analogButtonData were valid in last call to read()
-	 */
-	boolean analogButtonDataValid;
-	
-	/** \brief Rumble feature enabled or disabled.
-	 * 
-	 * True if rumble has been turned on with command 0x4d, false otherwise.
-	 *  Rumble must be enabled and 7.5v supplied to pin 3!
-	 */
-	boolean rumbleEnabled;
-	
-	/** \brief requested left motor (motor 1) power. 
-	 * 
-	 * 0xff for on, 0x00 for off, motor does not support partial activation.
-	 *  Rumble must be enabled and 7.5v supplied to pin 3!
-	 */
-	byte motor1Level;
-	
-	/** \brief requested right motor (motor 2) power. 
-	 * 
-	 * 0x00 to 0xFF -> 0 to 100% power.
-	 *  Rumble must be enabled and 7.5v supplied to pin 3!
-	 */
-	byte motor2Level;
+	//! \brief Failed polls, by cause (see #PsxPollFailure)
+	word failures[PSFAIL_MAX];
 
-	/** \brief Assert the Attention line
-	 * 
-	 * This function must be implemented by derived classes and must set the
-	 * Attention line \a low so that the controller will pay attention to what
-	 * we will send.
-	 */
-	virtual void attention () = 0;
+	//! \brief Times the controller was found in Configuration Mode by a poll
+	word configRecoveries;
 
-	/** \brief Deassert the Attention line
-	 * 
-	 * This function must be implemented by derived classes and must set the
-	 * Attention line \a high so that the controller will no longer pay
-	 * attention to what we will send.
-	 */
-	virtual void noAttention () = 0;
+	//! \brief Commands resent by the configuration functions
+	word configRetries;
 
-	/** \brief Transfer a single byte to/from the controller
-	 * 
-	 * This function must be implemented by derived classes and must transfer
-	 * a single <i>command</i> byte to the controller and read back a single
-	 * <i>data</i> byte.
-	 * 
-	 * \param[in] out The command byte to send the controller
-	 * \return The data byte returned by the controller
-	 */
-	virtual byte shiftInOut (const byte out) = 0;
+	//! \brief Clear all statistics
+	void clear () {
+		memset (this, 0x00, sizeof (*this));
+		durationMin = 0xFFFF;
+	}
+};
 
-	/** \brief Transfer several bytes to/from the controller
-	 * 
-	 * This function transfers an array of <i>command</i> bytes to the
-	 * controller and reads back an equally sized array of <i>data</i> bytes.
-	 * 
-	 * \param[in] out The command bytes to send the controller
-	 * \param[out] in The data bytes returned by the controller, must be sized
-	 *                 to hold at least \a len bytes
-	 * \param[in] len The amount of bytes to be exchanged
-	 */
-	void shiftInOut (const byte *out, byte *in, const byte len) {
-#ifdef DUMP_COMMS
-		byte inbuf[len];
+/** \brief Number of entries in the protocol trace buffer
+ *
+ * This can be overridden before including this file. It must be a power of 2,
+ * every entry takes 4 bytes of RAM.
+ */
+#ifndef PSX_TRACE_SIZE
+#define PSX_TRACE_SIZE 64
 #endif
 
-		for (byte i = 0; i < len; ++i) {
-			byte tmp = shiftInOut (out != NULL ? out[i] : 0x5A);
-#ifdef DUMP_COMMS
-			inbuf[i] = tmp;
-#endif
-			if (in != NULL) {
-				in[i] = tmp;
-			}
+//! \brief Kinds of protocol trace entries
+enum PsxTraceKind {
+	PSTR_NONE = 0,
+	PSTR_ATTENTION_ON,		//!< Attention asserted
+	PSTR_ATTENTION_OFF,		//!< Attention deasserted
+	PSTR_BYTE				//!< Byte exchanged
+};
 
-			delayMicroseconds (INTER_CMD_BYTE_DELAY);   // Very important!
-		}
+/** \brief Protocol Trace Entry
+ *
+ * These are recorded by PsxController when PSX_TRACE is defined (either in
+ * PsxNewLib.h or before including it) and printed by
+ * PsxController::flushTrace().
+ *
+ * For #PSTR_ATTENTION_ON and #PSTR_ATTENTION_OFF, \a data is the time of the
+ * event, as the lowest 24 bits of the microseconds counter, little-endian.
+ * For #PSTR_BYTE, it is the command byte, followed by the data byte returned by
+ * the controller.
+ */
+struct PsxTraceEntry {
+	byte kind;		//!< Kind of entry, see #PsxTraceKind
+	byte data[3];	//!< Entry data
+};
 
-#ifdef DUMP_COMMS
-		Serial.print (F("<-- "));
-		for (byte i = 0; i < len; ++i) {
-			if (out && out[i] < 0x10)
-				Serial.print (0);
-			Serial.print (out ? out[i]: 0x5A, HEX);
-			Serial.print (' ');
-		}
-		Serial.println ();
+/** \brief Controller Configuration Profile
+ *
+ * Describes how a controller should be configured, all at once. This is what
+ * configure() and beginConfig() take, instead of calling enterConfigMode(),
+ * enableAnalogSticks() and friends one by one.
+ *
+ * The constructor covers the common cases, the masks can be tweaked
+ * afterwards if needed.
+ */
+struct PsxConfigProfile {
+	//! \brief Enable analog sticks
+	boolean analogSticks;
 
-		Serial.print (F("--> "));
-		for (byte i = 0; i < len; ++i) {
-			if (inbuf[i] < 0x10)
-				Serial.print (0);
-			Serial.print (inbuf[i], HEX);
-			Serial.print (' ');
-		}
-		Serial.println ();
-#endif
-	}
+	//! \brief Disable the \a ANALOG button, so that the user cannot turn off
+	//!        the analog sticks
+	boolean analogLocked;
 
-	/** \brief Transfer several bytes to/from the controller
-	 * 
-	 * This function transfers an array of <i>command</i> bytes to the
-	 * controller and reads back the full reply of <i>data</i> bytes. The size
-	 * of the reply is calculated automatically and padding bytes (0x5A) are
-	 * appended to the outgoing message if it is shorter.
-	 * 
-	 * The reply is stored in an internal buffer and will be valid until the
-	 * next call to this function, so make sure to save anything if is needed.
-	 * 
-	 * \param[out] out The data bytes returned by the controller, must be sized
-	 *                 to hold at least \a len bytes
-	 * \param[in] len The amount of bytes to be exchanged
-	 * \return A pointer to a buffer containing the reply, whose size can be
-	 *         calculated with getReplyLength()
+	/** \brief Analog buttons to report
+	 *
+	 * These are the parameters to the 0x4F command, all zeros disables analog
+	 * buttons. Only used if #analogSticks is true.
+	 *
+	 * Every bit enables a byte of the reply to a poll, starting with the 4th:
+	 * the first 6 bits are the buttons and sticks, which must always be
+	 * enabled, then come the pressures, in the order of #PsxAnalogButton. Use
+	 * setAnalogButtons() rather than filling this directly.
 	 */
-	byte *autoShift (const byte *out, const byte len) {
-		byte *ret = nullptr;
+	byte pressureMask[3];
 
-		if (len >= 3 && len <= BUFFER_SIZE) {
-			// All commands have at least 3 bytes, so shift out those first
-			shiftInOut (out, inputBuffer, 3);
-			if (isValidReply (inputBuffer)) {
-				// Reply is good, get full length
-				byte replyLen = getReplyLength (inputBuffer);
+	/** \brief Rumble motors mapping
+	 *
+	 * These are the parameters to the 0x4D command, 0x00 0x01 enables both
+	 * motors, 0xFF 0xFF disables them.
+	 */
+	byte rumbleMap[2];
 
-				// Shift out rest of command
-				if (len > 3) {
-					shiftInOut (out + 3, inputBuffer + 3, len - 3);
-				}
+	/** \brief Constructor
+	 *
+	 * \param[in] sticks true to enable analog sticks
+	 * \param[in] locked true to disable the \a ANALOG button
+	 * \param[in] buttons true to enable analog buttons (requires \a sticks)
+	 * \param[in] rumble true to enable rumble
+	 */
+	PsxConfigProfile (boolean sticks = true, boolean locked = false, boolean buttons = false, boolean rumble = false):
+		analogSticks (sticks), analogLocked (locked) {
+		pressureMask[0] = buttons ? 0xFF : 0x00;
+		pressureMask[1] = buttons ? 0xFF : 0x00;
+		pressureMask[2] = buttons ? 0x03 : 0x00;
+		rumbleMap[0] = rumble ? 0x00 : 0xFF;
+		rumbleMap[1] = rumble ? 0x01 : 0xFF;
+	}
 
-				byte left = replyLen - len + 3;
-				//~ Serial.print ("len = ");
-				//~ Serial.print (replyLen);
-				//~ Serial.print (", left = ");
-				//~ Serial.println (left);
-				if (left == 0) {
-					// The whole reply was gathered
-					ret = inputBuffer;
-				} else if (len + left <= BUFFER_SIZE) {
-					// Part of reply is still missing and we have space for it
-					shiftInOut (NULL, inputBuffer + len, left);
-					ret = inputBuffer;
-				} else {
-					// Reply incomplete but not enough space provided
+	/** \brief Select which analog buttons to report
+	 *
+	 * Only the pressures of these buttons will be included in the reply to a
+	 * poll, which gets shorter and quicker to transfer with every button
+	 * that is left out. Replies must have an even length, so if an odd
+	 * number of buttons is selected, the first one that is not is added.
+	 *
+	 * \param[in] buttons The buttons to report, 0 disables analog buttons
+	 *                    altogether
+	 */
+	void setAnalogButtons (PsxAnalogButtons buttons) {
+		buttons &= PSAB_ALL;
+
+		byte n = 0;
+		for (byte i = 0; i < PSX_ANALOG_BTN_DATA_SIZE; ++i) {
+			if ((buttons & PSAB_BIT (i)) != 0) {
+				++n;
+			}
+		}
+
+		if ((n & 1) != 0) {
+			for (byte i = 0; i < PSX_ANALOG_BTN_DATA_SIZE; ++i) {
+				if ((buttons & PSAB_BIT (i)) == 0) {
+					buttons |= PSAB_BIT (i);
+					break;
 				}
 			}
 		}
 
-		return ret;
+		// Buttons and sticks, then pressures
+		unsigned long mask = buttons != 0 ? (static_cast<unsigned long> (buttons) << 6) | 0x3F : 0;
+		pressureMask[0] = mask & 0xFF;
+		pressureMask[1] = (mask >> 8) & 0xFF;
+		pressureMask[2] = (mask >> 16) & 0xFF;
 	}
 
-	/** \brief Get reply length
-	 * 
-	 * Calculates the length of a command reply, in bytes
-	 * 
-	 * \param[in] buf The buffer containing the reply, must be at least 2 bytes
-	 *                long
-	 * \return The calculated length
+	/** \brief Get the analog buttons that will be reported
+	 *
+	 * \return The buttons whose pressure is enabled in #pressureMask
 	 */
-	byte getReplyLength (const byte *buf) const {
-		return (buf[1] & 0x0F) * 2;
-	}
-
-	inline boolean isValidReply (const byte *status) {
-		//~ return status[0] != 0xFF || status[1] != 0xFF || status[2] != 0xFF;
-		return status[1] != 0xFF && (status[2] == 0x5A || status[2] == 0x00);
-		//~ return /* status[0] == 0xFF && */ status[1] != 0xFF && status[2] == 0x5A;
+	PsxAnalogButtons getAnalogButtons () const {
+		unsigned long mask = pressureMask[0] | (static_cast<unsigned long> (pressureMask[1]) << 8) |
+		                     (static_cast<unsigned long> (pressureMask[2]) << 16);
+		return (mask >> 6) & PSAB_ALL;
 	}
 
-	// Green Mode controllers
-	inline boolean isFlightstickReply (const byte *status) {
-		return (status[1] & 0xF0) == 0x50;
+	//! \brief Check if any analog button is requested
+	boolean hasAnalogButtons () const {
+		return analogSticks && (pressureMask[0] | pressureMask[1] | pressureMask[2]) != 0;
 	}
 
-	inline boolean isDualShockReply (const byte *status) {
-		return (status[1] & 0xF0) == 0x70;
+	//! \brief Check if any rumble motor is mapped
+	boolean hasRumble () const {
+		return rumbleMap[0] != 0xFF || rumbleMap[1] != 0xFF;
 	}
+};
 
-	inline boolean isDualShock2Reply (const byte *status) {
-		return status[1] == 0x79;
-	}
+/** \brief Button Event
+ *
+ * A single button being pressed or released, as seen by a poll.
+ */
+struct PsxButtonEvent {
+	unsigned long time;		//!< Time the reply of the poll was received (us)
+	PsxButton button;		//!< Button that changed
+	boolean pressed;		//!< true if the button was pressed, false if released
+};
 
-	inline boolean isDigitalReply (const byte *status) {
+/** \brief Button Event Queue
+ *
+ * A ring buffer of #PsxButtonEvent that PsxController fills at every
+ * successful poll, once attached with PsxController::setEventQueue(). Every
+ * button that changed since the previous poll produces an event, in order, so
+ * that no press is lost even if the application looks at the controller less
+ * often than it is polled.
+ *
+ * The queue can be filled by a single producer and drained by a single
+ * consumer, without any locking. This means that polls can run in an interrupt
+ * handler (i.e.: through PsxPollScheduler), while loop() calls pop(). If the
+ * queue is full, new events are dropped and counted.
+ *
+ * This class does not own its storage, use PsxButtonEventBuffer to get a queue
+ * with a built-in buffer.
+ */
+class PsxButtonEventQueue {
+protected:
+	PsxButtonEvent *events;		//!< Storage, a power of 2 entries long
+	byte mask;					//!< Number of entries in #events, minus 1
+
+	/* Both indices run freely and are only reduced through #mask when
+	 * accessing #events, so that a full queue can be told from an empty one.
+	 * Each of them is only ever written by one side, and bytes are read and
+	 * written atomically.
+	 */
+	volatile byte head;			//!< Next entry to be written, producer side
+	volatile byte tail;			//!< Next entry to be read, consumer side
+
+	volatile word overflows;	//!< Events dropped because the queue was full
+
+public:
+	/** \brief Constructor
+	 *
+	 * \param[in] buffer Storage for the events
+	 * \param[in] size Number of entries in \a buffer, must be a power of 2, at
+	 *                 most 128
+	 */
+	PsxButtonEventQueue (PsxButtonEvent *buffer, const byte size): events (buffer),
+	                     mask (size - 1), head (0), tail (0), overflows (0) {
+	}
+
+	/** \brief Add an event to the queue
+	 *
+	 * This shall only be called by the producer.
+	 *
+	 * \param[in] event The event to add
+	 * \return true if the event was queued, false if the queue was full
+	 */
+	boolean push (const PsxButtonEvent& event) {
+		boolean ret = false;
+
+		byte h = head;
+		if (static_cast<byte> (h - tail) > mask) {
+			++overflows;
+		} else {
+			events[h & mask] = event;
+
+			// Make sure the event is in place before the consumer can see it
+			__asm__ __volatile__ ("" ::: "memory");
+			head = h + 1;
+			ret = true;
+		}
+
+		return ret;
+	}
+
+	/** \brief Remove the oldest event from the queue
+	 *
+	 * This shall only be called by the consumer.
+	 *
+	 * \param[out] event The event
+	 * \return true if an event was retrieved, false if the queue was empty
+	 */
+	boolean pop (PsxButtonEvent& event) {
+		boolean ret = false;
+
+		byte t = tail;
+		if (t != head) {
+			__asm__ __volatile__ ("" ::: "memory");
+			event = events[t & mask];
+
+			// Make sure the event has been copied before its entry is reused
+			__asm__ __volatile__ ("" ::: "memory");
+			tail = t + 1;
+			ret = true;
+		}
+
+		return ret;
+	}
+
+	//! \brief Get the number of events waiting in the queue
+	byte available () const {
+		return head - tail;
+	}
+
+	//! \brief Check if the queue is empty
+	boolean isEmpty () const {
+		return head == tail;
+	}
+
+	/** \brief Discard all events in the queue
+	 *
+	 * This shall only be called by the consumer.
+	 */
+	void clear () {
+		tail = head;
+	}
+
+	/** \brief Get the number of events that were dropped
+	 *
+	 * \return The number of events that did not fit into the queue
+	 */
+	word getOverflows () const {
+		noInterrupts ();
+		word ret = overflows;
+		interrupts ();
+
+		return ret;
+	}
+
+	//! \brief Reset the count of dropped events
+	void clearOverflows () {
+		noInterrupts ();
+		overflows = 0;
+		interrupts ();
+	}
+};
+
+/** \brief Button Event Queue with Built-In Storage
+ *
+ * \tparam SIZE Number of events the queue can hold, must be a power of 2, at
+ *              most 128
+ */
+template <byte SIZE>
+class PsxButtonEventBuffer: public PsxButtonEventQueue {
+	static_assert (SIZE > 0 && SIZE <= 128 && (SIZE & (SIZE - 1)) == 0, "Queue size must be a power of 2, at most 128");
+
+protected:
+	PsxButtonEvent storage[SIZE];
+
+public:
+	PsxButtonEventBuffer (): PsxButtonEventQueue (storage, SIZE) {
+	}
+};
+
+/** \brief Poll recording header
+ *
+ * Every recording made by PsxFrameRecorder starts with these bytes, followed
+ * by #PSX_RECORDING_VERSION.
+ */
+static const byte PSX_RECORDING_MAGIC[] = {'P', 'S', 'X', 'R'};
+
+//! \brief Version of the poll recording format
+const byte PSX_RECORDING_VERSION = 1;
+
+/** \brief Poll Frame Recorder
+ *
+ * This writes the raw replies to polls to a Stream (i.e.: Serial, or a file on
+ * an SD card), once attached with PsxController::setRecorder(), so that they
+ * can be fed back to the library later through PsxControllerReplay.
+ *
+ * The format is compact binary: the header (#PSX_RECORDING_MAGIC and
+ * #PSX_RECORDING_VERSION) is followed by a record per poll, made of:
+ * - The command byte, 0x42, or 0x43 which outside of Configuration Mode
+ *   replies just like a poll and is recorded as well.
+ * - The length of the reply, header included, 0 if the poll failed.
+ * - The time elapsed since the previous record (us), as an unsigned LEB128
+ *   number, i.e.: 7 bits per byte, least significant first, with the highest
+ *   bit set on all bytes but the last. It is 0 for the first record.
+ * - The reply itself.
+ *
+ * The quick presence checks PsxController::update() makes while no controller
+ * is connected are recorded as polls too, with just the 3-byte header of the
+ * reply, if any.
+ *
+ * Records are written once Attention has been released, so they don't affect
+ * the timing of the exchange itself, but they add to the time polls take, by
+ * a lot if the Stream has to wait for its buffer to drain.
+ */
+class PsxFrameRecorder {
+protected:
+	Stream& stream;
+
+	unsigned long lastTime;			//!< Time of the last record (us)
+	unsigned long frames;			//!< Records written since begin()
+
+	//! \brief Write a number as unsigned LEB128
+	void writeNumber (unsigned long n) {
+		while (n >= 0x80) {
+			stream.write (static_cast<byte> (n | 0x80));
+			n >>= 7;
+		}
+		stream.write (static_cast<byte> (n));
+	}
+
+public:
+	/** \brief Constructor
+	 *
+	 * \param[in] s Where the recording will be written
+	 */
+	PsxFrameRecorder (Stream& s): stream (s), lastTime (0), frames (0) {
+	}
+
+	/** \brief Start a recording
+	 *
+	 * This writes the header, it must be called before any records are
+	 * written.
+	 */
+	void begin () {
+		stream.write (PSX_RECORDING_MAGIC, sizeof (PSX_RECORDING_MAGIC));
+		stream.write (PSX_RECORDING_VERSION);
+		frames = 0;
+	}
+
+	/** \brief Write a record
+	 *
+	 * \param[in] cmd The command byte, the second one sent
+	 * \param[in] frame The reply to the poll, NULL if the poll failed
+	 * \param[in] len Length of \a frame
+	 * \param[in] t Time the poll took place (us)
+	 */
+	void record (const byte cmd, const byte *frame, const byte len, const unsigned long t) {
+		byte n = frame != NULL ? len : 0;
+
+		stream.write (cmd);
+		stream.write (n);
+		writeNumber (frames > 0 ? t - lastTime : 0);
+		if (n > 0) {
+			stream.write (frame, n);
+		}
+
+		lastTime = t;
+		++frames;
+	}
+
+	//! \brief Get the number of records written since begin()
+	unsigned long getFrames () const {
+		return frames;
+	}
+};
+
+/** \brief Rumble Source
+ *
+ * Something that drives the rumble motors over time, i.e.: PsxRumbleEngine.
+ * Once attached with PsxController::setRumbleSource(), it is asked for the
+ * motor levels right before every poll, which then carries them to the
+ * controller, so it takes no bus transactions of its own.
+ */
+class PsxRumbleSource {
+public:
+	/** \brief Get the motor levels for the next poll
+	 *
+	 * This is called by the poll, so it must return quickly. It might be
+	 * called from an interrupt handler, if polls run in one.
+	 *
+	 * \param[in] ms Current time (ms)
+	 * \param[out] motor1 Small motor, 0x00 for off or 0xFF for on
+	 * \param[out] motor2 Large motor power [0x00 ... 0xFF]
+	 */
+	virtual void getRumble (const unsigned long ms, byte& motor1, byte& motor2) = 0;
+};
+
+/** \brief Controller State
+ *
+ * All the data decoded from a single reply, in a compact form. This is what
+ * PsxControllerData::getState() returns, it is usually easier to go through
+ * the inspection functions though.
+ */
+struct PsxState {
+	/** \brief (Digital) Button Status
+	 * 
+	 * The individual bits can be identified through #PsxButton. Note that they
+	 * are active-low, i.e.: a bit is 0 when the button is pressed.
+	 */
+	PsxButtons buttonWord;
+
+	//! \brief #buttonWord at the previous poll
+	PsxButtons previousButtonWord;
+
+	//! \name Analog Stick Data
+	//! @{
+	byte lx;		//!< Horizontal axis of left stick [0-255, L to R]
+	byte ly;		//!< Vertical axis of left stick [0-255, U to D]
+	byte rx;		//!< Horizontal axis of right stick [0-255, L to R]
+	byte ry;		//!< Vertical axis of right stick [0-255, U to D]
+	//! @}
+
+#if PSX_HAVE_ANALOG_BUTTONS
+	/** \brief Analog Button Data
+	 * 
+	 * Indexed by #PsxAnalogButton. Only present if DualShock 2 or NeGcon
+	 * support is enabled, see #PSX_PROTOCOLS.
+	 */
+	byte analogButtonData[PSX_ANALOG_BTN_DATA_SIZE];
+#endif
+
+	/** \brief Controller Protocol
+	 *
+	 * The #PsxControllerProtocol the reply was interpreted with, stored as a
+	 * byte to keep this small.
+	 */
+	byte protocol;
+
+	boolean analogSticksValid;		//!< True if the analog stick data is valid
+	boolean analogButtonDataValid;	//!< True if #analogButtonData is valid
+
+	/** \brief Changed Fields
+	 *
+	 * The #PsxChange bits of the fields that changed meaningfully since they
+	 * were last reported, see PsxControllerData::getChanges().
+	 */
+	PsxChanges changes;
+};
+
+/** \brief PSX Controller Data
+ * 
+ * This holds the data received from a controller and implements all the
+ * functions that can be used to inspect it, but it does not know how to talk
+ * to the controller: that is done by PsxController, which derives from this.
+ * 
+ * On its own, this class represents controllers that are polled through some
+ * other means, for instance those connected to a multitap.
+ */
+class PsxControllerData {
+protected:
+	/** \brief Decoded Data
+	 * 
+	 * Two copies are kept: the one at #frontState is what all the inspection
+	 * functions report, while the other one is where the next reply gets
+	 * decoded. They are swapped once decoding is complete, so the data can
+	 * never be seen half-updated, not even from an interrupt handler.
+	 */
+	PsxState states[2];
+
+	//! \brief Index of the published entry of #states
+	volatile byte frontState;
+
+	//! \brief Number of times #states were swapped, wraps around
+	volatile byte stateSeq;
+
+	//! \name Change Detection
+	//! @{
+	byte axisRef[PSX_AXES_NO];				//!< Axes when last reported changed
+	byte axisThreshold[PSX_AXES_NO];		//!< Smallest reported axis change
+#if PSX_HAVE_ANALOG_BUTTONS
+	byte pressureRef[PSX_ANALOG_BTN_DATA_SIZE];			//!< Pressures when last reported changed
+	byte pressureThreshold[PSX_ANALOG_BTN_DATA_SIZE];	//!< Smallest reported pressure change
+#endif
+	//! @}
+
+#if PSX_HAVE_ANALOG_BUTTONS
+	/** \brief Analog buttons included in replies
+	 *
+	 * Those selected with the last 0x4F command, which tells which bytes of a
+	 * DualShock 2 reply belong to which button.
+	 */
+	PsxAnalogButtons pressureLayout;
+#endif
+
+	//! \brief Get the published data
+	const PsxState& state () const {
+		return states[frontState];
+	}
+
+	//! \brief Get the data being decoded
+	PsxState& nextState () {
+		return states[frontState ^ 1];
+	}
+
+	/** \brief Start decoding a new reply
+	 * 
+	 * Initializes the next data with the current ones, so that what a reply
+	 * does not carry is retained, apart from analog data, which is marked as
+	 * invalid. This must be followed by publishState().
+	 */
+	void beginState () {
+		PsxState& s = nextState ();
+		s = state ();
+		s.analogSticksValid = false;
+		s.analogButtonDataValid = false;
+	}
+
+	/** \brief Set the analog buttons included in replies
+	 *
+	 * This must be called whenever a 0x4F command is acknowledged.
+	 *
+	 * \param[in] buttons The buttons enabled by the command
+	 */
+	void setPressureLayout (const PsxAnalogButtons buttons) {
+#if PSX_HAVE_ANALOG_BUTTONS
+		pressureLayout = buttons != 0 ? buttons : PSAB_ALL;
+#else
+		(void) buttons;
+#endif
+	}
+
+	/** \brief Check if a value changed meaningfully
+	 *
+	 * That is, if it moved by at least \a threshold from \a ref, or if it
+	 * reached either end of its range, which is always reported. If so, \a ref
+	 * is updated.
+	 */
+	static boolean valueChanged (const byte value, byte& ref, const byte threshold) {
+		byte delta = value > ref ? value - ref : ref - value;
+		boolean ret = delta > 0 && (delta >= threshold || value == 0x00 || value == 0xFF);
+		if (ret) {
+			ref = value;
+		}
+
+		return ret;
+	}
+
+	//! \brief Fill in the #PsxState::changes of the next data
+	void findChanges () {
+		PsxState& s = nextState ();
+		const PsxState& prev = state ();
+		PsxChanges ch = PSCH_NONE;
+
+		if (s.buttonWord != prev.buttonWord) {
+			ch |= PSCH_BUTTONS;
+		}
+
+		if (s.protocol != prev.protocol || s.analogSticksValid != prev.analogSticksValid ||
+		    s.analogButtonDataValid != prev.analogButtonDataValid) {
+			ch |= PSCH_PROTOCOL;
+		}
+
+		if (s.analogSticksValid) {
+			const byte axes[PSX_AXES_NO] = {s.lx, s.ly, s.rx, s.ry};
+			for (byte i = 0; i < PSX_AXES_NO; ++i) {
+				if (valueChanged (axes[i], axisRef[i], axisThreshold[i])) {
+					ch |= PSCH_LX << i;
+				}
+			}
+		}
+
+#if PSX_HAVE_ANALOG_BUTTONS
+		if (s.analogButtonDataValid) {
+			for (byte i = 0; i < PSX_ANALOG_BTN_DATA_SIZE; ++i) {
+				if (valueChanged (s.analogButtonData[i], pressureRef[i], pressureThreshold[i])) {
+					ch |= PSCH_PRESSURE_FIRST << i;
+				}
+			}
+		}
+#endif
+
+		s.changes = ch;
+	}
+
+	//! \brief Swap #states, making the next data the published one
+	void swapState () {
+		// Make sure the data is in place before switching to it
+		__asm__ __volatile__ ("" ::: "memory");
+		frontState ^= 1;
+		++stateSeq;
+	}
+
+	/** \brief Make the next data available to the inspection functions
+	 *
+	 * This also finds out what changed since the previous data.
+	 */
+	void publishState () {
+		findChanges ();
+		swapState ();
+	}
+
+	/** \brief Reset all data
+	 * 
+	 * Brings everything back to how it is before any reply is received. All
+	 * fields are reported as changed, thresholds are retained.
+	 */
+	void clearData () {
+		PsxState& s = nextState ();
+
+		// No buttons pressed
+		s.buttonWord = ~PSB_NONE;
+		s.previousButtonWord = ~PSB_NONE;
+
+		// Start with all analog axes at midway position
+		s.lx = ANALOG_IDLE_VALUE;
+		s.ly = ANALOG_IDLE_VALUE;
+		s.rx = ANALOG_IDLE_VALUE;
+		s.ry = ANALOG_IDLE_VALUE;
+
+		s.analogSticksValid = false;
+#if PSX_HAVE_ANALOG_BUTTONS
+		memset (s.analogButtonData, 0, sizeof (s.analogButtonData));
+#endif
+		s.analogButtonDataValid = false;
+
+		s.protocol = PSPROTO_UNKNOWN;
+
+		// Whatever is reported next is relative to the idle state
+		memset (axisRef, ANALOG_IDLE_VALUE, sizeof (axisRef));
+#if PSX_HAVE_ANALOG_BUTTONS
+		memset (pressureRef, 0, sizeof (pressureRef));
+		pressureLayout = PSAB_ALL;
+#endif
+		s.changes = PSCH_ALL;
+
+		swapState ();
+	}
+
+	/** \brief Get reply length
+	 * 
+	 * Calculates the length of a command reply, in bytes
+	 * 
+	 * \param[in] buf The buffer containing the reply, must be at least 2 bytes
+	 *                long
+	 * \return The calculated length
+	 */
+	byte getReplyLength (const byte *buf) const {
+		return (buf[1] & 0x0F) * 2;
+	}
+
+	inline boolean isValidReply (const byte *status) {
+		//~ return status[0] != 0xFF || status[1] != 0xFF || status[2] != 0xFF;
+		return status[1] != 0xFF && (status[2] == 0x5A || status[2] == 0x00);
+		//~ return /* status[0] == 0xFF && */ status[1] != 0xFF && status[2] == 0x5A;
+	}
+
+	// Green Mode controllers
+	inline boolean isFlightstickReply (const byte *status) {
+		return (status[1] & 0xF0) == 0x50;
+	}
+
+	inline boolean isDualShockReply (const byte *status) {
+		return (status[1] & 0xF0) == 0x70;
+	}
+
+	// Any DualShock reply longer than 6 bytes carries analog button data
+	inline boolean isDualShock2Reply (const byte *status) {
+		return (status[1] & 0xF0) == 0x70 && (status[1] & 0x0F) > 0x03;
+	}
+
+	inline boolean isDigitalReply (const byte *status) {
 		return (status[1] & 0xF0) == 0x40;
 	}
 
-	inline boolean isConfigReply (const byte *status) {
-		return (status[1] & 0xF0) == 0xF0;
+	inline boolean isConfigReply (const byte *status) {
+		return (status[1] & 0xF0) == 0xF0;
+	}
+
+	inline boolean isNegconReply (const byte *status) {
+		return status[1] == 0x23;
+	}
+
+	inline boolean isJogconReply (const byte *status) {
+		return (status[1] & 0xF0) == 0xE0;
+	}
+
+	inline boolean isGunconReply (const byte *status) {
+		return status[1] == 0x63;
+	}
+
+	/** \brief Decode the reply to a poll command
+	 * 
+	 * Updates all button and stick data according to the reply, which must be
+	 * valid, complete and not a Configuration Mode one.
+	 * 
+	 * \param[in] in The reply to decode
+	 */
+	void decodePollReply (const byte *in) {
+		PsxState& s = nextState ();
+
+		// We surely have buttons
+		s.previousButtonWord = s.buttonWord;
+		s.buttonWord = ((PsxButtons) in[4] << 8) | in[3];
+
+		/* See if we have anything more to read. Tests for unsupported
+		 * protocols are resolved at compile time and optimized out.
+		 */
+		if ((PSX_PROTOCOLS & PSX_SUPPORT_DUALSHOCK2) && isDualShock2Reply (in)) {
+			s.protocol = PSPROTO_DUALSHOCK2;
+		} else if ((PSX_PROTOCOLS & (PSX_SUPPORT_DUALSHOCK | PSX_SUPPORT_DUALSHOCK2)) && isDualShockReply (in)) {
+			s.protocol = PSPROTO_DUALSHOCK;
+		} else if ((PSX_PROTOCOLS & PSX_SUPPORT_FLIGHTSTICK) && isFlightstickReply (in)) {
+			s.protocol = PSPROTO_FLIGHTSTICK;
+		} else if ((PSX_PROTOCOLS & PSX_SUPPORT_NEGCON) && isNegconReply (in)) {
+			s.protocol = PSPROTO_NEGCON;
+		} else if ((PSX_PROTOCOLS & PSX_SUPPORT_JOGCON) && isJogconReply (in)) {
+			s.protocol = PSPROTO_JOGCON;
+		} else if ((PSX_PROTOCOLS & PSX_SUPPORT_GUNCON) && isGunconReply (in)) {
+			s.protocol = PSPROTO_GUNCON;
+		} else {
+			s.protocol = PSPROTO_DIGITAL;
+		}
+
+		switch (s.protocol) {
+#if PSX_PROTOCOLS & (PSX_SUPPORT_DUALSHOCK | PSX_SUPPORT_DUALSHOCK2 | PSX_SUPPORT_FLIGHTSTICK | PSX_SUPPORT_GUNCON)
+			case PSPROTO_DUALSHOCK2:
+#if PSX_PROTOCOLS & PSX_SUPPORT_DUALSHOCK2
+				/* We also have analog button data, only for the buttons in
+				 * pressureLayout, in order, unless all were enabled
+				 */
+				s.analogButtonDataValid = true;
+				{
+					byte n = getReplyLength (in) - 6;
+					const byte *p = in + 9;
+					for (byte i = 0; i < PSX_ANALOG_BTN_DATA_SIZE; ++i) {
+						if (n > 0 && (pressureLayout & PSAB_BIT (i)) != 0) {
+							s.analogButtonData[i] = *p++;
+							--n;
+						} else {
+							s.analogButtonData[i] = 0;
+						}
+					}
+				}
+#endif
+				/* Now fall through to DualShock case, the next line
+				 * avoids GCC warning
+				 */
+				/* FALLTHRU */
+			case PSPROTO_GUNCON:
+				/* The Guncon uses the same reply format as DualShocks,
+				 * by just falling through we'll end up with:
+				 * - A (Left side) -> Start
+				 * - B (Right side) -> Cross
+				 * - Trigger -> Circle
+				 * - Low byte of HSYNC -> RX
+				 * - High byte of HSYNC -> RY
+				 * - Low byte of VSYNC -> LX
+				 * - High byte of VSYNC -> LY
+				 */
+			case PSPROTO_DUALSHOCK:
+			case PSPROTO_FLIGHTSTICK:
+				// We have analog stick data
+				s.analogSticksValid = true;
+				s.rx = in[5];
+				s.ry = in[6];
+				s.lx = in[7];
+				s.ly = in[8];
+				break;
+#endif
+#if PSX_PROTOCOLS & PSX_SUPPORT_NEGCON
+			case PSPROTO_NEGCON:
+				// Map the twist axis to X axis of left analog
+				s.analogSticksValid = true;
+				s.lx = in[5];
+
+				// Map analog button data to their reasonable counterparts
+				s.analogButtonDataValid = true;
+				s.analogButtonData[PSAB_CROSS] = in[6];
+				s.analogButtonData[PSAB_SQUARE] = in[7];
+				s.analogButtonData[PSAB_L1] = in[8];
+
+				// Make up "missing" digital data
+				if (s.analogButtonData[PSAB_SQUARE] >= NEGCON_I_II_BUTTON_THRESHOLD) {
+					s.buttonWord &= ~PSB_SQUARE;
+				}
+				if (s.analogButtonData[PSAB_CROSS] >= NEGCON_I_II_BUTTON_THRESHOLD) {
+					s.buttonWord &= ~PSB_CROSS;
+				}
+				if (s.analogButtonData[PSAB_L1] >= NEGCON_L_BUTTON_THRESHOLD) {
+					s.buttonWord &= ~PSB_L1;
+				}
+				break;
+#endif
+#if PSX_PROTOCOLS & PSX_SUPPORT_JOGCON
+			case PSPROTO_JOGCON:
+				/* Map the wheel X axis of left analog, half a rotation
+				 * per direction: byte 5 has the wheel position, it is
+				 * 0 at startup, then we have 0xFF down to 0x80 for
+				 * left/CCW, and 0x01 up to 0x80 for right/CW
+				 *
+				 * byte 6 is the number of full CW rotations
+				 * byte 7 is 0 if wheel is still, 1 if it is rotating CW
+				 *        and 2 if rotation CCW
+				 * byte 8 seems to stay at 0
+				 *
+				 * We'll want to cap the movement halfway in each
+				 * direction, for ease of use/implementation.
+				 */
+				s.analogSticksValid = true;
+				if (in[6] < 0x80) {
+					// CW up to half
+					s.lx = in[5] < 0x80 ? in[5] : (0x80 - 1);
+				} else {
+					// CCW down to half
+					s.lx = in[5] > 0x80 ? in[5] : (0x80 + 1);
+				}
+
+				// Bring to the usual 0-255 range
+				s.lx += 0x80;
+				break;
+#endif
+			default:
+				// We are already done
+				break;
+		}
+	}
+
+public:
+	PsxControllerData (): frontState (0), stateSeq (0) {
+		setPressureLayout (PSAB_ALL);
+		setAxisThresholds (1);
+		setAnalogButtonThresholds (1);
+	}
+
+	//! \name Inspection Functions
+	//! @{
+
+	/** \brief Retrieve all controller data at once
+	 * 
+	 * This returns the data of the last poll, in a form that is compact and
+	 * cheap to get at: no copy is made. Polls never write to it directly, as
+	 * they decode into a second buffer which then replaces this one as a
+	 * whole, so it is always consistent, even when polls run in an interrupt
+	 * handler.
+	 * 
+	 * It is however recycled by the poll after the next one, so a caller
+	 * running asynchronously to polls shall be done with it within a polling
+	 * period. If getStateSequence() did not change in the meantime, the data
+	 * was certainly consistent.
+	 * 
+	 * \return The last controller state
+	 */
+	const PsxState& getState () const {
+		return state ();
+	}
+
+	/** \brief Get the state sequence number
+	 * 
+	 * \return A number that changes whenever new data is published, wrapping
+	 *         around after 255
+	 */
+	byte getStateSequence () const {
+		return stateSeq;
+	}
+
+	/** \brief Retrieve the controller protocol
+	 * 
+	 * This function retrieves the protocol that was used to interpret
+	 * controller data at the last call to read().
+	 * 
+	 * \return The controller protocol
+	 */
+	PsxControllerProtocol getProtocol () const {
+		return static_cast<PsxControllerProtocol> (state ().protocol);
+	}
+
+	/** \brief Check if any button has changed state
+	 * 
+	 * \return true if any button has changed state with regard to the previous
+	 *         call to read(), false otherwise
+	 */
+	boolean buttonsChanged () const {
+		const PsxState& s = state ();
+		return ((s.previousButtonWord ^ s.buttonWord) > 0);
+	}
+
+	/** \brief Check if a button has changed state
+	 * 
+	 * \return true if \a button has changed state with regard to the previous
+	 *         call to read(), false otherwise
+	 */
+	boolean buttonChanged (const PsxButtons button) const {
+		const PsxState& s = state ();
+		return (((s.previousButtonWord ^ s.buttonWord) & button) > 0);
+	}
+
+	/** \brief Check if a button is currently pressed
+	 * 
+	 * \param[in] button The button to be checked
+	 * \return true if \a button was pressed in last call to read(), false
+	 *         otherwise
+	 */
+	boolean buttonPressed (const PsxButton button) const {
+		return buttonPressed (~state ().buttonWord, button);
+	}
+
+	/** \brief Check if a button is pressed in a Button Word
+	 * 
+	 * \param[in] buttons The button word to check in
+	 * \param[in] button The button to be checked
+	 * \return true if \a button is pressed in \a buttons, false otherwise
+	 */
+	boolean buttonPressed (const PsxButtons buttons, const PsxButton button) const {
+		return ((buttons & static_cast<const PsxButtons> (button)) > 0);
+	}
+
+	/** \brief Check if a button has just been pressed
+	 * 
+	 * \param[in] button The button to be checked
+	 * \return true if \a button was not pressed in the previous call to read()
+	 *         and is now, false otherwise
+	 */
+	boolean buttonJustPressed (const PsxButton button) const {
+		const PsxState& s = state ();
+		return ((s.previousButtonWord & ~s.buttonWord & button) > 0);
+	}
+
+	/** \brief Check if a button has just been released
+	 * 
+	 * \param[in] button The button to be checked
+	 * \return true if \a button was pressed in the previous call to read() and
+	 *         is not now, false otherwise
+	 */
+	boolean buttonJustReleased (const PsxButton button) const {
+		const PsxState& s = state ();
+		return ((~s.previousButtonWord & s.buttonWord & button) > 0);
+	}
+
+	/** \brief Check if NO button is pressed in a Button Word
+	 * 
+	 * \param[in] buttons The button word to check in
+	 * \return true if all buttons in \a buttons are released, false otherwise
+	 */
+	boolean noButtonPressed (const PsxButtons buttons) const {
+		return buttons == PSB_NONE;
+	}
+
+	/** \brief Check if NO button is currently pressed
+	 * 
+	 * \return true if all buttons were released in the last call to read(),
+	 *         false otherwise
+	 */
+	boolean noButtonPressed (void) const {
+		return state ().buttonWord == ~PSB_NONE;
+	}
+	
+	/** \brief Retrieve the <em>Button Word</em>
+	 * 
+	 * The button word contains the status of all digital buttons and can be
+	 * retrieved so that it can be inspected later.
+	 * 
+	 * \sa buttonPressed
+	 * \sa noButtonPressed
+	 * 
+	 * \return the Button Word
+	 */
+	PsxButtons getButtonWord () const {
+		return ~state ().buttonWord;
+	}
+
+	/** \brief Retrieve button pressure depth/strength
+	 * 
+	 * This function will return how deeply/strongly a button is pressed. It
+	 * will only work on DualShock 2 controllers after enabling this feature
+	 * with enableAnalogButtons().
+	 * 
+	 * Note that button pressure depth/strength is only available for the D-Pad
+	 * buttons, []/^/O/X, L1/2 and R1/2.
+	 *
+	 * \param[in] button the button the retrieve the pressure depth/strength of
+	 * \return the pressure depth/strength [0-255, Fully released to fully
+	 *         pressed]
+	 */
+	byte getAnalogButton (const PsxAnalogButton button) const {
+		byte ret = 0;
+
+#if PSX_HAVE_ANALOG_BUTTONS
+		const PsxState& s = state ();
+		if (s.analogButtonDataValid) {
+			ret = s.analogButtonData[button];
+		//~ } else if (buttonPressed (button)) {		// FIXME
+			//~ // No analog data, assume fully pressed or fully released
+			//~ ret = 0xFF;
+		}
+#else
+		(void) button;
+#endif
+
+		return ret;
+	}
+
+	/** \brief Retrieve all analog button data
+	 */
+	const byte* getAnalogButtonData () const {
+#if PSX_HAVE_ANALOG_BUTTONS
+		const PsxState& s = state ();
+		return s.analogButtonDataValid ? s.analogButtonData : NULL;
+#else
+		return NULL;
+#endif
+	}
+
+	/** \brief Retrieve position of the \a left analog stick
+	 * 
+	 * This function will return the absolute position of the left analog stick.
+	 * 
+	 * Note that not all controllers have analog sticks, in which case this
+	 * function will return false.
+	 * 
+	 * \param[in] x A variable where the horizontal position will be stored
+	 *              [0-255, L to R]
+	 * \param[in] y A variable where the vertical position will be stored
+	 *              [0-255, U to D]
+	 * \return true if the returned position is valid, false otherwise
+	 */
+	boolean getLeftAnalog (byte& x, byte& y) const {
+		const PsxState& s = state ();
+
+		x = s.lx;
+		y = s.ly;
+
+		return s.analogSticksValid;
+	}
+
+	/** \brief Retrieve position of the \a right analog stick
+	 * 
+	 * This function will return the absolute position of the right analog
+	 * stick.
+	 * 
+	 * Note that not all controllers have analog sticks, in which case this
+	 * function will return false.
+	 * 
+	 * \param[in] x A variable where the horizontal position will be stored
+	 *              [0-255, L to R]
+	 * \param[in] y A variable where the vertical position will be stored
+	 *              [0-255, U to D]
+	 * \return true if the returned position is valid, false otherwise
+	 */
+	boolean getRightAnalog (byte& x, byte& y) const {
+		const PsxState& s = state ();
+
+		x = s.rx;
+		y = s.ry;
+
+		return s.analogSticksValid;
+	}
+
+	/** \brief Retrieve Guncon X/Y readings
+	 *
+	 * According to the Nocash PSX Specifications, the Guncon returns 16-bit X/Y
+	 * coordinates of the screen it is aimed at.
+	 *
+	 * The coordinates are updated in all frames. The absolute min/max may vary
+	 * from TV set to TV set.
+	 *
+	 * Vertical coordinates are counted in scanlines (ie. equal to pixels).
+	 * Horizontal coordinates are counted in 8MHz units (which would equal a
+	 * resolution of 385 pixels; which can be, for example, converted to 320
+	 * pixel resolution as X=X*320/385).
+	 *
+	 * <em>Caution:</em> The gun only returns meaningful data when read shortly
+	 * after begin of VBLANK (ie. AFTER rendering, but still BEFORE vsync), so
+	 * make sure to only consider readings returning \a GUNCON_OK;
+	 *
+	 * \sa GunconStatus
+	 */
+	GunconStatus getGunconCoordinates (word& x, word& y) const {
+		const PsxState& s = state ();
+
+		GunconStatus status = GUNCON_OTHER_ERROR;
+
+		if (s.protocol == PSPROTO_GUNCON && s.analogSticksValid) {
+			status = GUNCON_OK;
+			
+			x = (((word) s.ry) << 8) | s.rx;
+			y = (((word) s.ly) << 8) | s.lx;
+
+			if (x == 0x0001) {
+				if (y == 0x0005) {
+					status = GUNCON_UNEXPECTED_LIGHT;
+				} else if (y == 0x000A) {
+					status = GUNCON_NO_LIGHT;
+				}
+			}
+		}
+
+		return status;
+	}
+	
+	//! @}		// Inspection Functions
+
+	//! \name Change Detection Functions
+	//! @{
+
+	/** \brief Find out what changed at the last call to read()
+	 *
+	 * Digital buttons are reported as soon as any changes, while analog axes
+	 * and buttons are only reported when they move by their threshold from
+	 * the value they had when they were last reported, so that small
+	 * fluctuations are ignored but slow movements are not lost. Reaching
+	 * either end of the range is always reported.
+	 *
+	 * This can be used to only send reports when something actually changed:
+	 *
+	 * \code
+	 * if (psx.read () && psx.getChanges () != PSCH_NONE) {
+	 *     // Send report...
+	 * }
+	 * \endcode
+	 *
+	 * When the data is reset, i.e.: by begin() or when the controller is
+	 * disconnected, all fields are reported as changed, after which changes
+	 * are relative to the idle state.
+	 *
+	 * \return A combination of #PsxChange bits
+	 */
+	PsxChanges getChanges () const {
+		return state ().changes;
+	}
+
+	/** \brief Check if some fields changed at the last call to read()
+	 *
+	 * \param[in] mask The #PsxChange bits of the fields to check
+	 * \return true if any of them changed, false otherwise
+	 */
+	boolean changed (const PsxChanges mask = PSCH_ALL) const {
+		return (state ().changes & mask) != 0;
+	}
+
+	/** \brief Check if the pressure of a button changed at the last call to
+	 *         read()
+	 *
+	 * \param[in] button The button to be checked
+	 * \return true if its pressure changed by at least its threshold, false
+	 *         otherwise
+	 */
+	boolean analogButtonChanged (const PsxAnalogButton button) const {
+		return changed (PSCH_PRESSURE_FIRST << button);
+	}
+
+	/** \brief Set the change threshold of an analog stick axis
+	 *
+	 * \param[in] axis The axis
+	 * \param[in] threshold Smallest change that is reported, 0 or 1 to report
+	 *                      any
+	 */
+	void setAxisThreshold (const PsxAxis axis, const byte threshold) {
+		axisThreshold[axis] = threshold;
+	}
+
+	//! \brief Set the change threshold of all analog stick axes
+	void setAxisThresholds (const byte threshold) {
+		memset (axisThreshold, threshold, sizeof (axisThreshold));
+	}
+
+	/** \brief Set the change threshold of an analog button
+	 *
+	 * \param[in] button The button
+	 * \param[in] threshold Smallest pressure change that is reported, 0 or 1
+	 *                      to report any
+	 */
+	void setAnalogButtonThreshold (const PsxAnalogButton button, const byte threshold) {
+#if PSX_HAVE_ANALOG_BUTTONS
+		pressureThreshold[button] = threshold;
+#else
+		(void) button;
+		(void) threshold;
+#endif
+	}
+
+	//! \brief Set the change threshold of all analog buttons
+	void setAnalogButtonThresholds (const byte threshold) {
+#if PSX_HAVE_ANALOG_BUTTONS
+		memset (pressureThreshold, threshold, sizeof (pressureThreshold));
+#else
+		(void) threshold;
+#endif
+	}
+
+	//! @}
+};
+
+/** \brief PSX Controller Port
+ * 
+ * This represents a controller that is not polled by itself, but rather by
+ * some other object which talks to several controllers (i.e.: PsxMultitap).
+ * The latter feeds the replies it gets, and this can then be inspected through
+ * the usual functions, i.e.: buttonPressed(), getLeftAnalog(), etc.
+ */
+class PsxControllerPort: public PsxControllerData {
+protected:
+	//! \brief True if a controller replied at the last poll
+	boolean connected;
+
+public:
+	//! \brief Reset all data and mark the port as empty
+	void reset () {
+		clearData ();
+		disconnect ();
+	}
+
+	/** \brief Update data from a reply
+	 * 
+	 * \param[in] in The full reply to a poll command
+	 */
+	void updateFromReply (const byte *in) {
+		beginState ();
+		connected = isValidReply (in) && !isConfigReply (in);
+		if (connected) {
+			decodePollReply (in);
+		}
+		publishState ();
+	}
+
+	//! \brief Mark the port as empty
+	void disconnect () {
+		beginState ();
+		connected = false;
+		publishState ();
+	}
+
+	/** \brief Check if a controller is connected to this port
+	 * 
+	 * \return true if a controller replied on this port at the last poll,
+	 *         false otherwise
+	 */
+	boolean isConnected () const {
+		return connected;
+	}
+};
+
+/** \brief PSX Controller Interface
+ * 
+ * This is the base class implementing interactions with PSX controllers. It is
+ * partially abstract, so it is not supposed to be instantiated directly.
+ */
+class PsxController: public PsxControllerData {
+protected:
+	/** \brief Size of internal communication buffer
+	 * 
+	 * This can be sized after the longest command reply (which is 21 bytes for
+	 * 01 42 when in DualShock 2 mode), but we're better safe than sorry,
+	 * unless some protocols were left out on purpose. Without DualShock 2
+	 * support, the longest reply is 9 bytes.
+	 */
+#if PSX_PROTOCOLS == PSX_PRESET_ALL
+	static const byte BUFFER_SIZE = 32;
+#elif PSX_PROTOCOLS & PSX_SUPPORT_DUALSHOCK2
+	static const byte BUFFER_SIZE = 21;
+#else
+	static const byte BUFFER_SIZE = 9;
+#endif
+
+	/** \brief Internal communication buffer
+	 * 
+	 * This is used to hold replies received from the controller.
+	 */
+	byte inputBuffer[BUFFER_SIZE];
+
+	/** \brief Rumble feature enabled or disabled.
+	 * 
+	 * True if rumble has been turned on with command 0x4d, false otherwise.
+	 *  Rumble must be enabled and 7.5v supplied to pin 3!
+	 */
+	boolean rumbleEnabled;
+	
+	/** \brief requested left motor (motor 1) power. 
+	 * 
+	 * 0xff for on, 0x00 for off, motor does not support partial activation.
+	 *  Rumble must be enabled and 7.5v supplied to pin 3!
+	 */
+	byte motor1Level;
+	
+	/** \brief requested right motor (motor 2) power. 
+	 * 
+	 * 0x00 to 0xFF -> 0 to 100% power.
+	 *  Rumble must be enabled and 7.5v supplied to pin 3!
+	 */
+	byte motor2Level;
+
+	//! \name Non-Blocking Poll Engine State
+	//! @{
+
+	//! \brief Phases of a non-blocking poll
+	enum PollPhase {
+		POLL_IDLE = 0,		//!< No poll was ever started
+		POLL_ATTENTION,		//!< Attention asserted, waiting for #ATTN_DELAY
+		POLL_BYTE_DELAY,	//!< Waiting for ACK, or #INTER_CMD_BYTE_DELAY at most
+		POLL_NO_ATTENTION,	//!< Attention released, waiting for #ATTN_DELAY
+		POLL_DONE			//!< Poll complete, result is available
+	};
+
+	PollPhase pollPhase;				//!< Current phase
+	byte pollCommand[sizeof (enter_config)];	//!< Command being sent
+	byte pollCommandLen;				//!< Length of #pollCommand
+	byte pollPos;						//!< Index of next byte to exchange
+	byte pollReplyLen;					//!< Full reply length, 0 until known
+	unsigned long pollPhaseStart;		//!< Time the current phase started (us)
+	boolean pollResult;					//!< What read() would have returned
+
+	/** \brief Controller was found in Configuration Mode
+	 *
+	 * When this happens, read() calls exitConfigMode(). The poll engine cannot
+	 * block, so it sends #exit_config instead of #poll until the controller
+	 * is out of Configuration Mode.
+	 */
+	boolean pollExitingConfig;
+	//! @}
+
+	//! \name Configuration Sequencer State
+	//! @{
+
+	/** \brief Steps of a configuration sequence
+	 *
+	 * Every step sends its command until the reply shows it was taken, then
+	 * moves on to the next one right away. The mode byte (i.e.: the second
+	 * byte of the reply) tells whether the controller is in Configuration
+	 * Mode and, once out of it, which mode it ended up in.
+	 */
+	enum ConfigStep {
+		CONFIG_IDLE = 0,		//!< No sequence was ever started
+		CONFIG_ENTER,			//!< Sending #enter_config until in Configuration Mode
+		CONFIG_SET_MODE,		//!< Sending #set_mode
+		CONFIG_SET_PRESSURES,	//!< Sending #set_pressures
+		CONFIG_ENABLE_RUMBLE,	//!< Sending #enable_rumble
+		CONFIG_EXIT,			//!< Sending #exit_config until out of Configuration Mode
+		CONFIG_VERIFY,			//!< Polling until the mode matches the profile
+		CONFIG_DONE,			//!< Sequence completed successfully
+		CONFIG_FAILED			//!< A step timed out
+	};
+
+	ConfigStep configStep;				//!< Current step
+	PsxConfigProfile configProfile;		//!< Profile being applied
+	unsigned long configStepStart;		//!< Time the current step started (ms)
+	unsigned long configLastAttempt;	//!< Time the last command was sent (ms)
+	boolean configRetrying;				//!< Last command failed, retry after #COMMAND_RETRY_INTERVAL
+	//! @}
+
+	//! \name Connection Manager State
+	//! @{
+	boolean connected;					//!< Controller present, as far as update() knows
+	byte missedPolls;					//!< Consecutive failed polls
+	boolean haveConfigProfile;			//!< #configProfile shall be applied on reconnection
+	//! @}
+
+	//! \name Clock Speed State
+	//! @{
+	byte clockLevel;					//!< Current clock speed level
+	boolean clockCalibrated;			//!< calibrateClock() was called, fall back on errors
+	byte calibratedClockLevel;			//!< Level chosen by calibrateClock()
+	byte clockErrors;					//!< Consecutive garbled replies
+	byte clockGoodPolls;				//!< Consecutive good polls
+	//! @}
+
+	/** \brief Expected length of the next poll frame
+	 * 
+	 * The full length (header included) of the reply to the last successful
+	 * poll, which the next one will most likely have as well. 0 if unknown.
+	 */
+	byte predictedFrameLen;
+
+	//! \brief Queue button events are added to, NULL if none
+	PsxButtonEventQueue *eventQueue;
+
+	//! \brief Recorder poll replies are passed to, NULL if none
+	PsxFrameRecorder *recorder;
+
+	//! \brief Where motor levels come from, NULL if set with setRumble()
+	PsxRumbleSource *rumbleSource;
+
+	//! \brief read() calls exitConfigMode() when needed, see setConfigRecovery()
+	boolean configRecovery;
+
+	//! \brief read() found the controller in Configuration Mode and left it there
+	boolean configStuck;
+
+#ifdef PSX_TRACE
+	static_assert ((PSX_TRACE_SIZE & (PSX_TRACE_SIZE - 1)) == 0, "PSX_TRACE_SIZE must be a power of 2");
+
+	//! \name Trace State
+	//! @{
+	PsxTraceEntry trace[PSX_TRACE_SIZE];
+	volatile word traceHead;			//!< Entries recorded so far
+	word traceTail;						//!< Entries printed so far
+	//! @}
+#endif
+
+#ifdef PSX_COLLECT_STATS
+	//! \name Statistics State
+	//! @{
+	PsxStats stats;
+	unsigned long statsPollStart;		//!< Time current poll started (us)
+	byte statsPollBytes;				//!< Bytes exchanged so far in current poll
+	//! @}
+#endif
+
+	//! \name Statistics Functions
+	//! @{
+	/* These do nothing unless PSX_COLLECT_STATS is defined, in which case
+	 * they will be optimized out completely.
+	 */
+
+	//! \brief Count a byte exchanged during a poll
+	void statsByte (const byte n = 1) {
+#ifdef PSX_COLLECT_STATS
+		statsPollBytes += n;
+#else
+		(void) n;
+#endif
+	}
+
+	//! \brief Mark the start of a poll
+	void statsPollBegin () {
+#ifdef PSX_COLLECT_STATS
+		statsPollStart = currentMicros ();
+		statsPollBytes = 0;
+#endif
+	}
+
+	//! \brief Mark the end of a poll
+	void statsPollEnd () {
+#ifdef PSX_COLLECT_STATS
+		unsigned long duration = currentMicros () - statsPollStart;
+		word d = duration > 0xFFFF ? 0xFFFF : duration;
+
+		if (stats.polls < 0xFFFFFFFFUL) {
+			++stats.polls;
+			stats.bytes += statsPollBytes;
+		}
+		stats.lastPollBytes = statsPollBytes;
+		if (d < stats.durationMin) {
+			stats.durationMin = d;
+		}
+		if (d > stats.durationMax) {
+			stats.durationMax = d;
+		}
+
+		byte bin = d / PSX_STATS_BIN_WIDTH;
+		if (bin >= PSX_STATS_BINS) {
+			bin = PSX_STATS_BINS - 1;
+		}
+		if (stats.histogram[bin] < 0xFFFF) {
+			++stats.histogram[bin];
+		}
+#endif
+	}
+
+	//! \brief Count a failed poll
+	void statsFailure (const PsxPollFailure cause) {
+#ifdef PSX_COLLECT_STATS
+		if (stats.failures[cause] < 0xFFFF) {
+			++stats.failures[cause];
+		}
+#else
+		(void) cause;
+#endif
+	}
+
+	//! \brief Count a poll finding the controller in Configuration Mode
+	void statsConfigRecovery () {
+#ifdef PSX_COLLECT_STATS
+		if (stats.configRecoveries < 0xFFFF) {
+			++stats.configRecoveries;
+		}
+#endif
+	}
+
+	/** \brief Deal with a poll reply showing Configuration Mode
+	 *
+	 * This gets the controller out of it, or just flags it if recovery was
+	 * disabled with setConfigRecovery().
+	 */
+	void configReplyReceived () {
+		statsConfigRecovery ();
+		if (configRecovery) {
+			exitConfigMode ();
+		} else {
+			configStuck = true;
+		}
+	}
+
+	//! \brief Count a configuration command being resent
+	void statsConfigRetry () {
+#ifdef PSX_COLLECT_STATS
+		if (stats.configRetries < 0xFFFF) {
+			++stats.configRetries;
+		}
+#endif
+	}
+
+	//! @}
+
+	//! \name Trace Functions
+	//! @{
+	/* These do nothing unless PSX_TRACE is defined, in which case they only
+	 * take a few cycles, so that tracing doesn't upset the timing of the
+	 * exchanges they record.
+	 */
+
+	//! \brief Record a trace entry
+	void traceEntry (const byte kind, const byte d0, const byte d1, const byte d2) {
+#ifdef PSX_TRACE
+		PsxTraceEntry& e = trace[traceHead & (PSX_TRACE_SIZE - 1)];
+		e.kind = kind;
+		e.data[0] = d0;
+		e.data[1] = d1;
+		e.data[2] = d2;
+		++traceHead;
+#else
+		(void) kind;
+		(void) d0;
+		(void) d1;
+		(void) d2;
+#endif
+	}
+
+	/** \brief Record a change of the Attention line
+	 * 
+	 * Derived classes shall call this from assertAttention() and
+	 * releaseAttention().
+	 * 
+	 * \param[in] asserted true if Attention is being asserted
+	 */
+	void traceAttention (const boolean asserted) {
+#ifdef PSX_TRACE
+		unsigned long t = currentMicros ();
+		traceEntry (asserted ? PSTR_ATTENTION_ON : PSTR_ATTENTION_OFF, t, t >> 8, t >> 16);
+#else
+		(void) asserted;
+#endif
+	}
+
+	//! \brief Record a byte exchanged with the controller
+	void traceByte (const byte out, const byte in) {
+		traceEntry (PSTR_BYTE, out, in, 0x00);
+	}
+
+	//! @}
+
+	/** \brief Assert the Attention line
+	 * 
+	 * This function must be implemented by derived classes and must set the
+	 * Attention line \a low so that the controller will pay attention to what
+	 * we will send.
+	 */
+	virtual void attention () = 0;
+
+	/** \brief Deassert the Attention line
+	 * 
+	 * This function must be implemented by derived classes and must set the
+	 * Attention line \a high so that the controller will no longer pay
+	 * attention to what we will send.
+	 */
+	virtual void noAttention () = 0;
+
+	/** \brief Assert the Attention line without waiting
+	 * 
+	 * This is the same as attention(), but it must return as soon as the line
+	 * has been asserted, without waiting for #ATTN_DELAY to elapse. It is used
+	 * by the non-blocking poll engine, which takes care of the wait by itself.
+	 * 
+	 * The default implementation just calls attention(), which works but will
+	 * block, so derived classes should override it.
+	 */
+	virtual void assertAttention () {
+		attention ();
+	}
+
+	/** \brief Deassert the Attention line without waiting
+	 * 
+	 * This is the same as noAttention(), but it must return as soon as the
+	 * line has been deasserted, without waiting for #ATTN_DELAY to elapse.
+	 * 
+	 * \sa assertAttention()
+	 */
+	virtual void releaseAttention () {
+		noAttention ();
+	}
+
+	/** \brief Transfer a single byte to/from the controller
+	 * 
+	 * This function must be implemented by derived classes and must transfer
+	 * a single <i>command</i> byte to the controller and read back a single
+	 * <i>data</i> byte.
+	 * 
+	 * \param[in] out The command byte to send the controller
+	 * \return The data byte returned by the controller
+	 */
+	virtual byte shiftInOut (const byte out) = 0;
+
+	//! \name Timing Functions
+	//! @{
+
+	/** \brief Get current time (us)
+	 * 
+	 * All timing in this class goes through this function and the following
+	 * ones, so that derived classes which do not talk to real hardware can
+	 * account for time as they see fit. The defaults just use the Arduino
+	 * ones.
+	 * 
+	 * \return The number of microseconds since some point in the past
+	 */
+	virtual unsigned long currentMicros () {
+		return micros ();
+	}
+
+	/** \brief Get current time (ms)
+	 * 
+	 * \return The number of milliseconds since some point in the past
+	 * \sa currentMicros()
+	 */
+	virtual unsigned long currentMillis () {
+		return millis ();
+	}
+
+	/** \brief Wait for some time (ms)
+	 * 
+	 * \param[in] ms The number of milliseconds to wait
+	 * \sa currentMicros()
+	 */
+	virtual void waitMillis (const unsigned long ms) {
+		delay (ms);
+	}
+
+	//! @}
+
+	//! \name Clock Speed Functions
+	//! @{
+
+	/** \brief Get the number of supported clock speeds
+	 * 
+	 * Derived classes that can drive the bus at different speeds shall
+	 * override this, together with getDefaultClockLevel() and
+	 * applyClockLevel(). Speeds are identified by a level, 0 being the
+	 * slowest one.
+	 * 
+	 * The default implementation only supports a single speed.
+	 * 
+	 * \return The number of clock speed levels
+	 */
+	virtual byte getClockLevelsNo () const {
+		return 1;
+	}
+
+	/** \brief Get the default clock speed
+	 * 
+	 * \return The level of the speed used until told otherwise
+	 */
+	virtual byte getDefaultClockLevel () const {
+		return 0;
+	}
+
+	/** \brief Switch clock speed
+	 * 
+	 * This will only be called between transactions.
+	 * 
+	 * \param[in] level The new clock speed level, always less than
+	 *                  getClockLevelsNo()
+	 */
+	virtual void applyClockLevel (const byte level) {
+		(void) level;
+	}
+
+	/** \brief Check if the current clock speed is reliable
+	 * 
+	 * Polls the controller #CLOCK_CALIBRATION_POLLS times and checks that all
+	 * replies are valid and that they all have the same header and buttons.
+	 * 
+	 * \param[inout] ref Header and buttons to compare replies to
+	 * \param[in] haveRef If false, \a ref is filled with those of the first
+	 *                    reply
+	 * \return true if all replies were consistent
+	 */
+	boolean checkClockLevel (byte *ref, boolean haveRef) {
+		boolean ret = true;
+
+		for (byte i = 0; ret && i < CLOCK_CALIBRATION_POLLS; ++i) {
+			byte out[sizeof (poll)];
+			byte *in = sendCommand (out, makePollCommand (out));
+
+			if (in == NULL || isConfigReply (in) || getReplyLength (in) < 2) {
+				ret = false;
+			} else if (!haveRef) {
+				memcpy (ref, in, 5);
+				haveRef = true;
+			} else if (memcmp (ref, in, 5) != 0) {
+				ret = false;
+			}
+		}
+
+		return ret;
+	}
+
+	/** \brief Keep track of a failed poll
+	 * 
+	 * After calibrateClock() was called, the clock is slowed down once
+	 * #CLOCK_FALLBACK_ERRORS consecutive polls got a garbled reply, whose
+	 * header is still in #inputBuffer. A reply showing that nobody is
+	 * answering at all is no fault of the clock: in that case the calibrated
+	 * speed is restored instead, ready for when the controller comes back.
+	 */
+	void clockFallback () {
+		if (clockCalibrated) {
+			clockGoodPolls = 0;
+			if (inputBuffer[1] == 0xFF) {
+				clockErrors = 0;
+				if (clockLevel < calibratedClockLevel) {
+					setClockLevel (calibratedClockLevel);
+				}
+			} else if (++clockErrors >= CLOCK_FALLBACK_ERRORS) {
+				clockErrors = 0;
+				if (clockLevel > 0) {
+					setClockLevel (clockLevel - 1);
+				}
+			}
+		}
+	}
+
+	/** \brief Keep track of a successful poll
+	 * 
+	 * After #CLOCK_RECOVERY_POLLS of these in a row, a clock that was slowed
+	 * down by clockFallback() is stepped back up by one level.
+	 */
+	void clockSuccess () {
+		if (clockCalibrated) {
+			clockErrors = 0;
+			if (clockLevel < calibratedClockLevel && ++clockGoodPolls >= CLOCK_RECOVERY_POLLS) {
+				clockGoodPolls = 0;
+				setClockLevel (clockLevel + 1);
+			}
+		}
+	}
+
+	//! @}
+
+	/** \brief Wait for the controller to be ready for the next byte
+	 * 
+	 * This is called after every byte is exchanged. The controller signals it
+	 * is ready to receive the next byte by pulsing the \a Acknowledge line,
+	 * except after the last byte of a reply.
+	 * 
+	 * The default implementation does not watch the line and just waits for
+	 * #INTER_CMD_BYTE_DELAY. Derived classes that know where the line is
+	 * connected should override this.
+	 * 
+	 * \param[in] lastByte true if the byte just exchanged was the last one of
+	 *                     the reply, which is never acknowledged
+	 */
+	virtual void waitAck (const boolean lastByte) {
+		(void) lastByte;
+		delayMicroseconds (INTER_CMD_BYTE_DELAY);   // Very important!
+	}
+
+	/** \brief Check if the controller is ready for the next byte
+	 * 
+	 * This is the non-blocking counterpart of waitAck(), which tick() calls
+	 * while waiting between bytes, until #INTER_CMD_BYTE_DELAY has elapsed.
+	 * 
+	 * The default implementation does not watch the line and always returns
+	 * false, so that the whole delay is waited for.
+	 * 
+	 * \param[in] lastByte true if the byte just exchanged was the last one of
+	 *                     the reply, which is never acknowledged
+	 * \return true if the controller acknowledged the last byte
+	 */
+	virtual boolean checkAck (const boolean lastByte) {
+		(void) lastByte;
+		return false;
+	}
+
+	/** \brief Exchange several bytes with the controller
+	 * 
+	 * This is the loop behind shiftInOut(const byte*, byte*, const byte,
+	 * const boolean), which calls shiftInOut(const byte) and waitAck() for
+	 * every byte, through the vtable. Transports can replace it with a loop
+	 * where those calls are resolved at compile time and inlined, see
+	 * PsxControllerStatic.
+	 * 
+	 * \param[in] out The command bytes to send, NULL to send 0x5A
+	 * \param[out] in Where to store the bytes returned by the controller, can
+	 *                be NULL
+	 * \param[in] len The amount of bytes to be exchanged
+	 * \param[in] endOfReply true if the last byte to be exchanged is also the
+	 *                       last one of the reply
+	 */
+	virtual void transferBytes (const byte *out, byte *in, const byte len, const boolean endOfReply) {
+		for (byte i = 0; i < len; ++i) {
+			byte tmp = shiftInOut (out != NULL ? out[i] : 0x5A);
+			if (in != NULL) {
+				in[i] = tmp;
+			}
+
+			waitAck (endOfReply && i == len - 1);
+		}
+	}
+
+	/** \brief Transfer several bytes to/from the controller
+	 * 
+	 * This function transfers an array of <i>command</i> bytes to the
+	 * controller and reads back an equally sized array of <i>data</i> bytes.
+	 * 
+	 * \param[in] out The command bytes to send the controller
+	 * \param[out] in The data bytes returned by the controller, must be sized
+	 *                 to hold at least \a len bytes
+	 * \param[in] len The amount of bytes to be exchanged
+	 * \param[in] endOfReply true if the last byte to be exchanged is also the
+	 *                       last one of the reply
+	 */
+	void shiftInOut (const byte *out, byte *in, const byte len, const boolean endOfReply = false) {
+#ifdef PSX_TRACE
+		byte inbuf[len];
+		transferBytes (out, inbuf, len, endOfReply);
+		if (in != NULL) {
+			memcpy (in, inbuf, len);
+		}
+
+		// Recorded only once the whole block has been exchanged
+		for (byte i = 0; i < len; ++i) {
+			traceByte (out != NULL ? out[i] : 0x5A, inbuf[i]);
+		}
+#else
+		transferBytes (out, in, len, endOfReply);
+#endif
+		statsByte (len);
+	}
+
+	/** \brief Exchange a whole poll frame at once
+	 * 
+	 * This is the fast path of autoShift(), used when the length of the reply
+	 * can be predicted from the previous poll: the command is padded to
+	 * #predictedFrameLen and exchanged in a single call to shiftInOut(), rather
+	 * than in three steps, with the header only checked afterwards.
+	 * 
+	 * If the controller changed mode in the meantime and the reply turns out
+	 * to be longer, the rest is fetched right away. There's no point in
+	 * waiting for the acknowledge of the last byte at that point, as its
+	 * pulse is most likely over already. If the reply is shorter, whatever
+	 * was received past its end is just ignored.
+	 * 
+	 * \param[in] out The command to send
+	 * \param[in] len Length of \a out, at most #predictedFrameLen
+	 * \return A pointer to the reply, or NULL if it is not valid
+	 */
+	byte *burstShift (const byte *out, const byte len) {
+		byte *ret = NULL;
+
+		byte frame[BUFFER_SIZE];
+		memcpy (frame, out, len);
+		memset (frame + len, 0x5A, predictedFrameLen - len);
+		shiftInOut (frame, inputBuffer, predictedFrameLen, true);
+
+		if (isValidReply (inputBuffer)) {
+			byte frameLen = getReplyLength (inputBuffer) + 3;
+			if (frameLen < len) {
+				statsFailure (PSFAIL_REPLY_TRUNCATED);
+			} else if (frameLen > BUFFER_SIZE) {
+				statsFailure (PSFAIL_BUFFER_TOO_SMALL);
+			} else {
+				if (frameLen > predictedFrameLen) {
+					// Longer than expected, get the rest
+					shiftInOut (NULL, inputBuffer + predictedFrameLen, frameLen - predictedFrameLen, true);
+				}
+				ret = inputBuffer;
+			}
+		} else {
+			statsFailure (PSFAIL_INVALID_HEADER);
+		}
+
+		return ret;
+	}
+
+	/** \brief Transfer several bytes to/from the controller
+	 * 
+	 * This function transfers an array of <i>command</i> bytes to the
+	 * controller and reads back the full reply of <i>data</i> bytes. The size
+	 * of the reply is calculated automatically and padding bytes (0x5A) are
+	 * appended to the outgoing message if it is shorter.
+	 * 
+	 * The reply is stored in an internal buffer and will be valid until the
+	 * next call to this function, so make sure to save anything if is needed.
+	 * 
+	 * Polls go through burstShift() instead, when the length of their reply
+	 * can be predicted.
+	 * 
+	 * \param[out] out The data bytes returned by the controller, must be sized
+	 *                 to hold at least \a len bytes
+	 * \param[in] len The amount of bytes to be exchanged
+	 * \return A pointer to a buffer containing the reply, whose size can be
+	 *         calculated with getReplyLength()
+	 */
+	byte *autoShift (const byte *out, const byte len) {
+		byte *ret = nullptr;
+
+		boolean isPoll = len >= 3 && out[1] == poll[1];
+		if (isPoll && predictedFrameLen >= len && predictedFrameLen <= BUFFER_SIZE) {
+			ret = burstShift (out, len);
+		} else if (len >= 3 && len <= BUFFER_SIZE) {
+			// All commands have at least 3 bytes, so shift out those first
+			shiftInOut (out, inputBuffer, 3);
+			if (isValidReply (inputBuffer)) {
+				// Reply is good, get full length
+				byte replyLen = getReplyLength (inputBuffer);
+				byte left = replyLen - len + 3;
+
+				// Shift out rest of command
+				if (len > 3) {
+					shiftInOut (out + 3, inputBuffer + 3, len - 3, left == 0);
+				}
+
+				//~ Serial.print ("len = ");
+				//~ Serial.print (replyLen);
+				//~ Serial.print (", left = ");
+				//~ Serial.println (left);
+				if (left == 0) {
+					// The whole reply was gathered
+					ret = inputBuffer;
+				} else if (len + left <= BUFFER_SIZE) {
+					// Part of reply is still missing and we have space for it
+					shiftInOut (NULL, inputBuffer + len, left, true);
+					ret = inputBuffer;
+				} else if (replyLen + 3 < len) {
+					// Reply is shorter than command
+					statsFailure (PSFAIL_REPLY_TRUNCATED);
+				} else {
+					// Reply incomplete but not enough space provided
+					statsFailure (PSFAIL_BUFFER_TOO_SMALL);
+				}
+			} else {
+				statsFailure (PSFAIL_INVALID_HEADER);
+			}
+		} else {
+			statsFailure (PSFAIL_BUFFER_TOO_SMALL);
+		}
+
+		if (isPoll) {
+			predictedFrameLen = ret != NULL ? getReplyLength (ret) + 3 : 0;
+		}
+
+		return ret;
+	}
+
+	/** \brief Send a command to the controller
+	 * 
+	 * This takes care of a whole transaction: it asserts Attention, exchanges
+	 * the command and its reply through autoShift() and releases Attention.
+	 * The reply is only passed to the recorder, if any, after that.
+	 * 
+	 * \param[in] out The command to send
+	 * \param[in] len Length of \a out
+	 * \return A pointer to the reply, as returned by autoShift()
+	 */
+	byte *sendCommand (const byte *out, const byte len) {
+		attention ();
+		byte *ret = autoShift (out, len);
+		noAttention ();
+
+		if (len >= 3) {
+			recordFrame (out, ret);
+		}
+
+		return ret;
 	}
 
-	inline boolean isNegconReply (const byte *status) {
-		return status[1] == 0x23;
+	/** \brief Prepare the command used to poll the controller
+	 * 
+	 * This is #poll, with the current motor levels filled in if rumble is
+	 * enabled.
+	 * 
+	 * \param[out] out Buffer to hold the command, must be at least
+	 *                 <tt>sizeof (poll)</tt> bytes long
+	 * \return The number of bytes to be sent
+	 */
+	byte makePollCommand (byte *out) const {
+		byte len = 3;
+
+		memcpy (out, poll, sizeof (poll));
+		if (rumbleEnabled) {
+			out[3] = motor1Level;
+			out[4] = motor2Level;
+			len = sizeof (poll);
+		}
+
+		return len;
 	}
 
-	inline boolean isJogconReply (const byte *status) {
-		return (status[1] & 0xF0) == 0xE0;
+	/** \brief Update the motor levels from #rumbleSource
+	 * 
+	 * This must be called right before building every poll command.
+	 */
+	void updateRumble () {
+		if (rumbleSource != NULL) {
+			rumbleSource->getRumble (currentMillis (), motor1Level, motor2Level);
+		}
 	}
 
-	inline boolean isGunconReply (const byte *status) {
-		return status[1] == 0x63;
+	/** \brief Exchange the next byte of a non-blocking poll
+	 * 
+	 * As soon as the 3-byte header has been received, the full reply length
+	 * is determined, with the same rules as autoShift().
+	 */
+	void shiftNextPollByte () {
+		byte out = pollPos < pollCommandLen ? pollCommand[pollPos] : 0x5A;
+		byte in = shiftInOut (out);
+		inputBuffer[pollPos] = in;
+		++pollPos;
+		statsByte ();
+		traceByte (out, in);
+
+		if (pollPos == 3) {
+			if (!isValidReply (inputBuffer)) {
+				statsFailure (PSFAIL_INVALID_HEADER);
+			} else {
+				byte len = getReplyLength (inputBuffer) + 3;
+				if (len < pollCommandLen) {
+					statsFailure (PSFAIL_REPLY_TRUNCATED);
+				} else if (len > BUFFER_SIZE) {
+					statsFailure (PSFAIL_BUFFER_TOO_SMALL);
+				} else {
+					pollReplyLen = len;
+				}
+			}
+		}
+
+		pollPhaseStart = currentMicros ();
+		pollPhase = POLL_BYTE_DELAY;
+	}
+
+	/** \brief Complete a non-blocking poll
+	 * 
+	 * Interprets the reply just like read() does.
+	 */
+	void finishPoll () {
+		beginState ();
+		pollResult = false;
+
+		const byte *in = pollReplyLen > 0 && pollPos == pollReplyLen ? inputBuffer : NULL;
+		recordFrame (pollCommand, in);
+
+		if (isConfiguring ()) {
+			advanceConfig (in);
+		} else {
+			statsPollEnd ();
+			pollResult = handlePollReply (in);
+		}
+		publishState ();
+
+		pollPhase = POLL_DONE;
+	}
+
+	/** \brief Interpret the reply to a non-blocking poll
+	 * 
+	 * This is shared by all the ways a poll can be carried out without
+	 * blocking, which cannot call exitConfigMode() when the controller is
+	 * found in Configuration Mode: #exit_config is sent in place of the next
+	 * poll instead.
+	 * 
+	 * \param[in] in The full reply, or NULL if none was received
+	 * \return What read() would have returned
+	 */
+	boolean handlePollReply (const byte *in) {
+		boolean ret = false;
+
+		if (in != NULL) {
+			if (pollExitingConfig) {
+				// This was an exit_config, see if it worked
+				pollExitingConfig = isConfigReply (in);
+			} else if (isConfigReply (in)) {
+				// We're stuck in config mode, try to get out at next poll
+				statsConfigRecovery ();
+				pollExitingConfig = true;
+			} else {
+				decodePollReply (in);
+				queueButtonEvents ();
+				clockSuccess ();
+				ret = true;
+			}
+		} else {
+			clockFallback ();
+		}
+
+		return ret;
+	}
+
+	/** \brief Prepare the command for the next non-blocking poll
+	 * 
+	 * This is #poll, or #exit_config if the controller was found in
+	 * Configuration Mode.
+	 * 
+	 * \param[out] out Buffer to hold the command, must be at least
+	 *                 <tt>sizeof (poll)</tt> bytes long
+	 * \return The number of bytes to be sent
+	 */
+	byte makeNextPollCommand (byte *out) const {
+		byte len;
+
+		if (pollExitingConfig) {
+			memcpy (out, exit_config, 4);
+			len = 4;
+		} else {
+			len = makePollCommand (out);
+		}
+
+		return len;
+	}
+
+	/** \brief Start exchanging #pollCommand with the controller
+	 * 
+	 * The exchange is then carried out by tick().
+	 */
+	void startTransaction () {
+		statsPollBegin ();
+		pollPos = 0;
+		pollReplyLen = 0;
+		pollResult = false;
+
+		assertAttention ();
+		pollPhaseStart = currentMicros ();
+		pollPhase = POLL_ATTENTION;
+	}
+
+	//! \brief Check if a configuration sequence is in progress
+	boolean isConfiguring () const {
+		return configStep != CONFIG_IDLE && configStep != CONFIG_DONE && configStep != CONFIG_FAILED;
+	}
+
+	/** \brief Prepare the command for the current configuration step
+	 * 
+	 * \param[out] out Buffer to hold the command, must be at least
+	 *                 <tt>sizeof (enter_config)</tt> bytes long
+	 * \return The number of bytes to be sent
+	 */
+	byte makeConfigCommand (byte *out) const {
+		byte len = 0;
+
+		switch (configStep) {
+			case CONFIG_ENTER:
+				memcpy (out, enter_config, 4);
+				len = 4;
+				break;
+			case CONFIG_SET_MODE:
+				memcpy (out, set_mode, 5);
+				out[3] = configProfile.analogSticks ? 0x01 : 0x00;
+				out[4] = configProfile.analogLocked ? 0x03 : 0x00;
+				len = 5;
+				break;
+			case CONFIG_SET_PRESSURES:
+				memcpy (out, set_pressures, 6);
+				memcpy (out + 3, configProfile.pressureMask, 3);
+				len = 6;
+				break;
+			case CONFIG_ENABLE_RUMBLE:
+				memcpy (out, enable_rumble, 5);
+				memcpy (out + 3, configProfile.rumbleMap, 2);
+				len = 5;
+				break;
+			case CONFIG_EXIT:
+				memcpy (out, exit_config, 4);
+				len = 4;
+				break;
+			case CONFIG_VERIFY:
+			default:
+				len = makePollCommand (out);
+				break;
+		}
+
+		return len;
+	}
+
+	/** \brief Check if a reply shows the mode requested by the profile
+	 * 
+	 * \param[in] in A valid reply, not a Configuration Mode one
+	 */
+	boolean isProfileMode (const byte *in) {
+		boolean ret;
+
+		if (!configProfile.analogSticks) {
+			ret = isDigitalReply (in);
+		} else if (configProfile.hasAnalogButtons ()) {
+			ret = isDualShock2Reply (in);
+		} else {
+			ret = isDualShockReply (in) && !isDualShock2Reply (in);
+		}
+
+		return ret;
+	}
+
+	/** \brief Move the configuration sequence on
+	 * 
+	 * This is called when the command of the current step has been exchanged.
+	 * 
+	 * \param[in] in The full reply, or NULL if none was received
+	 */
+	void advanceConfig (const byte *in) {
+		ConfigStep next = configStep;
+		boolean inConfig = in != NULL && isConfigReply (in);
+
+		switch (configStep) {
+			case CONFIG_ENTER:
+				if (inConfig) {
+					next = CONFIG_SET_MODE;
+				}
+				break;
+			case CONFIG_SET_MODE:
+				if (inConfig) {
+					// Analog buttons need analog sticks
+					next = configProfile.analogSticks ? CONFIG_SET_PRESSURES : CONFIG_ENABLE_RUMBLE;
+				}
+				break;
+			case CONFIG_SET_PRESSURES:
+				if (inConfig) {
+					setPressureLayout (configProfile.getAnalogButtons ());
+					next = CONFIG_ENABLE_RUMBLE;
+				}
+				break;
+			case CONFIG_ENABLE_RUMBLE:
+				if (inConfig) {
+					rumbleEnabled = configProfile.hasRumble ();
+					next = CONFIG_EXIT;
+				}
+				break;
+			case CONFIG_EXIT:
+			case CONFIG_VERIFY:
+				if (in != NULL && !inConfig) {
+					// Outside of Configuration Mode, 0x43 replies just like 0x42
+					decodePollReply (in);
+					queueButtonEvents ();
+					pollResult = true;
+
+					/* Some controllers take a little while to switch mode, so
+					 * keep polling until they do
+					 */
+					next = isProfileMode (in) ? CONFIG_DONE : CONFIG_VERIFY;
+				}
+				break;
+			default:
+				break;
+		}
+
+		unsigned long now = currentMillis ();
+		if (next != configStep) {
+			configStep = next;
+			configStepStart = now;
+			configRetrying = false;
+		} else if (now - configStepStart > COMMAND_TIMEOUT) {
+			configStep = CONFIG_FAILED;
+		} else {
+			statsConfigRetry ();
+			configRetrying = true;
+			configLastAttempt = now;
+		}
+	}
+
+	/** \brief Check if a controller is present
+	 * 
+	 * This only exchanges the 3-byte header of #poll, which is enough to tell
+	 * whether anybody is answering, and bails out right after it. It is
+	 * recorded as a poll whose reply is just that header.
+	 * 
+	 * \return true if a controller replied
+	 */
+	boolean probe () {
+		attention ();
+		shiftInOut (poll, inputBuffer, 3);
+		noAttention ();
+
+		boolean ret = isValidReply (inputBuffer);
+		if (recorder != NULL) {
+			recorder->record (poll[1], ret ? inputBuffer : NULL, 3, currentMicros ());
+		}
+
+		return ret;
+	}
+
+	/** \brief Queue events for the buttons that changed at the last poll
+	 * 
+	 * This must be called after every successful decodePollReply(), before
+	 * publishState(). All events get the current time, buttons are reported
+	 * in the order of #PsxButton.
+	 */
+	void queueButtonEvents () {
+		if (eventQueue != NULL) {
+			const PsxState& s = nextState ();
+			PsxButtons changed = s.previousButtonWord ^ s.buttonWord;
+			if (changed != 0) {
+				PsxButtonEvent event;
+				event.time = currentMicros ();
+
+				for (PsxButtons b = 1; b != 0; b <<= 1) {
+					if ((changed & b) != 0) {
+						event.button = static_cast<PsxButton> (b);
+						event.pressed = (s.buttonWord & b) == 0;
+						eventQueue->push (event);
+					}
+				}
+			}
+		}
+	}
+
+	/** \brief Record the reply to a command
+	 * 
+	 * This must be called for every command once its transaction is over,
+	 * which sendCommand() does. Only replies to polls are recorded, along with
+	 * those to 0x43, which outside of Configuration Mode replies just like
+	 * 0x42.
+	 * 
+	 * \param[in] out The command, at least 2 bytes long
+	 * \param[in] in The reply, NULL if it was not valid
+	 */
+	void recordFrame (const byte *out, const byte *in) {
+		if (recorder != NULL && (out[1] == poll[1] || out[1] == enter_config[1])) {
+			recorder->record (out[1], in, in != NULL ? getReplyLength (in) + 3 : 0, currentMicros ());
+		}
 	}
-	
 
 public:
+	PsxController (): eventQueue (NULL), recorder (NULL), rumbleSource (NULL),
+	                  configRecovery (true), configStuck (false) {
+	}
+
 	/** \brief Initialize library
 	 * 
 	 * This function shall be called before any others, it will initialize the
@@ -570,28 +2847,46 @@ public:
 	 * \return true if a supported controller was found, false otherwise
 	 */
 	virtual boolean begin () {
-		// Start with all analog axes at midway position
-		lx = ANALOG_IDLE_VALUE;		
-		ly = ANALOG_IDLE_VALUE;
-		rx = ANALOG_IDLE_VALUE;
-		ry = ANALOG_IDLE_VALUE;
+#ifdef PSX_TRACE
+		traceHead = 0;
+		traceTail = 0;
+#endif
 
-		analogSticksValid = false;
-		memset (analogButtonData, 0, sizeof (analogButtonData));
+		clearData ();
 
-		protocol = PSPROTO_UNKNOWN;
-		
 		rumbleEnabled = false;
 		motor1Level = 0x00;
 		motor2Level = 0x00;
 
+#ifdef PSX_COLLECT_STATS
+		stats.clear ();
+#endif
+
+		pollPhase = POLL_IDLE;
+		pollExitingConfig = false;
+		pollResult = false;
+		configStep = CONFIG_IDLE;
+		configProfile = PsxConfigProfile (false);
+		haveConfigProfile = false;
+		missedPolls = 0;
+		configStuck = false;
+
+		clockCalibrated = false;
+		calibratedClockLevel = 0;
+		clockErrors = 0;
+		clockGoodPolls = 0;
+		predictedFrameLen = 0;
+		setClockLevel (getDefaultClockLevel ());
+
 		// Some disposable readings to let the controller know we are here
 		for (byte i = 0; i < 5; ++i) {
 			read ();
-			delay (1);
+			waitMillis (1);
 		}
 
-		return read ();
+		connected = read ();
+
+		return connected;
 	}
 
 	//! \name Configuration Mode Functions
@@ -610,19 +2905,18 @@ public:
 	boolean enterConfigMode () {
 		boolean ret = false;
 
-		unsigned long start = millis ();
+		unsigned long start = currentMillis ();
 		do {
-			attention ();
-			byte *in = autoShift (enter_config, 4);
-			noAttention ();
+			byte *in = sendCommand (enter_config, 4);
 
 			ret = in != NULL && isConfigReply (in);
 
 			if (!ret) {
-				delay (COMMAND_RETRY_INTERVAL);
+				statsConfigRetry ();
+				waitMillis (COMMAND_RETRY_INTERVAL);
 			}
-		} while (!ret && millis () - start <= COMMAND_TIMEOUT);
-		delay (MODE_SWITCH_DELAY);
+		} while (!ret && currentMillis () - start <= COMMAND_TIMEOUT);
+		waitMillis (MODE_SWITCH_DELAY);
 
 		return ret;
 	}
@@ -661,12 +2955,14 @@ public:
 		out[3] = enabled ? 0x01 : 0x00;
 		out[4] = locked ? 0x03 : 0x00;
 
-		unsigned long start = millis ();
+		configProfile.analogSticks = enabled;
+		configProfile.analogLocked = locked;
+		haveConfigProfile = true;
+
+		unsigned long start = currentMillis ();
 		byte cnt = 0;
 		do {
-			attention ();
-			byte *in = autoShift (out, 5);
-			noAttention ();
+			byte *in = sendCommand (out, 5);
 
 			/* We can't know if we have successfully enabled analog mode until
 			 * we get out of config mode, so let's just be happy if we get a few
@@ -678,10 +2974,11 @@ public:
 			ret = cnt >= 3;
 
 			if (!ret) {
-				delay (COMMAND_RETRY_INTERVAL);
+				statsConfigRetry ();
+				waitMillis (COMMAND_RETRY_INTERVAL);
 			}
-		} while (!ret && millis () - start <= COMMAND_TIMEOUT);
-		delay (MODE_SWITCH_DELAY);
+		} while (!ret && currentMillis () - start <= COMMAND_TIMEOUT);
+		waitMillis (MODE_SWITCH_DELAY);
 
 		return ret;
 	}
@@ -708,12 +3005,13 @@ public:
 		out[3] = enabled ? 0x00 : 0xff;
 		out[4] = enabled ? 0x01 : 0xff;
 
-		unsigned long start = millis ();
+		memcpy (configProfile.rumbleMap, out + 3, sizeof (configProfile.rumbleMap));
+		haveConfigProfile = true;
+
+		unsigned long start = currentMillis ();
 		byte cnt = 0;
 		do {
-			attention ();
-			byte *in = autoShift (out, 5);
-			noAttention ();
+			byte *in = sendCommand (out, 5);
 
 			/* The real way to check if the command was successful is to wait for ACK. 
 			 *  Currently the library doesn't support the pin, so I will just assume success.
@@ -724,10 +3022,11 @@ public:
 			ret = cnt >= 3;
 
 			if (!ret) {
-				delay (COMMAND_RETRY_INTERVAL);
+				statsConfigRetry ();
+				waitMillis (COMMAND_RETRY_INTERVAL);
 			}
-		} while (!ret && millis () - start <= COMMAND_TIMEOUT);
-		delay (MODE_SWITCH_DELAY);
+		} while (!ret && currentMillis () - start <= COMMAND_TIMEOUT);
+		waitMillis (MODE_SWITCH_DELAY);
 		
 		rumbleEnabled = true;
 		return ret;
@@ -764,22 +3063,45 @@ public:
 	 *         as this can only be checked after Configuration Mode is exited.
 	 */
 	boolean enableAnalogButtons (bool enabled = true) {
+		return selectAnalogButtons (enabled ? PSAB_ALL : 0);
+	}
+
+	/** \brief Enable analog buttons selectively
+	 * 
+	 * Like enableAnalogButtons(), but only the pressures of the given buttons
+	 * are reported, which makes the reply to every poll shorter: every
+	 * pressure takes a byte, on top of the 6 of buttons and sticks, with the
+	 * total rounded up to an even number. That's 18 data bytes (a 21-byte
+	 * frame) with all 12 buttons, down to 8 (an 11-byte frame) with one or
+	 * two. Those that are not reported will always read as released through
+	 * getAnalogButton().
+	 * 
+	 * \code
+	 * psx.selectAnalogButtons (PSAB_BIT (PSAB_CROSS) | PSAB_BIT (PSAB_SQUARE));
+	 * \endcode
+	 * 
+	 * This function will only work if when the controller is in Configuration
+	 * Mode. Use PsxConfigProfile::setAnalogButtons() to do the same through
+	 * configure().
+	 * 
+	 * \param[in] buttons The buttons to report, see
+	 *                    PsxConfigProfile::setAnalogButtons()
+	 * \return true if the command was ackowledged by the controller
+	 */
+	boolean selectAnalogButtons (const PsxAnalogButtons buttons) {
 		boolean ret = false;
-		byte out[sizeof (set_mode)];
+		byte out[sizeof (set_pressures)];
+
+		configProfile.setAnalogButtons (buttons);
+		haveConfigProfile = true;
 
 		memcpy (out, set_pressures, sizeof (set_pressures));
-		if (!enabled) {
-			out[3] = 0x00;
-			out[4] = 0x00;
-			out[5] = 0x00;
-		}
+		memcpy (out + 3, configProfile.pressureMask, sizeof (configProfile.pressureMask));
 
-		unsigned long start = millis ();
+		unsigned long start = currentMillis ();
 		byte cnt = 0;
 		do {
-			attention ();
-			byte *in = autoShift (out, sizeof (set_pressures));
-			noAttention ();
+			byte *in = sendCommand (out, sizeof (set_pressures));
 
 			/* We can't know if we have successfully enabled analog mode until
 			 * we get out of config mode, so let's just be happy if we get a few
@@ -791,10 +3113,15 @@ public:
 			ret = cnt >= 3;
 
 			if (!ret) {
-				delay (COMMAND_RETRY_INTERVAL);
+				statsConfigRetry ();
+				waitMillis (COMMAND_RETRY_INTERVAL);
 			}
-		} while (!ret && millis () - start <= COMMAND_TIMEOUT);
-		delay (MODE_SWITCH_DELAY);
+		} while (!ret && currentMillis () - start <= COMMAND_TIMEOUT);
+		waitMillis (MODE_SWITCH_DELAY);
+
+		if (ret) {
+			setPressureLayout (configProfile.getAnalogButtons ());
+		}
 
 		return ret;
 	}
@@ -814,9 +3141,7 @@ public:
 	PsxControllerType getControllerType () {
 		PsxControllerType ret = PSCTRL_UNKNOWN;
 
-		attention ();
-		byte *in = autoShift (type_read, 3);
-		noAttention ();
+		byte *in = sendCommand (type_read, 3);
 
 		if (in != nullptr) {
 			const byte& controllerType = in[3];
@@ -837,21 +3162,22 @@ public:
 	boolean exitConfigMode () {
 		boolean ret = false;
 
-		unsigned long start = millis ();
+		unsigned long start = currentMillis ();
 		do {
-			attention ();
 			//~ shiftInOut (poll, in, sizeof (poll));
 			//~ shiftInOut (exit_config, in, sizeof (exit_config));
-			byte *in = autoShift (exit_config, 4);
-			noAttention ();
+			byte *in = sendCommand (exit_config, 4);
 
 			ret = in != nullptr && !isConfigReply (in);
 
-			if (!ret) {
-				delay (COMMAND_RETRY_INTERVAL);
+			if (ret) {
+				configStuck = false;
+			} else {
+				statsConfigRetry ();
+				waitMillis (COMMAND_RETRY_INTERVAL);
 			}
-		} while (!ret && millis () - start <= COMMAND_TIMEOUT);
-		delay (MODE_SWITCH_DELAY);
+		} while (!ret && currentMillis () - start <= COMMAND_TIMEOUT);
+		waitMillis (MODE_SWITCH_DELAY);
 
 		return ret;
 	}
@@ -861,376 +3187,722 @@ public:
 	//! \name Polling Functions
 	//! @{
 
-	/** \brief Retrieve the controller protocol
-	 * 
-	 * This function retrieves the protocol that was used to interpret
-	 * controller data at the last call to read().
+	/** \brief Poll the controller
+	 * 
+	 * This function polls the controller for button and stick data. It self-
+	 * adapts to all the supported controller types and populates internal
+	 * variables with the retrieved information, which can be later accessed
+	 * through the inspection functions.
+	 * 
+	 * This function must be called quite often in order to keep the controller
+	 * alive. Most controllers have some kind of watchdog that will reset them
+	 * if they don't get polled at least every so often (like a couple dozen
+	 * times per seconds).
+	 * 
+	 * If this function fails repeatedly, it can safely be assumed that the
+	 * controller has been disconnected (or that it is not supported if it
+	 * failed right from the beginning).
+	 * 
+	 * If the controller is found in Configuration Mode, this calls
+	 * exitConfigMode(), which blocks for a while, unless that was disabled
+	 * through setConfigRecovery().
+	 * 
+	 * Classes that talk to several controllers override this to poll the
+	 * current one, see PsxBus.
+	 * 
+	 * \return true if the read was successful, false otherwise
+	 */
+	virtual boolean read () {
+		boolean ret = false;
+
+		beginState ();
+
+		statsPollBegin ();
+		updateRumble ();
+		attention ();
+		byte out[sizeof (poll)];
+		byte *in = autoShift (out, makePollCommand (out));
+		noAttention ();
+		statsPollEnd ();
+		recordFrame (out, in);
+
+		if (in != NULL) {
+			if (isConfigReply (in)) {
+				// We're stuck in config mode, try to get out
+				configReplyReceived ();
+			} else {
+				decodePollReply (in);
+				queueButtonEvents ();
+				clockSuccess ();
+				configStuck = false;
+				ret = true;
+			}
+		} else {
+			clockFallback ();
+		}
+
+		publishState ();
+
+		return ret;
+	}
+
+	/** \brief Enable or disable recovery from Configuration Mode in read()
+	 * 
+	 * Controllers sometimes get stuck in Configuration Mode, i.e.: after being
+	 * reset halfway through a configuration sequence. read() normally calls
+	 * exitConfigMode() when this happens, which can take hundreds of
+	 * milliseconds. When recovery is disabled, read() just fails and
+	 * isConfigStuck() returns true, so that recoverConfig() can be called when
+	 * it's convenient, i.e.: not from an interrupt handler.
+	 * 
+	 * \param[in] enabled true to let read() call exitConfigMode() (default)
+	 */
+	void setConfigRecovery (const boolean enabled) {
+		configRecovery = enabled;
+	}
+
+	/** \brief Check if the controller was left in Configuration Mode
+	 * 
+	 * \return true if read() found the controller in Configuration Mode while
+	 *         recovery was disabled, until recoverConfig() or a later read()
+	 *         succeeds
+	 */
+	boolean isConfigStuck () const {
+		return configStuck;
+	}
+
+	/** \brief Get the controller out of Configuration Mode
+	 * 
+	 * This is what read() does by itself unless setConfigRecovery() was used
+	 * to disable it. It blocks for a while.
+	 * 
+	 * \return true if the controller is out of Configuration Mode
+	 */
+	virtual boolean recoverConfig () {
+		return exitConfigMode ();
+	}
+
+	//! @}		// Polling Functions
+
+	//! \name Non-Blocking Polling Functions
+	//! @{
+
+	/** \brief Start polling the controller without blocking
+	 * 
+	 * read() keeps the CPU busy for the whole time it takes to exchange data
+	 * with the controller, most of which is spent waiting for the various
+	 * delays the protocol requires. This function starts a poll that will
+	 * instead be carried out incrementally by repeated calls to tick(), each of
+	 * which only does a little bit of work and returns immediately.
+	 * 
+	 * When pollComplete() returns true, the poll is over and all the inspection
+	 * functions will report exactly what they would after a call to read(),
+	 * whose return value is available through pollSucceeded().
+	 * 
+	 * No other function that talks to the controller shall be called while a
+	 * poll is in progress.
+	 * 
+	 * \return true if the poll was started, false if one is already in
+	 *         progress
+	 */
+	boolean beginPoll () {
+		boolean ret = false;
+
+		if ((pollPhase == POLL_IDLE || pollPhase == POLL_DONE) && !isConfiguring ()) {
+			updateRumble ();
+			pollCommandLen = makeNextPollCommand (pollCommand);
+			startTransaction ();
+			ret = true;
+		}
+
+		return ret;
+	}
+
+	/** \brief Advance a non-blocking poll
+	 * 
+	 * This function must be called as often as possible while a poll (or a
+	 * configuration sequence started with beginConfig()) is in progress. Every
+	 * call will either exchange a single byte with the controller or just
+	 * check if the current delay has elapsed, it will never wait.
+	 * 
+	 * When the \a Acknowledge line is connected, the next byte is sent as soon
+	 * as a call finds it pulsed, with #INTER_CMD_BYTE_DELAY as a timeout. The
+	 * pulse only lasts a few microseconds, so it is missed (and the timeout
+	 * applies) unless this is called often enough.
+	 * 
+	 * \return true if the poll (or configuration sequence) is complete, false
+	 *         otherwise
+	 */
+	boolean tick () {
+		unsigned long now = currentMicros ();
+
+		switch (pollPhase) {
+			case POLL_ATTENTION:
+				if (now - pollPhaseStart >= ATTN_DELAY) {
+					shiftNextPollByte ();
+				}
+				break;
+			case POLL_BYTE_DELAY: {
+				boolean more = pollPos < 3 || pollPos < pollReplyLen;
+				if (now - pollPhaseStart >= INTER_CMD_BYTE_DELAY || checkAck (!more)) {
+					if (more) {
+						shiftNextPollByte ();
+					} else {
+						releaseAttention ();
+						pollPhaseStart = currentMicros ();
+						pollPhase = POLL_NO_ATTENTION;
+					}
+				}
+				break;
+			}
+			case POLL_NO_ATTENTION:
+				if (now - pollPhaseStart >= ATTN_DELAY) {
+					finishPoll ();
+				}
+				break;
+			default:
+				// Nothing to do
+				break;
+		}
+
+		if (pollPhase == POLL_DONE && isConfiguring ()) {
+			// Send the command for the next step, possibly after a while
+			if (!configRetrying || currentMillis () - configLastAttempt >= COMMAND_RETRY_INTERVAL) {
+				pollCommandLen = makeConfigCommand (pollCommand);
+				startTransaction ();
+			}
+		}
+
+		return pollPhase == POLL_DONE && !isConfiguring ();
+	}
+
+	/** \brief Check if a non-blocking poll is complete
+	 * 
+	 * \return true if the poll started with beginPoll() is over, false if it
+	 *         is still in progress or if no poll was ever started
+	 */
+	boolean pollComplete () const {
+		return pollPhase == POLL_DONE;
+	}
+
+	/** \brief Check if the last non-blocking poll was successful
+	 * 
+	 * \return What read() would have returned, only meaningful when
+	 *         pollComplete() is true
+	 */
+	boolean pollSucceeded () const {
+		return pollResult;
+	}
+
+	//! @}		// Non-Blocking Polling Functions
+
+	//! \name Configuration Sequencer Functions
+	//! @{
+
+	/** \brief Start configuring the controller without blocking
+	 * 
+	 * This applies a whole configuration profile: it enters Configuration
+	 * Mode, sets analog sticks, analog buttons and rumble as requested and
+	 * gets out of Configuration Mode. It is carried out by repeated calls to
+	 * tick(), just like a non-blocking poll.
+	 * 
+	 * Unlike the single Configuration Mode functions, this does not wait for
+	 * #MODE_SWITCH_DELAY after every step: each command is sent again until
+	 * the mode byte in the reply shows it was taken, then the sequence moves
+	 * on right away, so that the whole process usually takes a few tens of
+	 * milliseconds rather than seconds. The sequence only completes
+	 * successfully once the controller reports the requested mode outside of
+	 * Configuration Mode. If any step does not succeed within
+	 * #COMMAND_TIMEOUT, the sequence fails.
+	 * 
+	 * No other function that talks to the controller shall be called while
+	 * the sequence is in progress.
+	 * 
+	 * \param[in] profile The configuration to apply
+	 * \return true if the sequence was started, false if a poll or another
+	 *         sequence is already in progress
+	 */
+	boolean beginConfig (const PsxConfigProfile& profile) {
+		boolean ret = false;
+
+		if ((pollPhase == POLL_IDLE || pollPhase == POLL_DONE) && !isConfiguring ()) {
+			configProfile = profile;
+			haveConfigProfile = true;
+			configStep = CONFIG_ENTER;
+			configStepStart = currentMillis ();
+			configRetrying = false;
+			pollExitingConfig = false;
+
+			pollCommandLen = makeConfigCommand (pollCommand);
+			startTransaction ();
+			ret = true;
+		}
+
+		return ret;
+	}
+
+	/** \brief Check if a configuration sequence is complete
 	 * 
-	 * \return The controller protocol
+	 * \return true if the sequence started with beginConfig() is over, false
+	 *         if it is still in progress or if none was ever started
 	 */
-	PsxControllerProtocol getProtocol () const {
-		return protocol;
+	boolean configComplete () const {
+		return configStep == CONFIG_DONE || configStep == CONFIG_FAILED;
 	}
 
-	/** \brief Poll the controller
-	 * 
-	 * This function polls the controller for button and stick data. It self-
-	 * adapts to all the supported controller types and populates internal
-	 * variables with the retrieved information, which can be later accessed
-	 * through the inspection functions.
+	/** \brief Check if the last configuration sequence was successful
 	 * 
-	 * This function must be called quite often in order to keep the controller
-	 * alive. Most controllers have some kind of watchdog that will reset them
-	 * if they don't get polled at least every so often (like a couple dozen
-	 * times per seconds).
+	 * \return true if the controller reported the requested mode, only
+	 *         meaningful when configComplete() is true
+	 */
+	boolean configSucceeded () const {
+		return configStep == CONFIG_DONE;
+	}
+
+	/** \brief Configure the controller
 	 * 
-	 * If this function fails repeatedly, it can safely be assumed that the
-	 * controller has been disconnected (or that it is not supported if it
-	 * failed right from the beginning).
+	 * This is the blocking version of beginConfig(), which goes through the
+	 * very same steps. It is still much quicker than calling the single
+	 * Configuration Mode functions.
 	 * 
-	 * \return true if the read was successful, false otherwise
+	 * \param[in] profile The configuration to apply
+	 * \return true if the controller reported the requested mode, false
+	 *         otherwise
 	 */
-	boolean read () {
+	boolean configure (const PsxConfigProfile& profile) {
 		boolean ret = false;
 
-		analogSticksValid = false;
-		analogButtonDataValid = false;
+		if ((pollPhase == POLL_IDLE || pollPhase == POLL_DONE) && !isConfiguring ()) {
+			configProfile = profile;
+			haveConfigProfile = true;
+			configStep = CONFIG_ENTER;
+			configStepStart = currentMillis ();
+			pollExitingConfig = false;
 
-		attention ();
-		byte *in = nullptr;
-		if(rumbleEnabled) {
-			byte out[sizeof (poll)];
-			memcpy(out, poll, sizeof(poll));
-			out[3] = motor1Level;
-			out[4] = motor2Level;
-			in = autoShift (out, sizeof(poll));
-		}
-		else {
-			in = autoShift (poll, 3);
-		}
-		noAttention ();
+			do {
+				byte *in = sendCommand (pollCommand, makeConfigCommand (pollCommand));
 
-		if (in != NULL) {
-			if (isConfigReply (in)) {
-				// We're stuck in config mode, try to get out
-				exitConfigMode ();
-			} else {
-				// We surely have buttons
-				previousButtonWord = buttonWord;
-				buttonWord = ((PsxButtons) in[4] << 8) | in[3];
-
-				// See if we have anything more to read
-				if (isDualShock2Reply (in)) {
-					protocol = PSPROTO_DUALSHOCK2;
-				} else if (isDualShockReply (in)) {
-					protocol = PSPROTO_DUALSHOCK;
-				} else if (isFlightstickReply (in)) {
-					protocol = PSPROTO_FLIGHTSTICK;
-				} else if (isNegconReply (in)) {
-					protocol = PSPROTO_NEGCON;
-				} else if (isJogconReply (in)) {
-					protocol = PSPROTO_JOGCON;
-				} else if (isGunconReply (in)) {
-					protocol = PSPROTO_GUNCON;
-				} else {
-					protocol = PSPROTO_DIGITAL;
+				beginState ();
+				advanceConfig (in);
+				publishState ();
+
+				if (configRetrying && isConfiguring ()) {
+					waitMillis (COMMAND_RETRY_INTERVAL);
 				}
+			} while (isConfiguring ());
 
-				switch (protocol) {
-					case PSPROTO_DUALSHOCK2:
-						// We also have analog button data
-						analogButtonDataValid = true;
-						for (int i = 0; i < PSX_ANALOG_BTN_DATA_SIZE; ++i) {
-							analogButtonData[i] = in[i + 9];
-						}
-						/* Now fall through to DualShock case, the next line
-						 * avoids GCC warning
-						 */
-						/* FALLTHRU */
-					case PSPROTO_GUNCON:
-						/* The Guncon uses the same reply format as DualShocks,
-						 * by just falling through we'll end up with:
-						 * - A (Left side) -> Start
-						 * - B (Right side) -> Cross
-						 * - Trigger -> Circle
-						 * - Low byte of HSYNC -> RX
-						 * - High byte of HSYNC -> RY
-						 * - Low byte of VSYNC -> LX
-						 * - High byte of VSYNC -> LY
-						 */
-					case PSPROTO_DUALSHOCK:
-					case PSPROTO_FLIGHTSTICK:
-						// We have analog stick data
-						analogSticksValid = true;
-						rx = in[5];
-						ry = in[6];
-						lx = in[7];
-						ly = in[8];
-						break;
-					case PSPROTO_NEGCON:
-						// Map the twist axis to X axis of left analog
-						analogSticksValid = true;
-						lx = in[5];
-
-						// Map analog button data to their reasonable counterparts
-						analogButtonDataValid = true;
-						analogButtonData[PSAB_CROSS] = in[6];
-						analogButtonData[PSAB_SQUARE] = in[7];
-						analogButtonData[PSAB_L1] = in[8];
-
-						// Make up "missing" digital data
-						if (analogButtonData[PSAB_SQUARE] >= NEGCON_I_II_BUTTON_THRESHOLD) {
-							buttonWord &= ~PSB_SQUARE;
-						}
-						if (analogButtonData[PSAB_CROSS] >= NEGCON_I_II_BUTTON_THRESHOLD) {
-							buttonWord &= ~PSB_CROSS;
-						}
-						if (analogButtonData[PSAB_L1] >= NEGCON_L_BUTTON_THRESHOLD) {
-							buttonWord &= ~PSB_L1;
-						}
-						break;
-					case PSPROTO_JOGCON:
-						/* Map the wheel X axis of left analog, half a rotation
-						 * per direction: byte 5 has the wheel position, it is
-						 * 0 at startup, then we have 0xFF down to 0x80 for
-						 * left/CCW, and 0x01 up to 0x80 for right/CW
-						 *
-						 * byte 6 is the number of full CW rotations
-						 * byte 7 is 0 if wheel is still, 1 if it is rotating CW
-						 *        and 2 if rotation CCW
-						 * byte 8 seems to stay at 0
-						 *
-						 * We'll want to cap the movement halfway in each
-						 * direction, for ease of use/implementation.
-						 */
-						analogSticksValid = true;
-						if (in[6] < 0x80) {
-							// CW up to half
-							lx = in[5] < 0x80 ? in[5] : (0x80 - 1);
-						} else {
-							// CCW down to half
-							lx = in[5] > 0x80 ? in[5] : (0x80 + 1);
-						}
+			ret = configSucceeded ();
+		}
+
+		return ret;
+	}
+
+	//! @}		// Configuration Sequencer Functions
 
-						// Bring to the usual 0-255 range
-						lx += 0x80;
-						break;
-					default:
-						// We are already done
-						break;
+	//! \name Connection Management Functions
+	//! @{
+
+	/** \brief Poll the controller, handling disconnections and reconnections
+	 * 
+	 * This can be called in place of read() to have the library keep track of
+	 * whether a controller is connected or not:
+	 * - While none is, only a quick presence check is performed, which gives
+	 *   up as soon as the first bytes show that nobody is answering.
+	 * - Once one is, it is polled as usual. It is only considered
+	 *   disconnected after #DISCONNECT_THRESHOLD consecutive failed polls.
+	 * - When a controller is (re)connected, or comes back after a few failed
+	 *   polls in a different mode (i.e.: it was reset by a flaky cable), the
+	 *   last configuration is applied again through configure(). This is the
+	 *   last profile passed to configure() or beginConfig(), or set through
+	 *   setConfigProfile() or the single Configuration Mode functions.
+	 * 
+	 * Note that reapplying the configuration blocks for a few tens of
+	 * milliseconds.
+	 * 
+	 * \return true if fresh controller data is available, false otherwise
+	 */
+	boolean update () {
+		boolean ret = false;
+
+		if (!connected) {
+			if (probe ()) {
+				connected = true;
+				missedPolls = 0;
+				if (clockCalibrated) {
+					// This might be a different controller
+					calibrateClock ();
 				}
-				
-				ret = true;
+				if (haveConfigProfile) {
+					ret = configure (configProfile);
+				}
+				if (!ret) {
+					// Not configured, or configuration failed, just poll
+					ret = read ();
+				}
+			}
+		} else if (read ()) {
+			if (missedPolls > 0 && haveConfigProfile && !isProfileMode (inputBuffer)) {
+				// The controller was reset while we weren't looking
+				configure (configProfile);
 			}
+			missedPolls = 0;
+			ret = true;
+		} else if (++missedPolls >= DISCONNECT_THRESHOLD) {
+			connected = false;
+
+			// Whatever was held is released, as far as we can tell
+			beginState ();
+			PsxState& s = nextState ();
+			s.previousButtonWord = s.buttonWord;
+			s.buttonWord = ~PSB_NONE;
+			queueButtonEvents ();
+
+			// Start over, this also publishes the new state
+			clearData ();
 		}
 
 		return ret;
 	}
 
-	/** \brief Check if any button has changed state
+	/** \brief Check if a controller is connected
 	 * 
-	 * \return true if any button has changed state with regard to the previous
-	 *         call to read(), false otherwise
+	 * \return true if a controller is connected, according to the last call
+	 *         to update() (or begin())
 	 */
-	boolean buttonsChanged () const {
-		return ((previousButtonWord ^ buttonWord) > 0);
+	boolean isConnected () const {
+		return connected;
 	}
 
-	/** \brief Check if a button has changed state
+	/** \brief Set the configuration to be applied on reconnection
 	 * 
-	 * \return true if \a button has changed state with regard to the previous
-	 *         call to read(), false otherwise
+	 * update() will apply this to any controller it finds from now on. It is
+	 * not applied to the currently connected one, use configure() for that.
+	 * Note that begin() forgets it, so call this afterwards.
+	 * 
+	 * \param[in] profile The configuration to apply
 	 */
-	boolean buttonChanged (const PsxButtons button) const {
-		return (((previousButtonWord ^ buttonWord) & button) > 0);
+	void setConfigProfile (const PsxConfigProfile& profile) {
+		configProfile = profile;
+		haveConfigProfile = true;
 	}
 
-	/** \brief Check if a button is currently pressed
-	 * 
-	 * \param[in] button The button to be checked
-	 * \return true if \a button was pressed in last call to read(), false
-	 *         otherwise
-	 */
-	boolean buttonPressed (const PsxButton button) const {
-		return buttonPressed (~buttonWord, button);
+	//! \brief Do not configure controllers on reconnection
+	void clearConfigProfile () {
+		haveConfigProfile = false;
 	}
 
-	/** \brief Check if a button is pressed in a Button Word
+	//! @}		// Connection Management Functions
+
+	//! \name Button Event Functions
+	//! @{
+
+	/** \brief Start reporting button events
 	 * 
-	 * \param[in] buttons The button word to check in
-	 * \param[in] button The button to be checked
-	 * \return true if \a button is pressed in \a buttons, false otherwise
+	 * From now on, every successful poll adds an event to \a queue for each
+	 * button that was pressed or released since the previous poll. This works
+	 * with read(), non-blocking polls and anything built upon them (i.e.:
+	 * PsxPollScheduler). When update() decides that the controller has been
+	 * disconnected, release events are generated for any buttons that were
+	 * held.
+	 * 
+	 * Polls can then run in an interrupt handler, while events are retrieved
+	 * with PsxButtonEventQueue::pop() from the main loop.
+	 * 
+	 * Note that controllers connected through a multitap or a PsxBus are not
+	 * covered.
+	 * 
+	 * \param[in] queue The queue to fill, NULL to stop reporting events
 	 */
-	boolean buttonPressed (const PsxButtons buttons, const PsxButton button) const {
-		return ((buttons & static_cast<const PsxButtons> (button)) > 0);
+	void setEventQueue (PsxButtonEventQueue *queue) {
+		eventQueue = queue;
 	}
 
-	/** \brief Check if a button has just been pressed
-	 * 
-	 * \param[in] button The button to be checked
-	 * \return true if \a button was not pressed in the previous call to read()
-	 *         and is now, false otherwise
-	 */
-	boolean buttonJustPressed (const PsxButton button) const {
-		return (buttonChanged (button) & buttonPressed (button));
+	//! \brief Get the queue button events are added to, NULL if none
+	PsxButtonEventQueue *getEventQueue () const {
+		return eventQueue;
 	}
 
-	/** \brief Check if a button has just been released
+	//! @}		// Button Event Functions
+
+	//! \name Recording Functions
+	//! @{
+
+	/** \brief Start recording polls
 	 * 
-	 * \param[in] button The button to be checked
-	 * \return true if \a button was pressed in the previous call to read() and
-	 *         is not now, false otherwise
+	 * From now on, the raw reply to every poll is passed to \a rec, which
+	 * must have been started with PsxFrameRecorder::begin() already. This
+	 * works with read(), non-blocking polls and anything built upon them.
+	 * 
+	 * To replay a recording with PsxControllerReplay exactly as it went, start
+	 * recording before calling begin(), which polls the controller a few
+	 * times.
+	 * 
+	 * \param[in] rec The recorder, NULL to stop recording
 	 */
-	boolean buttonJustReleased (const PsxButton button) const {
-		return (buttonChanged (button) & ((~previousButtonWord & button) > 0));
+	void setRecorder (PsxFrameRecorder *rec) {
+		recorder = rec;
 	}
 
-	/** \brief Check if NO button is pressed in a Button Word
-	 * 
-	 * \param[in] buttons The button word to check in
-	 * \return true if all buttons in \a buttons are released, false otherwise
-	 */
-	boolean noButtonPressed (const PsxButtons buttons) const {
-		return buttons == PSB_NONE;
+	//! \brief Get the recorder poll replies are passed to, NULL if none
+	PsxFrameRecorder *getRecorder () const {
+		return recorder;
 	}
 
-	/** \brief Check if NO button is currently pressed
+	//! @}		// Recording Functions
+
+	//! \name Rumble Effect Functions
+	//! @{
+
+	/** \brief Drive the rumble motors from a source
 	 * 
-	 * \return true if all buttons were released in the last call to read(),
-	 *         false otherwise
+	 * From now on, the motor levels are taken from \a source right before
+	 * every poll, in place of those set with setRumble(). This works with
+	 * read(), non-blocking polls and anything built upon them. Rumble must
+	 * still be enabled, i.e.: through configure().
+	 * 
+	 * \param[in] source The source, NULL to go back to setRumble()
 	 */
-	boolean noButtonPressed (void) const {
-		return buttonWord == ~PSB_NONE;
+	void setRumbleSource (PsxRumbleSource *source) {
+		rumbleSource = source;
 	}
-	
-	/** \brief Retrieve the <em>Button Word</em>
+
+	//! \brief Get the source of the motor levels, NULL if none
+	PsxRumbleSource *getRumbleSource () const {
+		return rumbleSource;
+	}
+
+	//! @}		// Rumble Effect Functions
+
+	//! \name Clock Speed Functions
+	//! @{
+
+	/** \brief Find the fastest reliable clock speed
 	 * 
-	 * The button word contains the status of all digital buttons and can be
-	 * retrieved so that it can be inspected later.
+	 * Many controllers work fine with a faster clock than the default one,
+	 * which makes every transaction shorter, while some need a slower one.
+	 * This function polls the controller at the default speed, then steps the
+	 * speed up (or down, if the default one does not work) for as long as the
+	 * replies are valid and consistent, and keeps the fastest speed that was
+	 * found to be reliable.
 	 * 
-	 * \sa buttonPressed
-	 * \sa noButtonPressed
+	 * After this has been called, the clock is automatically slowed down
+	 * after a few consecutive polls get garbled replies (see
+	 * #CLOCK_FALLBACK_ERRORS) and sped up again, up to the chosen speed, after
+	 * a long run of good ones (see #CLOCK_RECOVERY_POLLS). Polls nobody
+	 * answers to are not held against the clock. update() also calibrates it
+	 * again whenever a controller is connected.
 	 * 
-	 * \return the Button Word
+	 * The controller must be connected and should not be touched while this
+	 * runs, as replies are compared to each other.
+	 * 
+	 * \return The chosen clock speed level
 	 */
-	PsxButtons getButtonWord () const {
-		return ~buttonWord;
+	byte calibrateClock () {
+		byte ref[5];
+		byte best = getDefaultClockLevel ();
+
+		setClockLevel (best);
+		if (checkClockLevel (ref, false)) {
+			// Go as fast as we can
+			for (byte l = best + 1; l < getClockLevelsNo (); ++l) {
+				setClockLevel (l);
+				if (!checkClockLevel (ref, true)) {
+					break;
+				}
+				best = l;
+			}
+		} else {
+			// Go as slow as we need
+			while (best > 0) {
+				setClockLevel (--best);
+				if (checkClockLevel (ref, false)) {
+					break;
+				}
+			}
+		}
+
+		setClockLevel (best);
+		clockCalibrated = true;
+		calibratedClockLevel = best;
+		clockErrors = 0;
+		clockGoodPolls = 0;
+
+		/* Replies at a speed that is too fast might have been taken for
+		 * something else by the controller, make sure it's still fine
+		 */
+		read ();
+
+		return best;
 	}
 
-	/** \brief Retrieve button pressure depth/strength
+	/** \brief Set the clock speed
 	 * 
-	 * This function will return how deeply/strongly a button is pressed. It
-	 * will only work on DualShock 2 controllers after enabling this feature
-	 * with enableAnalogButtons().
-	 * 
-	 * Note that button pressure depth/strength is only available for the D-Pad
-	 * buttons, []/^/O/X, L1/2 and R1/2.
-	 *
-	 * \param[in] button the button the retrieve the pressure depth/strength of
-	 * \return the pressure depth/strength [0-255, Fully released to fully
-	 *         pressed]
+	 * \param[in] level Clock speed level, 0 being the slowest
+	 * \return true if the level is supported by the interface, false
+	 *         otherwise
 	 */
-	byte getAnalogButton (const PsxAnalogButton button) const {
-		byte ret = 0;
-		
-		if (analogButtonDataValid) {
-			ret = analogButtonData[button];
-		//~ } else if (buttonPressed (button)) {		// FIXME
-			//~ // No analog data, assume fully pressed or fully released
-			//~ ret = 0xFF;
+	boolean setClockLevel (const byte level) {
+		boolean ret = false;
+
+		if (level < getClockLevelsNo ()) {
+			clockLevel = level;
+			applyClockLevel (level);
+			ret = true;
 		}
 
 		return ret;
 	}
 
-	/** \brief Retrieve all analog button data
+	/** \brief Get the current clock speed
+	 * 
+	 * \return The current clock speed level, 0 being the slowest
 	 */
-	const byte* getAnalogButtonData () const {
-		return analogButtonDataValid ? analogButtonData : NULL;
+	byte getClockLevel () const {
+		return clockLevel;
 	}
 
-	/** \brief Retrieve position of the \a left analog stick
-	 * 
-	 * This function will return the absolute position of the left analog stick.
+	//! @}		// Clock Speed Functions
+
+#ifdef PSX_COLLECT_STATS
+	//! \name Statistics Functions
+	//! @{
+
+	/** \brief Retrieve poll statistics
 	 * 
-	 * Note that not all controllers have analog sticks, in which case this
-	 * function will return false.
+	 * These are collected since begin() or the last call to clearStats().
+	 * This is only available when PSX_COLLECT_STATS is defined.
 	 * 
-	 * \param[in] x A variable where the horizontal position will be stored
-	 *              [0-255, L to R]
-	 * \param[in] y A variable where the vertical position will be stored
-	 *              [0-255, U to D]
-	 * \return true if the returned position is valid, false otherwise
+	 * \return The statistics
 	 */
-	boolean getLeftAnalog (byte& x, byte& y) const {
-		x = lx;
-		y = ly;
+	const PsxStats& getStats () const {
+		return stats;
+	}
 
-		return analogSticksValid;
+	//! \brief Clear poll statistics
+	void clearStats () {
+		stats.clear ();
 	}
 
-	/** \brief Retrieve position of the \a right analog stick
+	//! @}		// Statistics Functions
+#endif
+
+#ifdef PSX_TRACE
+	//! \name Trace Functions
+	//! @{
+
+	/** \brief Print the protocol trace
 	 * 
-	 * This function will return the absolute position of the right analog
-	 * stick.
+	 * All the entries recorded since the last call are printed to \a stream
+	 * as hex text and then dropped. This is only available when PSX_TRACE is
+	 * defined.
 	 * 
-	 * Note that not all controllers have analog sticks, in which case this
-	 * function will return false.
+	 * The output can be turned into readable frames with the
+	 * <tt>extras/psxtrace.py</tt> script. Recording is cheap, but printing is
+	 * not, so this should be called when no poll is in progress, i.e.: between
+	 * calls to read(). If more than #PSX_TRACE_SIZE entries were recorded in
+	 * the meantime, the oldest are lost, and their number is printed as well.
 	 * 
-	 * \param[in] x A variable where the horizontal position will be stored
-	 *              [0-255, L to R]
-	 * \param[in] y A variable where the vertical position will be stored
-	 *              [0-255, U to D]
-	 * \return true if the returned position is valid, false otherwise
+	 * \param[in] stream Where the trace shall be printed, i.e.: Serial
 	 */
-	boolean getRightAnalog (byte& x, byte& y) const {
-		x = rx;
-		y = ry;
+	void flushTrace (Stream& stream) {
+		noInterrupts ();
+		word head = traceHead;
+		interrupts ();
+
+		word lost = 0;
+		if (static_cast<word> (head - traceTail) > PSX_TRACE_SIZE) {
+			lost = head - traceTail - PSX_TRACE_SIZE;
+			traceTail = head - PSX_TRACE_SIZE;
+		}
+
+		stream.print (F("PSXTRACE "));
+		stream.println (lost);
+
+		byte n = 0;
+		while (traceTail != head) {
+			const PsxTraceEntry& e = trace[traceTail & (PSX_TRACE_SIZE - 1)];
+			printTraceByte (stream, e.kind);
+			for (byte i = 0; i < sizeof (e.data); ++i) {
+				printTraceByte (stream, e.data[i]);
+			}
+			++traceTail;
 
-		return analogSticksValid;
+			if (++n == 8) {
+				stream.println ();
+				n = 0;
+			} else {
+				stream.print (' ');
+			}
+		}
+		if (n > 0) {
+			stream.println ();
+		}
+
+		stream.println (F("END"));
 	}
 
-	/** \brief Retrieve Guncon X/Y readings
-	 *
-	 * According to the Nocash PSX Specifications, the Guncon returns 16-bit X/Y
-	 * coordinates of the screen it is aimed at.
-	 *
-	 * The coordinates are updated in all frames. The absolute min/max may vary
-	 * from TV set to TV set.
-	 *
-	 * Vertical coordinates are counted in scanlines (ie. equal to pixels).
-	 * Horizontal coordinates are counted in 8MHz units (which would equal a
-	 * resolution of 385 pixels; which can be, for example, converted to 320
-	 * pixel resolution as X=X*320/385).
-	 *
-	 * <em>Caution:</em> The gun only returns meaningful data when read shortly
-	 * after begin of VBLANK (ie. AFTER rendering, but still BEFORE vsync), so
-	 * make sure to only consider readings returning \a GUNCON_OK;
-	 *
-	 * \sa GunconStatus
-	 */
-	GunconStatus getGunconCoordinates (word& x, word& y) const {
-		GunconStatus status = GUNCON_OTHER_ERROR;
+	//! @}		// Trace Functions
 
-		if (protocol == PSPROTO_GUNCON && analogSticksValid) {
-			status = GUNCON_OK;
-			
-			x = (((word) ry) << 8) | rx;
-			y = (((word) ly) << 8) | lx;
+private:
+	//! \brief Print a byte as two hex digits
+	static void printTraceByte (Stream& stream, const byte b) {
+		if (b < 0x10) {
+			stream.print ('0');
+		}
+		stream.print (b, HEX);
+	}
+#endif
 
-			if (x == 0x0001) {
-				if (y == 0x0005) {
-					status = GUNCON_UNEXPECTED_LIGHT;
-				} else if (y == 0x000A) {
-					status = GUNCON_NO_LIGHT;
-				}
+};
+
+/** \brief Statically-Dispatched PSX Controller Base
+ *
+ * PsxController calls the transport functions (shiftInOut(const byte),
+ * waitAck(), etc.) through the vtable, which keeps the compiler from inlining
+ * them: every byte of a frame then costs a couple of indirect calls, and
+ * whatever is known at compile time about the pins can't be exploited across
+ * them.
+ *
+ * Transports that derive from this instead, passing themselves as \a T (the
+ * Curiously Recurring Template Pattern), get a frame transfer loop that calls
+ * their own functions directly: the whole loop, byte exchanges and
+ * \a Acknowledge waits included, becomes a single function with no indirect
+ * calls. Everything else is unchanged and they still are PsxControllers, so
+ * they can be used anywhere a PsxController is expected.
+ *
+ * \code
+ * template <...>
+ * class MyTransport: public PsxControllerStatic<MyTransport<...> > {
+ *     friend class PsxControllerStatic<MyTransport<...> >;
+ *
+ * protected:
+ *     virtual byte shiftInOut (const byte out) override { ... }
+ *     ...
+ * };
+ * \endcode
+ *
+ * The friend declaration is needed so that this can call the protected
+ * functions of \a T. Note that classes further derived from \a T shall not
+ * override shiftInOut(const byte) or waitAck(), as their overrides would be
+ * bypassed by the loop.
+ *
+ * \tparam T The transport class deriving from this
+ */
+template <typename T>
+class PsxControllerStatic: public PsxController {
+protected:
+	virtual void transferBytes (const byte *out, byte *in, const byte len, const boolean endOfReply) override {
+		T& self = static_cast<T&> (*this);
+
+		for (byte i = 0; i < len; ++i) {
+			byte tmp = self.T::shiftInOut (out != NULL ? out[i] : 0x5A);
+			if (in != NULL) {
+				in[i] = tmp;
 			}
-		}
 
-		return status;
+			self.T::waitAck (endOfReply && i == len - 1);
+		}
 	}
-	
-	//! @}		// Polling Functions
 };
 
 #endif
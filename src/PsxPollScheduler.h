@@ -0,0 +1,424 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file PsxPollScheduler.h
+ * \brief Fixed-rate controller polling
+ *
+ * Note that this file defines the Timer 1 interrupt handler on AVR, so it must
+ * only be included in a single source file. Define PSX_SCHEDULER_NO_ISR before
+ * including it in any others.
+ */
+
+#ifndef PSXPOLLSCHEDULER_H_
+#define PSXPOLLSCHEDULER_H_
+
+#include "PsxNewLib.h"
+
+//! \brief Shortest supported polling period (us)
+const unsigned long PSX_SCHEDULER_MIN_PERIOD = 1000;
+
+/** \brief Longest supported polling period (us)
+ *
+ * Controllers need to be polled more often than this anyway, and it still fits
+ * Timer 1 at its largest prescaler with any clock up to 64 MHz.
+ */
+const unsigned long PSX_SCHEDULER_MAX_PERIOD = 1000000UL;
+
+/** \brief Fixed-Rate Poll Scheduler
+ *
+ * This polls a controller at a fixed rate, up to 1 kHz, independently of
+ * what the main loop is doing. onTimer() must be called periodically, usually
+ * from a timer interrupt: PsxSchedulerTimer1 takes care of that on AVR
+ * boards. On other boards, or if no timer is available, run() can be called
+ * as often as possible from loop() instead, which is less precise.
+ *
+ * The main loop can retrieve the data of the newest poll at any time with
+ * getLatest(), as a PsxState copied from PsxController::getState(). While the
+ * scheduler is running, the controller object must not be used directly.
+ *
+ * onTimer() only calls PsxController::read(), which is the only function of
+ * the controller that is safe to call from an interrupt handler. Even then,
+ * read() would block for hundreds of milliseconds to get the controller out
+ * of Configuration Mode if it found it stuck there: the scheduler disables
+ * that (see PsxController::setConfigRecovery()) and leaves it to service(),
+ * which must be called from loop(). For the same reason, no
+ * PsxFrameRecorder writing to a Stream that can block (i.e.: Serial) shall be
+ * attached to the controller.
+ *
+ * Note that a poll must take less than the polling period, which usually
+ * means using the \a Acknowledge line and/or calibrateClock() to go beyond a
+ * few hundred Hz.
+ *
+ * The scheduler also keeps track of:
+ * - The actual polling period, which tells how much jitter there is.
+ * - Overruns, i.e.: polls that could not start on time because the previous
+ *   one had not finished yet.
+ * - The time between a poll completing and its data being retrieved by the
+ *   main loop.
+ */
+class PsxPollScheduler {
+protected:
+	PsxController& controller;
+
+	//! \brief Nominal polling period (us)
+	unsigned long period;
+
+	//! \brief True while onTimer() is polling
+	volatile boolean busy;
+
+	//! \brief True while service() is using the controller
+	volatile boolean recovering;
+
+	//! \brief Last poll found the controller stuck in Configuration Mode
+	volatile boolean configStuck;
+
+	//! \name Latest Sample
+	//! @{
+	volatile boolean sampleValid;		//!< Last poll succeeded
+	volatile unsigned long sampleTime;	//!< Time last poll completed (us)
+	volatile unsigned long sampleSeq;	//!< Number of polls so far
+	unsigned long consumedSeq;			//!< #sampleSeq at last getLatest()
+	//! @}
+
+	//! \name Statistics
+	//! @{
+	unsigned long lastStart;			//!< Time last poll started (us), 0 if none
+	volatile unsigned long periodMin;	//!< Shortest actual period (us)
+	volatile unsigned long periodMax;	//!< Longest actual period (us)
+	volatile word overruns;				//!< Polls skipped or delayed
+	unsigned long latencyMax;			//!< Longest poll-to-consumer latency (us)
+	unsigned long latencySum;			//!< Sum of poll-to-consumer latencies (us)
+	word latencyCount;					//!< Number of latencies in #latencySum
+	//! @}
+
+public:
+	/** \brief Constructor
+	 *
+	 * \param[in] ctrl The controller to poll, it must have been initialized
+	 *                 with begin() already
+	 * \param[in] us Polling period (us), it is clamped to
+	 *               [#PSX_SCHEDULER_MIN_PERIOD ... #PSX_SCHEDULER_MAX_PERIOD]
+	 */
+	PsxPollScheduler (PsxController& ctrl, const unsigned long us): controller (ctrl),
+	                  period (us < PSX_SCHEDULER_MIN_PERIOD ? PSX_SCHEDULER_MIN_PERIOD :
+	                          (us > PSX_SCHEDULER_MAX_PERIOD ? PSX_SCHEDULER_MAX_PERIOD : us)),
+	                  busy (false), recovering (false), configStuck (false), sampleValid (false),
+	                  sampleTime (0), sampleSeq (0), consumedSeq (0) {
+		resetStats ();
+	}
+
+	//! \brief Get the polling period (us)
+	unsigned long getPeriod () const {
+		return period;
+	}
+
+	/** \brief Poll the controller
+	 *
+	 * This must be called every polling period, usually from a timer
+	 * interrupt. On AVR, it is safe to have other interrupts enabled while
+	 * this runs, and it's actually recommended, as a poll can take a while.
+	 */
+	void onTimer () {
+		if (busy || recovering) {
+			// Previous poll is still running or service() has the controller
+			++overruns;
+			return;
+		}
+		busy = true;
+
+		unsigned long start = micros ();
+		if (lastStart != 0) {
+			unsigned long actual = start - lastStart;
+			if (actual < periodMin) {
+				periodMin = actual;
+			}
+			if (actual > periodMax) {
+				periodMax = actual;
+			}
+			if (actual >= 2 * period) {
+				// Missed at least a full period
+				++overruns;
+			}
+		}
+		lastStart = start;
+
+		controller.setConfigRecovery (false);
+		boolean ok = controller.read ();
+		configStuck = controller.isConfigStuck ();
+
+		noInterrupts ();
+		sampleValid = ok;
+		sampleTime = micros ();
+		++sampleSeq;
+		interrupts ();
+
+		busy = false;
+	}
+
+	/** \brief Do what onTimer() cannot do from an interrupt handler
+	 *
+	 * This must be called often from loop(). When the latest poll found the
+	 * controller stuck in Configuration Mode, it gets it out of there, which
+	 * blocks for a while, during which no polls take place.
+	 *
+	 * \return true if the controller needed to be recovered
+	 */
+	boolean service () {
+		boolean ret = configStuck;
+
+		if (ret) {
+			// onTimer() can only interrupt us, so it won't be polling now
+			recovering = true;
+			controller.recoverConfig ();
+			configStuck = false;
+			recovering = false;
+		}
+
+		return ret;
+	}
+
+	/** \brief Poll the controller, if it's time
+	 *
+	 * This can be called from loop() in place of having onTimer() called from
+	 * a timer interrupt. The rate will only be as steady as loop() is. It also
+	 * takes care of service().
+	 *
+	 * \return true if the controller was polled
+	 */
+	boolean run () {
+		boolean ret = false;
+
+		service ();
+
+		if (lastStart == 0 || micros () - lastStart >= period) {
+			onTimer ();
+			ret = true;
+		}
+
+		return ret;
+	}
+
+	/** \brief Retrieve the data of the latest poll
+	 *
+	 * \param[out] state Where the data will be copied
+	 * \return true if this is a new sample, i.e.: the controller was polled
+	 *         since the last call, false otherwise
+	 */
+	boolean getLatest (PsxState& state) {
+		noInterrupts ();
+		state = controller.getState ();
+		unsigned long seq = sampleSeq;
+		unsigned long t = sampleTime;
+		interrupts ();
+
+		boolean ret = seq != consumedSeq;
+		if (ret) {
+			unsigned long latency = micros () - t;
+			if (latency > latencyMax) {
+				latencyMax = latency;
+			}
+			if (latencyCount < 0xFFFF) {
+				latencySum += latency;
+				++latencyCount;
+			}
+			consumedSeq = seq;
+		}
+
+		return ret;
+	}
+
+	/** \brief Check if the latest poll was successful
+	 *
+	 * \return What read() returned at the latest poll
+	 */
+	boolean isLatestValid () const {
+		return sampleValid;
+	}
+
+	/** \brief Get the number of polls so far
+	 *
+	 * \return The sequence number of the latest sample
+	 */
+	unsigned long getSequence () const {
+		noInterrupts ();
+		unsigned long ret = sampleSeq;
+		interrupts ();
+
+		return ret;
+	}
+
+	//! \name Statistics Functions
+	//! @{
+
+	/** \brief Get the shortest and longest actual polling periods
+	 *
+	 * Their difference from the nominal period is the jitter.
+	 *
+	 * \param[out] pmin Shortest period (us)
+	 * \param[out] pmax Longest period (us)
+	 */
+	void getPeriodRange (unsigned long& pmin, unsigned long& pmax) const {
+		noInterrupts ();
+		pmin = periodMin;
+		pmax = periodMax;
+		interrupts ();
+	}
+
+	/** \brief Get the worst jitter
+	 *
+	 * \return The largest difference between the actual and nominal polling
+	 *         periods (us)
+	 */
+	unsigned long getMaxJitter () const {
+		unsigned long pmin, pmax;
+		getPeriodRange (pmin, pmax);
+
+		unsigned long ret = 0;
+		if (pmax >= pmin) {
+			unsigned long early = pmin < period ? period - pmin : 0;
+			unsigned long late = pmax > period ? pmax - period : 0;
+			ret = early > late ? early : late;
+		}
+
+		return ret;
+	}
+
+	/** \brief Get the number of overruns
+	 *
+	 * \return The number of times a poll could not start on time
+	 */
+	word getOverruns () const {
+		noInterrupts ();
+		word ret = overruns;
+		interrupts ();
+
+		return ret;
+	}
+
+	//! \brief Get the longest time between a poll and getLatest() (us)
+	unsigned long getMaxLatency () const {
+		return latencyMax;
+	}
+
+	//! \brief Get the average time between a poll and getLatest() (us)
+	unsigned long getAverageLatency () const {
+		return latencyCount > 0 ? latencySum / latencyCount : 0;
+	}
+
+	//! \brief Reset all statistics
+	void resetStats () {
+		noInterrupts ();
+		lastStart = 0;
+		periodMin = 0xFFFFFFFFUL;
+		periodMax = 0;
+		overruns = 0;
+		interrupts ();
+
+		latencyMax = 0;
+		latencySum = 0;
+		latencyCount = 0;
+	}
+
+	//! @}
+};
+
+#if defined (__AVR__)
+
+/** \brief Timer 1 Driver for PsxPollScheduler
+ *
+ * This calls PsxPollScheduler::onTimer() from the Timer 1 Compare Match A
+ * interrupt. Timer 1 is then no longer available to other libraries, i.e.:
+ * Servo won't work.
+ */
+class PsxSchedulerTimer1 {
+public:
+	/** \brief Scheduler the interrupt is forwarded to
+	 *
+	 * \return A reference to the pointer to the scheduler, which is NULL when
+	 *         the timer is not running
+	 */
+	static PsxPollScheduler*& current () {
+		static PsxPollScheduler *scheduler = NULL;
+		return scheduler;
+	}
+
+	/** \brief Start polling
+	 *
+	 * The smallest prescaler the polling period fits with is used, for the
+	 * best accuracy.
+	 *
+	 * \param[in] sched The scheduler to run
+	 */
+	static void begin (PsxPollScheduler& sched) {
+		static const word dividers[] = {8, 64, 256, 1024};
+		static const byte prescalers[] = {
+			_BV (CS11),
+			_BV (CS11) | _BV (CS10),
+			_BV (CS12),
+			_BV (CS12) | _BV (CS10)
+		};
+
+		unsigned long cycles = (F_CPU / 1000000UL) * sched.getPeriod ();
+		byte i = 0;
+		while (i < sizeof (prescalers) - 1 && cycles / dividers[i] > 0x10000UL) {
+			++i;
+		}
+
+		unsigned long ticks = cycles / dividers[i];
+		if (ticks > 0x10000UL) {
+			// Can't go any slower
+			ticks = 0x10000UL;
+		}
+		byte prescaler = prescalers[i];
+
+		noInterrupts ();
+		current () = &sched;
+		TCCR1A = 0;
+		TCCR1B = _BV (WGM12);						// CTC mode, stopped
+		TCNT1 = 0;
+		OCR1A = ticks - 1;
+		TIFR1 = _BV (OCF1A);
+		TIMSK1 |= _BV (OCIE1A);
+		TCCR1B = _BV (WGM12) | prescaler;
+		interrupts ();
+	}
+
+	//! \brief Stop polling
+	static void end () {
+		noInterrupts ();
+		TCCR1B = 0;
+		TIMSK1 &= ~_BV (OCIE1A);
+		current () = NULL;
+		interrupts ();
+	}
+};
+
+#ifndef PSX_SCHEDULER_NO_ISR
+// Polls take a while, let other interrupts (i.e.: millis()) through
+ISR (TIMER1_COMPA_vect, ISR_NOBLOCK) {
+	PsxPollScheduler *scheduler = PsxSchedulerTimer1::current ();
+	if (scheduler != NULL) {
+		scheduler->onTimer ();
+	}
+}
+#endif
+
+#endif
+
+#endif
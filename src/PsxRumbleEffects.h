@@ -0,0 +1,313 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file PsxRumbleEffects.h
+ * \brief Timed rumble effects
+ */
+
+#ifndef PSXRUMBLEEFFECTS_H_
+#define PSXRUMBLEEFFECTS_H_
+
+#include "PsxNewLib.h"
+
+//! \brief Time unit of effect steps (ms)
+const byte PSX_RUMBLE_TICK = 10;
+
+/** \brief Fade flag
+ *
+ * When ORed into PsxRumbleStep::duration, the large motor goes gradually from
+ * its level at the end of the previous step to that of this step, rather than
+ * jumping to it.
+ */
+const byte PSX_RUMBLE_FADE = 0x80;
+
+//! \brief Returned by PsxRumbleEngine::play() when an effect cannot be played
+const int8_t PSX_RUMBLE_NONE = -1;
+
+/** \brief Rumble Effect Step
+ *
+ * Effects are arrays of these, stored in flash with PROGMEM and terminated by
+ * a step with a \a duration of 0, i.e.:
+ *
+ * \code
+ * static const PsxRumbleStep MY_EFFECT[] PROGMEM = {
+ *     {20, 0xFF, 0x80},						// 200 ms, both motors
+ *     {PSX_RUMBLE_FADE | 30, 0x00, 0x00},		// Large motor fading out
+ *     {0, 0x00, 0x00}
+ * };
+ * \endcode
+ */
+struct PsxRumbleStep {
+	//! \brief Duration, in units of #PSX_RUMBLE_TICK [1 ... 127], may be ORed with #PSX_RUMBLE_FADE
+	byte duration;
+
+	//! \brief Small motor, 0x00 for off or 0xFF for on
+	byte motor1;
+
+	//! \brief Large motor power, reached at the end of the step if fading
+	byte motor2;
+};
+
+//! \brief A short, sharp buzz of both motors
+static const PsxRumbleStep PSX_RUMBLE_PULSE[] PROGMEM = {
+	{10, 0xFF, 0xFF},
+	{0, 0x00, 0x00}
+};
+
+//! \brief The large motor ramping up and back down
+static const PsxRumbleStep PSX_RUMBLE_RAMP[] PROGMEM = {
+	{PSX_RUMBLE_FADE | 50, 0x00, 0xFF},
+	{PSX_RUMBLE_FADE | 50, 0x00, 0x00},
+	{0, 0x00, 0x00}
+};
+
+//! \brief Two beats and a pause, best played repeatedly
+static const PsxRumbleStep PSX_RUMBLE_HEARTBEAT[] PROGMEM = {
+	{8, 0x00, 0xC0},
+	{10, 0x00, 0x00},
+	{8, 0x00, 0xFF},
+	{60, 0x00, 0x00},
+	{0, 0x00, 0x00}
+};
+
+//! \brief A hit with both motors, then the large one dying down
+static const PsxRumbleStep PSX_RUMBLE_IMPACT[] PROGMEM = {
+	{6, 0xFF, 0xFF},
+	{PSX_RUMBLE_FADE | 40, 0x00, 0x00},
+	{0, 0x00, 0x00}
+};
+
+/** \brief Rumble Effect Engine
+ *
+ * This plays rumble effects described by PsxRumbleStep tables, without ever
+ * blocking: once attached with PsxController::setRumbleSource(), it works out
+ * the motor levels right before every poll, which then carries them to the
+ * controller.
+ *
+ * \code
+ * PsxRumbleEngine<> rumble;
+ *
+ * psx.setRumbleSource (&rumble);
+ * // ...
+ * rumble.play (PSX_RUMBLE_IMPACT, 2);
+ * \endcode
+ *
+ * Several effects can play at the same time, each on its own layer with a
+ * priority: the motors follow the one with the highest priority (the newest,
+ * among those with the same one), while the others keep playing underneath
+ * and take over if it ends first.
+ *
+ * Effects can be started and stopped from loop() even if polls run in an
+ * interrupt handler, i.e.: through PsxPollScheduler.
+ *
+ * \tparam LAYERS Number of effects that can play at the same time
+ */
+template <byte LAYERS = 4>
+class PsxRumbleEngine: public PsxRumbleSource {
+	static_assert (LAYERS > 0 && LAYERS <= 127, "Layers must be 1 to 127");
+
+protected:
+	//! \brief A playing effect
+	struct Layer {
+		const PsxRumbleStep *effect;	//!< Steps, in flash, NULL if free
+		unsigned long stepStart;		//!< Time current step started (ms)
+		word serial;					//!< Order the effect was started in
+		byte step;						//!< Index of current step
+		byte priority;
+		byte repeats;					//!< Times left to play, 0 for ever
+		byte from;						//!< Large motor level at step start
+		boolean started;				//!< #stepStart is valid
+	};
+
+	Layer layers[LAYERS];
+
+	//! \brief Serial number of the next effect
+	word nextSerial;
+
+	//! \brief Check if \a a shall be heard over \a b
+	static boolean louder (const Layer& a, const Layer& b) {
+		return a.priority > b.priority || (a.priority == b.priority && static_cast<int16_t> (a.serial - b.serial) > 0);
+	}
+
+	/** \brief Move a layer to the step it is at
+	 *
+	 * \return false if the effect is over
+	 */
+	static boolean seek (Layer& l, const unsigned long ms) {
+		boolean ret = true;
+
+		if (!l.started) {
+			l.stepStart = ms;
+			l.started = true;
+		}
+
+		while (ret) {
+			byte duration = pgm_read_byte (&l.effect[l.step].duration) & ~PSX_RUMBLE_FADE;
+			if (duration == 0) {
+				// End of effect, go round again if needed
+				if (l.step == 0 || l.repeats == 1) {
+					ret = false;
+				} else {
+					if (l.repeats > 1) {
+						--l.repeats;
+					}
+					l.step = 0;
+					l.from = 0x00;
+				}
+			} else {
+				word length = static_cast<word> (duration) * PSX_RUMBLE_TICK;
+				if (ms - l.stepStart < length) {
+					break;
+				}
+				l.from = pgm_read_byte (&l.effect[l.step].motor2);
+				l.stepStart += length;
+				++l.step;
+			}
+		}
+
+		return ret;
+	}
+
+public:
+	PsxRumbleEngine (): nextSerial (0) {
+		for (byte i = 0; i < LAYERS; ++i) {
+			layers[i].effect = NULL;
+		}
+	}
+
+	/** \brief Start playing an effect
+	 *
+	 * If all layers are busy, the effect replaces the oldest of those with the
+	 * lowest priority, as long as that is not higher than its own.
+	 *
+	 * \param[in] effect The steps of the effect, stored with PROGMEM
+	 * \param[in] priority Effects with higher priorities are heard over the
+	 *                     others
+	 * \param[in] repeats Number of times to play the effect, 0 for ever
+	 * \return A handle that can be passed to stop(), or #PSX_RUMBLE_NONE if
+	 *         the effect could not be started
+	 */
+	int8_t play (const PsxRumbleStep *effect, const byte priority = 0, const byte repeats = 1) {
+		int8_t ret = PSX_RUMBLE_NONE;
+
+		noInterrupts ();
+		for (byte i = 0; i < LAYERS; ++i) {
+			Layer& l = layers[i];
+			if (l.effect == NULL) {
+				ret = i;
+				break;
+			} else if (l.priority <= priority && (ret == PSX_RUMBLE_NONE || louder (layers[ret], l))) {
+				ret = i;
+			}
+		}
+
+		if (effect != NULL && ret != PSX_RUMBLE_NONE) {
+			Layer& l = layers[ret];
+			l.effect = effect;
+			l.serial = nextSerial++;
+			l.step = 0;
+			l.priority = priority;
+			l.repeats = repeats;
+			l.from = 0x00;
+			l.started = false;
+		} else {
+			ret = PSX_RUMBLE_NONE;
+		}
+		interrupts ();
+
+		return ret;
+	}
+
+	/** \brief Stop an effect
+	 *
+	 * \param[in] handle What play() returned when the effect was started
+	 */
+	void stop (const int8_t handle) {
+		if (handle >= 0 && handle < LAYERS) {
+			noInterrupts ();
+			layers[handle].effect = NULL;
+			interrupts ();
+		}
+	}
+
+	//! \brief Stop all effects
+	void stopAll () {
+		noInterrupts ();
+		for (byte i = 0; i < LAYERS; ++i) {
+			layers[i].effect = NULL;
+		}
+		interrupts ();
+	}
+
+	/** \brief Check if an effect is still playing
+	 *
+	 * Note that handles are reused, so this is only meaningful for the last
+	 * effect started with it.
+	 *
+	 * \param[in] handle What play() returned when the effect was started
+	 * \return true if it is playing, false if it ended or was stopped
+	 */
+	boolean isPlaying (const int8_t handle) const {
+		return handle >= 0 && handle < LAYERS && layers[handle].effect != NULL;
+	}
+
+	//! \brief Check if any effect is playing
+	boolean isPlaying () const {
+		boolean ret = false;
+
+		for (byte i = 0; i < LAYERS && !ret; ++i) {
+			ret = layers[i].effect != NULL;
+		}
+
+		return ret;
+	}
+
+	virtual void getRumble (const unsigned long ms, byte& motor1, byte& motor2) override {
+		const Layer *top = NULL;
+
+		for (byte i = 0; i < LAYERS; ++i) {
+			Layer& l = layers[i];
+			if (l.effect != NULL) {
+				if (!seek (l, ms)) {
+					l.effect = NULL;
+				} else if (top == NULL || louder (l, *top)) {
+					top = &l;
+				}
+			}
+		}
+
+		motor1 = 0x00;
+		motor2 = 0x00;
+		if (top != NULL) {
+			const PsxRumbleStep *step = &top->effect[top->step];
+			byte duration = pgm_read_byte (&step->duration);
+			motor1 = pgm_read_byte (&step->motor1);
+			motor2 = pgm_read_byte (&step->motor2);
+
+			if ((duration & PSX_RUMBLE_FADE) != 0) {
+				// Linear ramp from the previous level
+				long span = static_cast<long> (duration & ~PSX_RUMBLE_FADE) * PSX_RUMBLE_TICK;
+				long elapsed = ms - top->stepStart;
+				motor2 = top->from + (static_cast<long> (motor2) - top->from) * elapsed / span;
+			}
+		}
+	}
+};
+
+#endif
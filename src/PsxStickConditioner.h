@@ -0,0 +1,622 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file PsxStickConditioner.h
+ * \brief Analog stick calibration and shaping
+ */
+
+#ifndef PSXSTICKCONDITIONER_H_
+#define PSXSTICKCONDITIONER_H_
+
+#include "PsxNewLib.h"
+
+/** \brief Smallest calibrated range on either side of the center
+ *
+ * Until a stick has been moved further, this much travel from the center (in
+ * raw units) is taken as full deflection.
+ */
+const byte PSX_STICK_MIN_RANGE = 64;
+
+/** \brief Center tracking speed
+ *
+ * Every reading taken at rest, i.e.: well within the dead zone, moves the
+ * center by 1/2^n of its distance from it.
+ */
+const byte PSX_STICK_CENTER_SHIFT = 4;
+
+//! \brief Largest value of a conditioned axis, either way
+const byte PSX_STICK_MAX = 127;
+
+/** \brief Response Curves
+ *
+ * These map the deflection of the stick (once past the dead zone) to its
+ * output. All curves other than #PSCURVE_LINEAR give finer control around the
+ * center at the expense of the outer part of the travel.
+ *
+ * \sa PsxAnalogStick::setCurve()
+ */
+enum PsxStickCurve {
+	PSCURVE_LINEAR = 0,		//!< Output proportional to deflection
+	PSCURVE_QUADRATIC,		//!< Output grows with the square of deflection
+	PSCURVE_CUBIC			//!< Output grows with the cube of deflection
+};
+
+//! \brief Dead Zone Shapes
+enum PsxDeadZoneMode {
+	PSDZ_RADIAL = 0,		//!< Circular, both axes are scaled together
+	PSDZ_AXIAL				//!< Cross-shaped, every axis on its own
+};
+
+//! \brief #PSCURVE_QUADRATIC lookup table
+static const byte PSX_CURVE_QUADRATIC[PSX_STICK_MAX + 1] PROGMEM = {
+	  0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,   1,   1,   2,   2,
+	  2,   2,   3,   3,   3,   3,   4,   4,   5,   5,   5,   6,   6,   7,   7,   8,
+	  8,   9,   9,  10,  10,  11,  11,  12,  13,  13,  14,  15,  15,  16,  17,  17,
+	 18,  19,  20,  20,  21,  22,  23,  24,  25,  26,  26,  27,  28,  29,  30,  31,
+	 32,  33,  34,  35,  36,  37,  39,  40,  41,  42,  43,  44,  45,  47,  48,  49,
+	 50,  52,  53,  54,  56,  57,  58,  60,  61,  62,  64,  65,  67,  68,  70,  71,
+	 73,  74,  76,  77,  79,  80,  82,  84,  85,  87,  88,  90,  92,  94,  95,  97,
+	 99, 101, 102, 104, 106, 108, 110, 112, 113, 115, 117, 119, 121, 123, 125, 127
+};
+
+//! \brief #PSCURVE_CUBIC lookup table
+static const byte PSX_CURVE_CUBIC[PSX_STICK_MAX + 1] PROGMEM = {
+	  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+	  0,   0,   0,   0,   0,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,
+	  2,   2,   2,   3,   3,   3,   3,   4,   4,   4,   5,   5,   5,   6,   6,   6,
+	  7,   7,   8,   8,   9,   9,  10,  10,  11,  11,  12,  13,  13,  14,  15,  16,
+	 16,  17,  18,  19,  19,  20,  21,  22,  23,  24,  25,  26,  27,  28,  29,  31,
+	 32,  33,  34,  35,  37,  38,  39,  41,  42,  44,  45,  47,  48,  50,  51,  53,
+	 55,  57,  58,  60,  62,  64,  66,  68,  70,  72,  74,  76,  78,  80,  83,  85,
+	 87,  89,  92,  94,  97,  99, 102, 104, 107, 110, 113, 115, 118, 121, 124, 127
+};
+
+/** \brief Reciprocal lookup table
+ *
+ * Entry \a i is 65536 / i, saturated, so that radial scaling needs no
+ * divisions.
+ */
+static const word PSX_STICK_RECIPROCALS[PSX_STICK_MAX + 1] PROGMEM = {
+	    0, 65535, 32768, 21845, 16384, 13107, 10923,  9362,
+	 8192,  7282,  6554,  5958,  5461,  5041,  4681,  4369,
+	 4096,  3855,  3641,  3449,  3277,  3121,  2979,  2849,
+	 2731,  2621,  2521,  2427,  2341,  2260,  2185,  2114,
+	 2048,  1986,  1928,  1872,  1820,  1771,  1725,  1680,
+	 1638,  1598,  1560,  1524,  1489,  1456,  1425,  1394,
+	 1365,  1337,  1311,  1285,  1260,  1237,  1214,  1192,
+	 1170,  1150,  1130,  1111,  1092,  1074,  1057,  1040,
+	 1024,  1008,   993,   978,   964,   950,   936,   923,
+	  910,   898,   886,   874,   862,   851,   840,   830,
+	  819,   809,   799,   790,   780,   771,   762,   753,
+	  745,   736,   728,   720,   712,   705,   697,   690,
+	  683,   676,   669,   662,   655,   649,   643,   636,
+	  630,   624,   618,   612,   607,   601,   596,   590,
+	  585,   580,   575,   570,   565,   560,   555,   551,
+	  546,   542,   537,   533,   529,   524,   520,   516
+};
+
+/** \brief Calibration of a single axis
+ *
+ * All values are raw positions, as reported by the controller.
+ */
+struct PsxAxisCalibration {
+	byte min;			//!< Position at full deflection towards 0
+	byte center;		//!< Position at rest
+	byte max;			//!< Position at full deflection towards 255
+};
+
+//! \brief Calibration of an analog stick
+struct PsxStickCalibration {
+	PsxAxisCalibration x;		//!< Horizontal axis
+	PsxAxisCalibration y;		//!< Vertical axis
+};
+
+/** \brief Analog Stick Conditioner
+ *
+ * This turns the raw position of an analog stick into a signed one, through
+ * the following stages:
+ * 1. Calibration: the center and the extremes of every axis are learned over
+ *    time, which takes care of sticks that don't rest at 128 or that don't
+ *    reach 0 or 255 anymore. The extremes only ever grow. The center is only
+ *    tracked while the stick is within half of the dead zone, where its
+ *    output is 0 anyway, so that small deflections that are held for a long
+ *    time are not mistaken for a drifting center: with no dead zone, the
+ *    center is never tracked. recenter() takes the next reading as the center
+ *    instead, i.e.: at start-up, when the stick is at rest. Calibration can
+ *    also be saved and restored, i.e.: to/from EEPROM.
+ * 2. Normalization to [-127 ... 127] on either side of the center.
+ * 3. Dead zone, either radial or axial, whose size is removed from the output
+ *    range so that there is no jump at its edge.
+ * 4. Response curve.
+ * 5. Anti-dead zone, i.e.: the smallest output that is ever returned outside
+ *    of the dead zone, to compensate for the dead zone of whatever the output
+ *    is fed to.
+ *
+ * Everything is done with 8/16-bit integers and lookup tables, divisions only
+ * take place when the calibration or settings change.
+ *
+ * Usually a PsxStickConditioner is used to handle both sticks of a controller.
+ */
+class PsxAnalogStick {
+protected:
+	PsxAxisCalibration cal[2];		//!< Calibration, X and Y
+	word centerAcc[2];				//!< Tracked centers, 8.8 fixed point
+	word scaleNeg[2];				//!< Scale below the center, 8.8 fixed point
+	word scalePos[2];				//!< Scale above the center, 8.8 fixed point
+	boolean autoCalibration;
+	boolean recenterPending;		//!< Next reading is the center, see recenter()
+
+	PsxDeadZoneMode deadZoneMode;
+	byte deadZone;					//!< Dead zone size, normalized units
+	word deadZoneScale;				//!< Scale past the dead zone, 8.8 fixed point
+	byte antiDeadZone;				//!< Anti-dead zone size, normalized units
+	word antiDeadZoneScale;			//!< Scale past the anti-dead zone, 8.8 fixed point
+	const byte *curve;				//!< Curve lookup table in flash, NULL if linear
+
+	//! \brief Compute the 8.8 fixed point factor that scales \a range to \a to
+	static word makeScale (const byte range, const byte to = PSX_STICK_MAX) {
+		return range > 0 ? ((static_cast<word> (to) << 8) + range / 2) / range : 0;
+	}
+
+	//! \brief Recompute the normalization factors of an axis
+	void updateScales (const byte axis) {
+		const PsxAxisCalibration& c = cal[axis];
+		scaleNeg[axis] = makeScale (c.center - c.min);
+		scalePos[axis] = makeScale (c.max - c.center);
+	}
+
+	/** \brief Make sure the extremes of an axis are far enough from its
+	 *         center
+	 */
+	void enforceMinRange (const byte axis) {
+		PsxAxisCalibration& c = cal[axis];
+		if (c.center - c.min < PSX_STICK_MIN_RANGE) {
+			c.min = c.center > PSX_STICK_MIN_RANGE ? c.center - PSX_STICK_MIN_RANGE : 0;
+		}
+		if (c.max - c.center < PSX_STICK_MIN_RANGE) {
+			c.max = c.center < 0xFF - PSX_STICK_MIN_RANGE ? c.center + PSX_STICK_MIN_RANGE : 0xFF;
+		}
+	}
+
+	//! \brief Update the extremes of an axis with a new reading
+	void learnRange (const byte axis, const byte raw) {
+		PsxAxisCalibration& c = cal[axis];
+		boolean changed = false;
+
+		if (raw < c.min) {
+			c.min = raw;
+			changed = true;
+		} else if (raw > c.max) {
+			c.max = raw;
+			changed = true;
+		}
+
+		if (changed) {
+			updateScales (axis);
+		}
+	}
+
+	//! \brief Pull the center of an axis towards a reading taken at rest
+	void trackCenter (const byte axis, const byte raw) {
+		PsxAxisCalibration& c = cal[axis];
+
+		word target = static_cast<word> (raw) << 8;
+		if (target > centerAcc[axis]) {
+			centerAcc[axis] += (target - centerAcc[axis]) >> PSX_STICK_CENTER_SHIFT;
+		} else {
+			centerAcc[axis] -= (centerAcc[axis] - target) >> PSX_STICK_CENTER_SHIFT;
+		}
+
+		byte center = (centerAcc[axis] + 0x80) >> 8;
+		if (center != c.center) {
+			c.center = center;
+			enforceMinRange (axis);
+			updateScales (axis);
+		}
+	}
+
+	//! \brief Make a raw position the center of an axis
+	void setCenter (const byte axis, const byte raw) {
+		PsxAxisCalibration& c = cal[axis];
+
+		c.center = raw;
+		centerAcc[axis] = static_cast<word> (raw) << 8;
+		if (c.min > c.center) {
+			c.min = c.center;
+		}
+		if (c.max < c.center) {
+			c.max = c.center;
+		}
+		enforceMinRange (axis);
+		updateScales (axis);
+	}
+
+	//! \brief Map a raw position to [-127 ... 127] around the center
+	int8_t normalize (const byte axis, const byte raw) const {
+		const PsxAxisCalibration& c = cal[axis];
+		int8_t ret;
+
+		if (raw >= c.center) {
+			byte d = raw - c.center;
+			ret = d >= c.max - c.center ? PSX_STICK_MAX : (d * scalePos[axis]) >> 8;
+		} else {
+			byte d = c.center - raw;
+			ret = d >= c.center - c.min ? -PSX_STICK_MAX : -((d * scaleNeg[axis]) >> 8);
+		}
+
+		return ret;
+	}
+
+	//! \brief Apply dead zone, curve and anti-dead zone to a deflection
+	byte shape (byte m) const {
+		if (m <= deadZone) {
+			m = 0;
+		} else {
+			if (deadZone > 0) {
+				word s = ((m - deadZone) * deadZoneScale) >> 8;
+				m = s < PSX_STICK_MAX ? s : PSX_STICK_MAX;
+			}
+
+			if (curve != NULL) {
+				m = pgm_read_byte (curve + m);
+			}
+
+			if (antiDeadZone > 0 && m > 0) {
+				word s = antiDeadZone + ((m * antiDeadZoneScale) >> 8);
+				m = s < PSX_STICK_MAX ? s : PSX_STICK_MAX;
+			}
+		}
+
+		return m;
+	}
+
+	//! \brief Give a magnitude the sign of \a v
+	static int8_t withSign (const byte m, const int8_t v) {
+		return v < 0 ? -static_cast<int8_t> (m) : static_cast<int8_t> (m);
+	}
+
+public:
+	PsxAnalogStick (): autoCalibration (true), recenterPending (false), deadZoneMode (PSDZ_RADIAL), deadZone (0),
+	                   deadZoneScale (makeScale (PSX_STICK_MAX)), antiDeadZone (0),
+	                   antiDeadZoneScale (makeScale (PSX_STICK_MAX)), curve (NULL) {
+		resetCalibration ();
+	}
+
+	/** \brief Process a raw stick position
+	 *
+	 * \param[in] rawX Raw horizontal position [0-255, L to R]
+	 * \param[in] rawY Raw vertical position [0-255, U to D]
+	 * \param[out] x Conditioned horizontal position [-127 ... 127, L to R]
+	 * \param[out] y Conditioned vertical position [-127 ... 127, U to D]
+	 */
+	void process (const byte rawX, const byte rawY, int8_t& x, int8_t& y) {
+		if (recenterPending) {
+			setCenter (0, rawX);
+			setCenter (1, rawY);
+			recenterPending = false;
+		}
+
+		if (autoCalibration) {
+			learnRange (0, rawX);
+			learnRange (1, rawY);
+		}
+
+		int8_t nx = normalize (0, rawX);
+		int8_t ny = normalize (1, rawY);
+		byte ax = nx < 0 ? -nx : nx;
+		byte ay = ny < 0 ? -ny : ny;
+		const byte restZone = deadZone / 2;
+
+		if (deadZoneMode == PSDZ_AXIAL) {
+			x = withSign (shape (ax), nx);
+			y = withSign (shape (ay), ny);
+
+			if (autoCalibration) {
+				if (ax <= restZone) {
+					trackCenter (0, rawX);
+				}
+				if (ay <= restZone) {
+					trackCenter (1, rawY);
+				}
+			}
+		} else {
+			/* Approximate the distance from the center as
+			 * max (hi, 7/8 hi + 1/2 lo), which is within 3% of the real thing
+			 */
+			byte hi = ax > ay ? ax : ay;
+			byte lo = ax > ay ? ay : ax;
+			word r = hi - (hi >> 3) + (lo >> 1);
+			if (r < hi) {
+				r = hi;
+			}
+			if (r > PSX_STICK_MAX) {
+				r = PSX_STICK_MAX;
+			}
+
+			byte s = r > 0 ? shape (r) : 0;
+			if (s == 0) {
+				x = 0;
+				y = 0;
+			} else {
+				// Scale both axes by s / r
+				word k = pgm_read_word (&PSX_STICK_RECIPROCALS[r]);
+				unsigned long sx = (static_cast<unsigned long> (ax * s) * k + 0x8000) >> 16;
+				unsigned long sy = (static_cast<unsigned long> (ay * s) * k + 0x8000) >> 16;
+				x = withSign (sx < PSX_STICK_MAX ? sx : PSX_STICK_MAX, nx);
+				y = withSign (sy < PSX_STICK_MAX ? sy : PSX_STICK_MAX, ny);
+			}
+
+			if (autoCalibration && r <= restZone) {
+				trackCenter (0, rawX);
+				trackCenter (1, rawY);
+			}
+		}
+	}
+
+	//! \name Calibration Functions
+	//! @{
+
+	/** \brief Enable or disable automatic calibration
+	 *
+	 * When disabled, the current calibration is kept as it is.
+	 */
+	void setAutoCalibration (const boolean enabled) {
+		autoCalibration = enabled;
+	}
+
+	//! \brief Check if automatic calibration is enabled
+	boolean getAutoCalibration () const {
+		return autoCalibration;
+	}
+
+	/** \brief Take the next reading as the center
+	 *
+	 * Call this when the stick is known to be at rest, i.e.: right after the
+	 * controller was found. This works even if automatic calibration is
+	 * disabled.
+	 */
+	void recenter () {
+		recenterPending = true;
+	}
+
+	/** \brief Forget the calibration
+	 *
+	 * This assumes a centered stick with the minimum range of travel, which
+	 * automatic calibration will then refine.
+	 */
+	void resetCalibration () {
+		for (byte i = 0; i < 2; ++i) {
+			cal[i].center = ANALOG_IDLE_VALUE;
+			cal[i].min = ANALOG_IDLE_VALUE;
+			cal[i].max = ANALOG_IDLE_VALUE;
+			centerAcc[i] = static_cast<word> (ANALOG_IDLE_VALUE) << 8;
+			enforceMinRange (i);
+			updateScales (i);
+		}
+	}
+
+	/** \brief Retrieve the current calibration
+	 *
+	 * \param[out] c Where the calibration will be stored
+	 */
+	void getCalibration (PsxStickCalibration& c) const {
+		c.x = cal[0];
+		c.y = cal[1];
+	}
+
+	/** \brief Set the calibration
+	 *
+	 * Every axis keeps at least #PSX_STICK_MIN_RANGE of travel on each side
+	 * of the center.
+	 *
+	 * \param[in] c The calibration to use, i.e.: one previously retrieved with
+	 *              getCalibration()
+	 */
+	void setCalibration (const PsxStickCalibration& c) {
+		cal[0] = c.x;
+		cal[1] = c.y;
+		for (byte i = 0; i < 2; ++i) {
+			setCenter (i, cal[i].center);
+		}
+	}
+
+	//! @}
+
+	//! \name Shaping Functions
+	//! @{
+
+	/** \brief Set the dead zone
+	 *
+	 * \param[in] size Size of the dead zone, in output units [0 ... 126]
+	 * \param[in] mode Shape of the dead zone
+	 */
+	void setDeadZone (const byte size, const PsxDeadZoneMode mode = PSDZ_RADIAL) {
+		deadZone = size < PSX_STICK_MAX ? size : PSX_STICK_MAX - 1;
+		deadZoneMode = mode;
+		deadZoneScale = makeScale (PSX_STICK_MAX - deadZone);
+	}
+
+	/** \brief Set the anti-dead zone
+	 *
+	 * \param[in] size Smallest output value outside of the dead zone
+	 *                 [0 ... 126]
+	 */
+	void setAntiDeadZone (const byte size) {
+		antiDeadZone = size < PSX_STICK_MAX ? size : PSX_STICK_MAX - 1;
+		antiDeadZoneScale = makeScale (PSX_STICK_MAX, PSX_STICK_MAX - antiDeadZone);
+	}
+
+	/** \brief Select one of the built-in response curves
+	 *
+	 * \param[in] c The curve to use
+	 */
+	void setCurve (const PsxStickCurve c) {
+		switch (c) {
+			case PSCURVE_QUADRATIC:
+				curve = PSX_CURVE_QUADRATIC;
+				break;
+			case PSCURVE_CUBIC:
+				curve = PSX_CURVE_CUBIC;
+				break;
+			case PSCURVE_LINEAR:
+			default:
+				curve = NULL;
+				break;
+		}
+	}
+
+	/** \brief Use a custom response curve
+	 *
+	 * \param[in] lut Lookup table stored in flash (PROGMEM), mapping every
+	 *                deflection [0 ... 127] to an output [0 ... 127], NULL
+	 *                for a linear response
+	 */
+	void setCustomCurve (const byte *lut) {
+		curve = lut;
+	}
+
+	//! @}
+};
+
+/** \brief Controller Stick Conditioner
+ *
+ * This conditions both analog sticks of a controller through a pair of
+ * PsxAnalogStick, each with its own calibration, so one of these is needed
+ * for every controller. Call update() after every successful read():
+ *
+ * \code
+ * PsxStickConditioner sticks;
+ *
+ * if (psx.read ()) {
+ *     sticks.update (psx);
+ *
+ *     int8_t x, y;
+ *     if (sticks.getLeftStick (x, y)) {
+ *         // x and y are in [-127 ... 127]
+ *     }
+ * }
+ * \endcode
+ *
+ * Only controllers with actual sticks are considered: the analog axes of the
+ * neGcon and JogCon are something else entirely.
+ */
+class PsxStickConditioner {
+protected:
+	PsxAnalogStick left;
+	PsxAnalogStick right;
+
+	int8_t lx, ly, rx, ry;			//!< Conditioned positions
+
+	//! \brief True if the last update() found valid stick data
+	boolean valid;
+
+public:
+	PsxStickConditioner (): lx (0), ly (0), rx (0), ry (0), valid (false) {
+	}
+
+	/** \brief Process the latest stick positions of a controller
+	 *
+	 * \param[in] pad The controller, i.e.: a PsxController right after read()
+	 * \return true if the controller reported valid stick positions
+	 */
+	boolean update (const PsxControllerData& pad) {
+		PsxControllerProtocol proto = pad.getProtocol ();
+		byte x, y;
+
+		valid = (proto == PSPROTO_DUALSHOCK || proto == PSPROTO_DUALSHOCK2 || proto == PSPROTO_FLIGHTSTICK) &&
+		        pad.getLeftAnalog (x, y);
+		if (valid) {
+			left.process (x, y, lx, ly);
+			pad.getRightAnalog (x, y);
+			right.process (x, y, rx, ry);
+		} else {
+			lx = ly = rx = ry = 0;
+		}
+
+		return valid;
+	}
+
+	/** \brief Retrieve the conditioned position of the \a left stick
+	 *
+	 * \param[out] x Horizontal position [-127 ... 127, L to R]
+	 * \param[out] y Vertical position [-127 ... 127, U to D]
+	 * \return true if the position is valid
+	 */
+	boolean getLeftStick (int8_t& x, int8_t& y) const {
+		x = lx;
+		y = ly;
+		return valid;
+	}
+
+	/** \brief Retrieve the conditioned position of the \a right stick
+	 *
+	 * \param[out] x Horizontal position [-127 ... 127, L to R]
+	 * \param[out] y Vertical position [-127 ... 127, U to D]
+	 * \return true if the position is valid
+	 */
+	boolean getRightStick (int8_t& x, int8_t& y) const {
+		x = rx;
+		y = ry;
+		return valid;
+	}
+
+	//! \brief Take the next positions of both sticks as their centers, see PsxAnalogStick::recenter()
+	void recenter () {
+		left.recenter ();
+		right.recenter ();
+	}
+
+	//! \brief Access the settings and calibration of the \a left stick
+	PsxAnalogStick& getLeft () {
+		return left;
+	}
+
+	//! \brief Access the settings and calibration of the \a right stick
+	PsxAnalogStick& getRight () {
+		return right;
+	}
+
+	//! \name Shaping Functions
+	//! @{
+	/* These apply to both sticks, which can also be set up independently
+	 * through getLeft() and getRight().
+	 */
+
+	//! \brief Set the dead zone of both sticks, see PsxAnalogStick::setDeadZone()
+	void setDeadZone (const byte size, const PsxDeadZoneMode mode = PSDZ_RADIAL) {
+		left.setDeadZone (size, mode);
+		right.setDeadZone (size, mode);
+	}
+
+	//! \brief Set the anti-dead zone of both sticks, see PsxAnalogStick::setAntiDeadZone()
+	void setAntiDeadZone (const byte size) {
+		left.setAntiDeadZone (size);
+		right.setAntiDeadZone (size);
+	}
+
+	//! \brief Set the response curve of both sticks, see PsxAnalogStick::setCurve()
+	void setCurve (const PsxStickCurve c) {
+		left.setCurve (c);
+		right.setCurve (c);
+	}
+
+	//! @}
+};
+
+#endif
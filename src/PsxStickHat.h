@@ -0,0 +1,286 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file PsxStickHat.h
+ * \brief Analog stick to hat switch conversion
+ */
+
+#ifndef PSXSTICKHAT_H_
+#define PSXSTICKHAT_H_
+
+#include "PsxStickConditioner.h"
+
+//! \brief Hat switch value when the stick is at rest
+const int16_t PSX_HAT_RELEASED = -1;
+
+/** \brief Dead zone release margin
+ *
+ * Once out of the dead zone, the stick must get this much closer to the center
+ * (in stick units) to be taken as released again.
+ */
+const byte PSX_HAT_RELEASE_MARGIN = 4;
+
+//! \brief Hat Switch Resolutions
+enum PsxHatMode {
+	PSHAT_4WAY = 0,			//!< Up, right, down and left only
+	PSHAT_8WAY,				//!< Diagonals too, in 45 degree steps
+	PSHAT_360				//!< Any angle, in 1 degree steps
+};
+
+/** \brief Arctangent lookup table
+ *
+ * Entry \a i is atan (i / 64), in quarters of a degree.
+ */
+static const byte PSX_HAT_ATAN[65] PROGMEM = {
+	  0,   4,   7,  11,  14,  18,  21,  25,  29,  32,  36,  39,  42,  46,  49,  53,
+	 56,  60,  63,  66,  69,  73,  76,  79,  82,  85,  88,  91,  95,  98, 100, 103,
+	106, 109, 112, 115, 117, 120, 123, 125, 128, 131, 133, 136, 138, 140, 143, 145,
+	147, 150, 152, 154, 156, 159, 161, 163, 165, 167, 169, 171, 173, 175, 176, 178,
+	180
+};
+
+/** \brief Analog Stick to Hat Switch Converter
+ *
+ * This turns the position of an analog stick into the direction of a hat
+ * switch, as reported by USB joysticks: 0 degrees is up and angles grow
+ * clockwise, while #PSX_HAT_RELEASED means the stick is at rest.
+ *
+ * Angles are found by folding the position into the first octant and looking
+ * up the ratio of the two axes in a small arctangent table, so no floating
+ * point is involved. Only fixed-width integer arithmetic is used, which gives
+ * the very same results on AVR and on a PC.
+ *
+ * In the 4- and 8-way modes, the stick must move past the boundary between two
+ * directions by the hysteresis angle before the output changes, which keeps a
+ * stick resting right on a boundary from flickering between them. In 360
+ * degree mode, the output only changes when the angle moves by more than that.
+ *
+ * \code
+ * PsxStickHat hat (PSHAT_8WAY);
+ * byte x, y;
+ *
+ * if (psx.getRightAnalog (x, y)) {
+ *     int16_t angle = hat.updateRaw (x, y);
+ *     // ...
+ * }
+ * \endcode
+ */
+class PsxStickHat {
+protected:
+	PsxHatMode mode;
+
+	//! \brief Distance from the center below which the stick is at rest
+	byte deadZone;
+
+	//! \brief Hysteresis (degrees)
+	byte hysteresis;
+
+	//! \brief Last output
+	int16_t last;
+
+	/** \brief Get the angle of a position
+	 *
+	 * \param[in] x Horizontal position [-128 ... 127, L to R]
+	 * \param[in] y Vertical position [-128 ... 127, U to D]
+	 * \return The angle, in quarters of a degree [0 ... 1439]
+	 */
+	static int16_t angle4 (const int8_t x, const int8_t y) {
+		byte ax = x < 0 ? -x : x;
+		byte ay = y < 0 ? -y : y;
+		byte hi = ax > ay ? ax : ay;
+		byte lo = ax > ay ? ay : ax;
+		if (hi > PSX_STICK_MAX) {
+			// Only -128 gets here
+			hi >>= 1;
+			lo >>= 1;
+		}
+
+		// Fold into the first octant: r = lo / hi, in 1/256ths
+		word r = 256;
+		if (lo < hi) {
+			word k = pgm_read_word (&PSX_STICK_RECIPROCALS[hi]);
+			r = (static_cast<unsigned long> (lo) * k + 0x80) >> 8;
+			if (r > 256) {
+				r = 256;
+			}
+		}
+
+		// Look it up, interpolating between entries
+		byte i = r >> 2;
+		int16_t a = pgm_read_byte (&PSX_HAT_ATAN[i]);
+		byte f = r & 0x03;
+		if (f > 0) {
+			a += ((pgm_read_byte (&PSX_HAT_ATAN[i + 1]) - a) * f + 2) >> 2;
+		}
+
+		// Unfold: angle from the vertical axis, then pick the quadrant
+		int16_t q = ax > ay ? 360 - a : a;
+		int16_t ret;
+		if (x >= 0) {
+			ret = y <= 0 ? q : 720 - q;
+		} else {
+			ret = y > 0 ? 720 + q : 1440 - q;
+		}
+
+		return ret < 1440 ? ret : ret - 1440;
+	}
+
+	//! \brief Distance between two angles, either way round
+	static int16_t distance (const int16_t a, const int16_t b, const int16_t full) {
+		int16_t d = a > b ? a - b : b - a;
+		return d <= full / 2 ? d : full - d;
+	}
+
+public:
+	/** \brief Constructor
+	 *
+	 * \param[in] m Resolution
+	 * \param[in] dz Dead zone, in stick units from the center [0 ... 127]
+	 * \param[in] hyst Hysteresis (degrees)
+	 */
+	PsxStickHat (const PsxHatMode m = PSHAT_8WAY, const byte dz = 50, const byte hyst = 5):
+	             mode (m), deadZone (dz), hysteresis (hyst), last (PSX_HAT_RELEASED) {
+	}
+
+	/** \brief Get the angle of a position
+	 *
+	 * This is stateless, no dead zone nor hysteresis are applied.
+	 *
+	 * \param[in] x Horizontal position [-128 ... 127, L to R]
+	 * \param[in] y Vertical position [-128 ... 127, U to D]
+	 * \return The angle (degrees) [0 ... 359], clockwise from up. 0 at the
+	 *         center as well.
+	 */
+	static int16_t getAngle (const int8_t x, const int8_t y) {
+		int16_t ret = 0;
+
+		if (x != 0 || y != 0) {
+			ret = (angle4 (x, y) + 2) >> 2;
+			if (ret >= 360) {
+				ret = 0;
+			}
+		}
+
+		return ret;
+	}
+
+	/** \brief Convert a stick position
+	 *
+	 * \param[in] x Horizontal position [-128 ... 127, L to R], i.e.: as
+	 *              returned by PsxAnalogStick::process()
+	 * \param[in] y Vertical position [-128 ... 127, U to D]
+	 * \return The hat switch angle (degrees) [0 ... 359], or
+	 *         #PSX_HAT_RELEASED if the stick is in the dead zone
+	 */
+	int16_t update (const int8_t x, const int8_t y) {
+		// Same distance approximation as PsxAnalogStick
+		byte ax = x < 0 ? -x : x;
+		byte ay = y < 0 ? -y : y;
+		byte hi = ax > ay ? ax : ay;
+		byte lo = ax > ay ? ay : ax;
+		word r = hi - (hi >> 3) + (lo >> 1);
+		if (r < hi) {
+			r = hi;
+		}
+
+		word threshold = deadZone;
+		if (last != PSX_HAT_RELEASED) {
+			threshold = deadZone > PSX_HAT_RELEASE_MARGIN ? deadZone - PSX_HAT_RELEASE_MARGIN : 0;
+		}
+
+		if (r <= threshold) {
+			last = PSX_HAT_RELEASED;
+		} else if (mode == PSHAT_360) {
+			int16_t a = getAngle (x, y);
+			if (last == PSX_HAT_RELEASED || distance (a, last, 360) > hysteresis) {
+				last = a;
+			}
+		} else {
+			// Sector width and number of sectors, in quarters of a degree
+			const int16_t width = mode == PSHAT_4WAY ? 360 : 180;
+			const byte n = mode == PSHAT_4WAY ? 4 : 8;
+
+			int16_t a = angle4 (x, y);
+			if (last == PSX_HAT_RELEASED || distance (a, last * 4, 1440) > width / 2 + hysteresis * 4) {
+				byte s = ((a + width / 2) / width) % n;
+				last = s * (width / 4);
+			}
+		}
+
+		return last;
+	}
+
+	/** \brief Convert a raw stick position
+	 *
+	 * \param[in] x Horizontal position [0 ... 255, L to R], as reported by the
+	 *              controller
+	 * \param[in] y Vertical position [0 ... 255, U to D]
+	 * \return The hat switch angle (degrees) [0 ... 359], or
+	 *         #PSX_HAT_RELEASED if the stick is in the dead zone
+	 */
+	int16_t updateRaw (const byte x, const byte y) {
+		return update (static_cast<int8_t> (x - ANALOG_IDLE_VALUE), static_cast<int8_t> (y - ANALOG_IDLE_VALUE));
+	}
+
+	//! \brief Get the last output of update()
+	int16_t getHat () const {
+		return last;
+	}
+
+	//! \brief Forget the last output, as if the stick was released
+	void reset () {
+		last = PSX_HAT_RELEASED;
+	}
+
+	//! \name Configuration Functions
+	//! @{
+
+	//! \brief Set the resolution
+	void setMode (const PsxHatMode m) {
+		mode = m;
+		reset ();
+	}
+
+	//! \brief Get the resolution
+	PsxHatMode getMode () const {
+		return mode;
+	}
+
+	/** \brief Set the dead zone
+	 *
+	 * \param[in] dz Distance from the center (in stick units) below which the
+	 *               stick is taken as being at rest [0 ... 127]
+	 */
+	void setDeadZone (const byte dz) {
+		deadZone = dz;
+	}
+
+	/** \brief Set the hysteresis
+	 *
+	 * \param[in] hyst How far past a boundary the stick must move before the
+	 *                 direction changes (degrees), 0 to disable
+	 */
+	void setHysteresis (const byte hyst) {
+		hysteresis = hyst;
+	}
+
+	//! @}
+};
+
+#endif
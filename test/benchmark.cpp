@@ -0,0 +1,133 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file benchmark.cpp
+ * \brief Host benchmark of polls, for every controller type
+ *
+ * This runs the library against PsxControllerSim for every controller type
+ * and mode, and reports per case:
+ * - bytes: Bytes exchanged per poll.
+ * - bus_us: Time a poll takes on the bus, all delays included, as accounted
+ *   for by the virtual clock of the simulator, at the default clock speed
+ *   without the Acknowledge line.
+ * - read_ns: CPU time taken by read(), simulator included (ns).
+ * - decode_ns: CPU time taken to decode a reply (ns).
+ *
+ * Results are printed as CSV lines prefixed by "# BENCH ", which the test
+ * runner passes through as comments, so they can be picked up from the CI log
+ * with i.e.: <tt>grep '^# BENCH ' | cut -c 9-</tt>. The number of bytes and
+ * the bus time are fixed by the protocol and by the library, so they are also
+ * checked against their expected values: any change to them must be
+ * deliberate.
+ *
+ * examples/Benchmark does the same on a board.
+ */
+
+#include <ArduinoUnitTests.h>
+#include <PsxControllerSim.h>
+#include <chrono>
+
+// Decodes are way quicker than reads, so time more of them
+const unsigned int READS_NO = 2000;
+const unsigned int DECODES_NO = 20000;
+
+/* Exposes the decoder, so that it can be timed on its own, on the last reply
+ * received
+ */
+class BenchController: public PsxControllerSim {
+public:
+	void decodeLast () {
+		beginState ();
+		decodePollReply (inputBuffer);
+		publishState ();
+	}
+};
+
+struct BenchCase {
+	const char *name;
+	PsxSimModel model;
+	boolean configure;
+	PsxConfigProfile profile;
+	PsxControllerProtocol protocol;		//!< Expected protocol
+	unsigned long bytes;				//!< Expected bytes per poll
+	unsigned long busTime;				//!< Expected bus time per poll (us)
+};
+
+static const BenchCase cases[] = {
+	{"digital", PSSIM_DIGITAL, false, PsxConfigProfile (false), PSPROTO_DIGITAL, 5, 510},
+	{"dualshock", PSSIM_DUALSHOCK, true, PsxConfigProfile (true), PSPROTO_DUALSHOCK, 9, 838},
+	{"dualshock_rumble", PSSIM_DUALSHOCK, true, PsxConfigProfile (true, false, false, true), PSPROTO_DUALSHOCK, 9, 838},
+	{"dualshock2_pressures", PSSIM_DUALSHOCK2, true, PsxConfigProfile (true, false, true), PSPROTO_DUALSHOCK2, 21, 1822},
+	{"dualshock2_pressures_rumble", PSSIM_DUALSHOCK2, true, PsxConfigProfile (true, false, true, true), PSPROTO_DUALSHOCK2, 21, 1822},
+	{"flightstick", PSSIM_FLIGHTSTICK, false, PsxConfigProfile (false), PSPROTO_FLIGHTSTICK, 9, 838},
+	{"negcon", PSSIM_NEGCON, false, PsxConfigProfile (false), PSPROTO_NEGCON, 9, 838},
+	{"jogcon", PSSIM_JOGCON, false, PsxConfigProfile (false), PSPROTO_JOGCON, 9, 838},
+	{"guncon", PSSIM_GUNCON, false, PsxConfigProfile (false), PSPROTO_GUNCON, 9, 838}
+};
+
+static unsigned long elapsedNs (const std::chrono::steady_clock::time_point& start) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now () - start).count ();
+}
+
+unittest (benchmark) {
+	BenchController psx;
+
+	printf ("# BENCH case,protocol,ok,bytes,bus_us,read_ns,decode_ns\n");
+	for (byte i = 0; i < sizeof (cases) / sizeof (cases[0]); ++i) {
+		const BenchCase& c = cases[i];
+
+		psx.setModel (c.model);
+		psx.resetStats ();
+
+		boolean ok = psx.begin ();
+		if (ok && c.configure) {
+			ok = psx.configure (c.profile);
+			psx.setRumble (true, 0xFF);
+		}
+		assertTrue (ok);
+
+		// Bus time and bytes, from the simulator
+		unsigned long clock0 = psx.getClock ();
+		unsigned long bytes0 = psx.getBytesExchanged ();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+		for (unsigned int j = 0; j < READS_NO; ++j) {
+			ok = psx.read () && ok;
+		}
+		unsigned long readTime = elapsedNs (start);
+		unsigned long busTime = (psx.getClock () - clock0) / READS_NO;
+		unsigned long bytes = (psx.getBytesExchanged () - bytes0) / READS_NO;
+
+		// Decoder alone
+		start = std::chrono::steady_clock::now ();
+		for (unsigned int j = 0; j < DECODES_NO; ++j) {
+			psx.decodeLast ();
+		}
+		unsigned long decodeTime = elapsedNs (start);
+
+		printf ("# BENCH %s,%d,%d,%lu,%lu,%lu,%lu\n", c.name, psx.getProtocol (), ok ? 1 : 0, bytes, busTime,
+		        readTime / READS_NO, decodeTime / DECODES_NO);
+
+		assertTrue (ok);
+		assertEqual (c.protocol, psx.getProtocol ());
+		assertEqual (c.bytes, bytes);
+		assertEqual (c.busTime, busTime);
+	}
+}
+
+unittest_main ()
@@ -0,0 +1,222 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file hwspi_async.cpp
+ * \brief Tests of the PsxControllerHwSpiAsync state machine on a mock port
+ */
+
+#include <ArduinoUnitTests.h>
+
+// The interrupt handlers are AVR-only, the mock port below calls them instead
+#define PSX_SPI_ASYNC_NO_ISR
+#include <PsxControllerHwSpiAsync.h>
+
+/** \brief Mock SPI and Timer Peripheral
+ *
+ * This just records what the state machine asks for, the test then plays the
+ * hardware through transfer() and expire(), replying with a scripted frame.
+ */
+struct MockSpiPort {
+	static boolean timerRunning;
+	static byte timerUs;
+	static boolean transferInterrupt;
+	static boolean writePending;
+	static byte sent[32];
+	static byte sentLen;
+	static const byte *reply;
+	static byte replyLen;
+	static byte in;
+
+	static void reset (const byte *r, const byte len) {
+		timerRunning = false;
+		transferInterrupt = false;
+		writePending = false;
+		sentLen = 0;
+		reply = r;
+		replyLen = len;
+	}
+
+	static void begin () {
+		timerRunning = false;
+	}
+
+	static void startTimer (const byte us) {
+		timerRunning = true;
+		timerUs = us;
+	}
+
+	static void stopTimer () {
+		timerRunning = false;
+	}
+
+	static void enableTransferInterrupt (const boolean enabled) {
+		transferInterrupt = enabled;
+	}
+
+	static void write (const byte out) {
+		writePending = true;
+		in = sentLen < replyLen ? reply[sentLen] : 0xFF;
+		sent[sentLen++] = out;
+	}
+
+	static byte read () {
+		return in;
+	}
+};
+
+boolean MockSpiPort::timerRunning;
+byte MockSpiPort::timerUs;
+boolean MockSpiPort::transferInterrupt;
+boolean MockSpiPort::writePending;
+byte MockSpiPort::sent[32];
+byte MockSpiPort::sentLen;
+const byte *MockSpiPort::reply;
+byte MockSpiPort::replyLen;
+byte MockSpiPort::in;
+
+typedef PsxControllerHwSpiAsync<10, PSX_NO_ACK_PIN, MockSpiPort> PsxAsync;
+
+/* Play the hardware until the frame is complete, checking that every byte is
+ * transferred with the transfer interrupt enabled and that the timer is always
+ * started with the expected delay. Returns the number of steps taken.
+ */
+static int runFrame (PsxAsync& psx) {
+	int steps = 0;
+
+	while (!psx.frameComplete () && steps < 200) {
+		if (MockSpiPort::writePending) {
+			assertTrue (MockSpiPort::transferInterrupt);
+			MockSpiPort::writePending = false;
+			psx.onTransferComplete ();
+		} else if (MockSpiPort::timerRunning) {
+			// Attention delay before the first byte and after the last one
+			byte expected = MockSpiPort::sentLen == 0 || !MockSpiPort::transferInterrupt ? ATTN_DELAY : INTER_CMD_BYTE_DELAY;
+			assertEqual (expected, MockSpiPort::timerUs);
+			psx.onTimer ();
+		} else {
+			break;
+		}
+		++steps;
+	}
+
+	return steps;
+}
+
+static void startPad (PsxAsync& psx) {
+	const byte reply[] = {0xFF, 0x41, 0x5A, 0xFF, 0xFF};
+	MockSpiPort::reset (NULL, 0);
+	psx.begin ();
+
+	// Get it to a known state
+	byte frame[21];
+	MockSpiPort::reset (reply, sizeof (reply));
+	psx.beginFrame (frame, sizeof (frame));
+	runFrame (psx);
+	psx.endFrame ();
+}
+
+unittest (digital_frame) {
+	PsxAsync psx;
+	startPad (psx);
+
+	const byte reply[] = {0xFF, 0x41, 0x5A, 0xEF, 0xBF};		// Up and Cross
+	byte frame[21];
+	MockSpiPort::reset (reply, sizeof (reply));
+	assertTrue (psx.beginFrame (frame, sizeof (frame)));
+	assertFalse (psx.frameComplete ());
+	assertFalse (psx.beginFrame (frame, sizeof (frame)));		// Already busy
+	assertFalse (psx.endFrame ());
+
+	runFrame (psx);
+	assertTrue (psx.frameComplete ());
+	assertFalse (MockSpiPort::transferInterrupt);
+	assertTrue (PsxSpiAsyncHandler::current () == NULL);
+	assertEqual (5, psx.getFrameLength ());
+	assertEqual (5, MockSpiPort::sentLen);
+	assertEqual (0x01, MockSpiPort::sent[0]);
+	assertEqual (0x42, MockSpiPort::sent[1]);
+
+	assertTrue (psx.endFrame ());
+	assertFalse (psx.frameComplete ());
+	assertEqual (PSPROTO_DIGITAL, psx.getProtocol ());
+	assertTrue (psx.buttonPressed (PSB_CROSS));
+	assertTrue (psx.buttonPressed (PSB_PAD_UP));
+	assertFalse (psx.buttonPressed (PSB_CIRCLE));
+}
+
+unittest (analog_frame) {
+	PsxAsync psx;
+	startPad (psx);
+
+	const byte reply[] = {0xFF, 0x73, 0x5A, 0xFF, 0xFF, 0x10, 0x20, 0x30, 0x40};
+	byte frame[21];
+	MockSpiPort::reset (reply, sizeof (reply));
+	assertTrue (psx.beginFrame (frame, sizeof (frame)));
+	runFrame (psx);
+	assertEqual (9, psx.getFrameLength ());
+	assertEqual (9, MockSpiPort::sentLen);
+
+	assertTrue (psx.endFrame ());
+	assertEqual (PSPROTO_DUALSHOCK, psx.getProtocol ());
+	byte x, y;
+	assertTrue (psx.getLeftAnalog (x, y));
+	assertEqual (0x30, x);
+	assertEqual (0x40, y);
+	assertTrue (psx.getRightAnalog (x, y));
+	assertEqual (0x10, x);
+	assertEqual (0x20, y);
+}
+
+unittest (nothing_plugged_in) {
+	PsxAsync psx;
+	startPad (psx);
+
+	// No reply: the frame must stop after the header
+	byte frame[21];
+	MockSpiPort::reset (NULL, 0);
+	assertTrue (psx.beginFrame (frame, sizeof (frame)));
+	runFrame (psx);
+	assertTrue (psx.frameComplete ());
+	assertEqual (3, MockSpiPort::sentLen);
+	assertFalse (psx.endFrame ());
+
+	// And the object must be ready for the next one
+	assertTrue (psx.beginFrame (frame, sizeof (frame)));
+	runFrame (psx);
+	assertTrue (psx.frameComplete ());
+	psx.endFrame ();
+}
+
+unittest (buffer_too_small) {
+	PsxAsync psx;
+	startPad (psx);
+
+	const byte reply[] = {0xFF, 0x79, 0x5A, 0xFF, 0xFF, 0x80, 0x80, 0x80, 0x80,
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	byte frame[9];
+	MockSpiPort::reset (reply, sizeof (reply));
+	assertFalse (psx.beginFrame (frame, 3));
+	assertTrue (psx.beginFrame (frame, sizeof (frame)));
+	runFrame (psx);
+	assertTrue (psx.frameComplete ());
+	assertEqual (3, MockSpiPort::sentLen);
+	assertFalse (psx.endFrame ());
+}
+
+unittest_main ()
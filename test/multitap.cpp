@@ -0,0 +1,149 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file multitap.cpp
+ * \brief Tests of PsxMultitap
+ */
+
+#include <ArduinoUnitTests.h>
+#include <PsxControllerSim.h>
+#include <PsxMultitap.h>
+
+/** \brief Simulated controller behind an optional multitap
+ *
+ * When a multitap reply is set, every transaction gets it, no matter the
+ * command. Otherwise the simulated controller answers as if it was connected
+ * directly.
+ */
+class SimTap: public PsxControllerSim {
+protected:
+	byte tapPos;
+
+	virtual void assertAttention () override {
+		tapPos = 0;
+		PsxControllerSim::assertAttention ();
+	}
+
+	virtual byte shiftInOut (const byte out) override {
+		byte ret;
+
+		if (tapReply != NULL) {
+			ret = tapPos < MULTITAP_REPLY_SIZE ? tapReply[tapPos] : 0xFF;
+			++tapPos;
+		} else {
+			ret = PsxControllerSim::shiftInOut (out);
+		}
+
+		return ret;
+	}
+
+public:
+	const byte *tapReply;
+
+	SimTap (): tapPos (0), tapReply (NULL) {
+	}
+};
+
+static const byte TAP_REPLY[MULTITAP_REPLY_SIZE] = {
+	0xFF, MULTITAP_ID, 0x5A,
+	0x41, 0x5A, 0xEF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,		// A: Digital, Up
+	0x73, 0x5A, 0xFF, 0xBF, 0x10, 0x20, 0x30, 0x40,		// B: DualShock, Cross
+	0x79, 0x5A, 0x7F, 0xFF, 0x11, 0x22, 0x33, 0x44,		// C: DualShock 2 with pressures, Left
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF		// D: Empty
+};
+
+unittest (multitap_ports) {
+	PsxMultitap<SimTap> tap;
+	tap.setModel (PSSIM_DIGITAL);
+	assertTrue (tap.begin ());
+
+	tap.tapReply = TAP_REPLY;
+	assertTrue (tap.readAll ());
+	assertTrue (tap.isMultitapPresent ());
+
+	const PsxMultitapPort& a = tap.getPort (0);
+	assertTrue (a.isConnected ());
+	assertEqual (PSPROTO_DIGITAL, a.getProtocol ());
+	assertEqual (PSB_PAD_UP, a.getButtonWord ());
+
+	byte x, y;
+	const PsxMultitapPort& b = tap.getPort (1);
+	assertTrue (b.isConnected ());
+	assertEqual (PSPROTO_DUALSHOCK, b.getProtocol ());
+	assertEqual (PSB_CROSS, b.getButtonWord ());
+	assertTrue (b.getLeftAnalog (x, y));
+	assertEqual (0x30, x);
+	assertEqual (0x40, y);
+	assertTrue (b.getRightAnalog (x, y));
+	assertEqual (0x10, x);
+	assertEqual (0x20, y);
+
+	// Only the first 6 bytes make it through, so it looks like a DualShock
+	const PsxMultitapPort& c = tap.getPort (2);
+	assertTrue (c.isConnected ());
+	assertEqual (PSPROTO_DUALSHOCK, c.getProtocol ());
+	assertEqual (PSB_PAD_LEFT, c.getButtonWord ());
+	assertTrue (c.getLeftAnalog (x, y));
+	assertEqual (0x33, x);
+	assertEqual (0x44, y);
+	assertTrue (c.getRightAnalog (x, y));
+	assertEqual (0x11, x);
+	assertEqual (0x22, y);
+
+	assertFalse (tap.getPort (3).isConnected ());
+}
+
+unittest (single_pad_fallback) {
+	PsxMultitap<SimTap> tap;
+	tap.setModel (PSSIM_DUALSHOCK);
+	assertTrue (tap.begin ());
+	assertTrue (tap.configure (PsxConfigProfile (true)));
+
+	tap.setButtons (PSB_CIRCLE);
+	tap.setLeftAnalog (0x00, 0xFF);
+	assertTrue (tap.readAll ());
+	assertFalse (tap.isMultitapPresent ());
+
+	const PsxMultitapPort& a = tap.getPort (0);
+	assertTrue (a.isConnected ());
+	assertEqual (PSPROTO_DUALSHOCK, a.getProtocol ());
+	assertEqual (PSB_CIRCLE, a.getButtonWord ());
+	byte x, y;
+	assertTrue (a.getLeftAnalog (x, y));
+	assertEqual (0x00, x);
+	assertEqual (0xFF, y);
+
+	for (byte i = 1; i < MULTITAP_PORTS; ++i) {
+		assertFalse (tap.getPort (i).isConnected ());
+	}
+}
+
+unittest (nothing_connected) {
+	PsxMultitap<SimTap> tap;
+	tap.setModel (PSSIM_NONE);
+	assertFalse (tap.begin ());
+
+	assertFalse (tap.readAll ());
+	assertFalse (tap.isMultitapPresent ());
+	for (byte i = 0; i < MULTITAP_PORTS; ++i) {
+		assertFalse (tap.getPort (i).isConnected ());
+	}
+}
+
+unittest_main ()
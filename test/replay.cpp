@@ -0,0 +1,217 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file replay.cpp
+ * \brief Tests of PsxFrameRecorder and PsxControllerReplay
+ */
+
+#include <ArduinoUnitTests.h>
+#include <PsxControllerSim.h>
+#include <PsxControllerReplay.h>
+
+const unsigned int POLLS_NO = 50;
+
+//! \brief A Stream that reads back what was written to it
+class MemoryStream: public Stream {
+private:
+	byte data[2048];
+	size_t writePos;
+	size_t readPos;
+
+public:
+	MemoryStream (): writePos (0), readPos (0) {
+	}
+
+	virtual size_t write (uint8_t b) {
+		size_t ret = 0;
+		if (writePos < sizeof (data)) {
+			data[writePos++] = b;
+			ret = 1;
+		}
+		return ret;
+	}
+
+	virtual int available () {
+		return writePos - readPos;
+	}
+
+	virtual int read () {
+		return readPos < writePos ? data[readPos++] : -1;
+	}
+
+	virtual int peek () {
+		return readPos < writePos ? data[readPos] : -1;
+	}
+
+	size_t size () const {
+		return writePos;
+	}
+};
+
+//! \brief A MemoryStream that counts writes made while Attention is asserted
+class BusCheckStream: public MemoryStream {
+private:
+	const PsxControllerSim& sim;
+
+public:
+	unsigned int writesInTransaction;
+
+	BusCheckStream (const PsxControllerSim& s): sim (s), writesInTransaction (0) {
+	}
+
+	virtual size_t write (uint8_t b) {
+		if (sim.isSelected ()) {
+			++writesInTransaction;
+		}
+		return MemoryStream::write (b);
+	}
+};
+
+//! \brief What the controller is doing at a given poll
+static PsxButtons buttonsAt (const unsigned int i) {
+	return (i / 3) % 2 != 0 ? PSB_CROSS : (i % 7 == 0 ? PSB_L1 | PSB_START : PSB_NONE);
+}
+
+unittest (record_and_replay) {
+	MemoryStream recording;
+	PsxFrameRecorder recorder (recording);
+	PsxButtons live[POLLS_NO];
+	byte liveLx[POLLS_NO];
+
+	// Live session
+	PsxControllerSim sim;
+	recorder.begin ();
+	sim.setRecorder (&recorder);
+	assertTrue (sim.begin ());
+	assertTrue (sim.configure (PsxConfigProfile (true, false, true)));
+	for (unsigned int i = 0; i < POLLS_NO; ++i) {
+		sim.setButtons (buttonsAt (i));
+		sim.setLeftAnalog (i * 5, 0x80);
+		sim.advanceClock (1000);
+		assertTrue (sim.read ());
+		live[i] = sim.getButtonWord ();
+		byte y;
+		sim.getLeftAnalog (liveLx[i], y);
+	}
+	assertMore (recorder.getFrames (), POLLS_NO);
+
+	// Replay, calling the same functions
+	PsxControllerReplay psx (recording);
+	assertTrue (psx.begin ());
+	assertTrue (psx.configure (PsxConfigProfile (true, false, true)));
+	assertEqual (PSPROTO_DUALSHOCK2, psx.getProtocol ());
+	for (unsigned int i = 0; i < POLLS_NO; ++i) {
+		assertTrue (psx.read ());
+		assertEqual (live[i], psx.getButtonWord ());
+
+		byte x, y;
+		assertTrue (psx.getLeftAnalog (x, y));
+		assertEqual (liveLx[i], x);
+	}
+	assertFalse (psx.isFinished ());
+	assertEqual (recorder.getFrames (), psx.getFramesReplayed ());
+
+	// Recording is over, so the controller is gone
+	assertFalse (psx.read ());
+	assertTrue (psx.isFinished ());
+}
+
+unittest (replay_hot_plug) {
+	MemoryStream recording;
+	PsxFrameRecorder recorder (recording);
+	boolean liveOk[POLLS_NO];
+	PsxButtons live[POLLS_NO];
+
+	// Live session, the controller is plugged in after a while
+	PsxControllerSim sim;
+	sim.setModel (PSSIM_NONE);
+	recorder.begin ();
+	sim.setRecorder (&recorder);
+	assertFalse (sim.begin ());
+	sim.setConfigProfile (PsxConfigProfile (true));
+	for (unsigned int i = 0; i < POLLS_NO; ++i) {
+		if (i == 10) {
+			sim.setModel (PSSIM_DUALSHOCK2);
+		}
+		sim.setButtons (buttonsAt (i));
+		sim.advanceClock (1000);
+		liveOk[i] = sim.update ();
+		live[i] = sim.getButtonWord ();
+	}
+	assertTrue (sim.isConnected ());
+
+	// Probes made while nothing was plugged in must not shift the replay
+	PsxControllerReplay psx (recording);
+	assertFalse (psx.begin ());
+	psx.setConfigProfile (PsxConfigProfile (true));
+	for (unsigned int i = 0; i < POLLS_NO; ++i) {
+		assertEqual (liveOk[i], psx.update ());
+		assertEqual (live[i], psx.getButtonWord ());
+	}
+	assertFalse (psx.isOutOfSync ());
+	assertEqual (recorder.getFrames (), psx.getFramesReplayed ());
+	assertEqual (PSPROTO_DUALSHOCK, psx.getProtocol ());
+}
+
+unittest (replay_out_of_sync) {
+	MemoryStream recording;
+	PsxFrameRecorder recorder (recording);
+
+	PsxControllerSim sim;
+	recorder.begin ();
+	sim.setRecorder (&recorder);
+	assertTrue (sim.begin ());
+	for (unsigned int i = 0; i < 5; ++i) {
+		assertTrue (sim.read ());
+	}
+
+	// Entering Configuration Mode sends 0x43, but a poll was recorded
+	PsxControllerReplay psx (recording);
+	assertTrue (psx.begin ());
+	assertFalse (psx.isOutOfSync ());
+	assertFalse (psx.enterConfigMode ());
+	assertTrue (psx.isOutOfSync ());
+	assertTrue (psx.isFinished ());
+}
+
+unittest (invalid_recording) {
+	MemoryStream recording;
+	recording.write ('X');
+
+	PsxControllerReplay psx (recording);
+	assertFalse (psx.begin ());
+	assertTrue (psx.isFinished ());
+}
+
+unittest (records_written_outside_transactions) {
+	PsxControllerSim sim;
+	BusCheckStream recording (sim);
+	PsxFrameRecorder recorder (recording);
+
+	recorder.begin ();
+	sim.setRecorder (&recorder);
+	assertTrue (sim.begin ());
+	assertTrue (sim.configure (PsxConfigProfile (true)));
+	assertTrue (sim.read ());
+
+	assertMore (recorder.getFrames (), 0UL);
+	assertEqual (0U, recording.writesInTransaction);
+}
+
+unittest_main ()
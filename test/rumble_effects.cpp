@@ -0,0 +1,106 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file rumble_effects.cpp
+ * \brief Tests of PsxRumbleEngine
+ */
+
+#include <ArduinoUnitTests.h>
+#include <PsxRumbleEffects.h>
+
+unittest (ramp_levels) {
+	PsxRumbleEngine<> rumble;
+	byte m1, m2;
+
+	int8_t h = rumble.play (PSX_RUMBLE_RAMP);
+	assertNotEqual (PSX_RUMBLE_NONE, h);
+
+	// Effects start at the first call
+	rumble.getRumble (1000, m1, m2);
+	assertEqual (0x00, m1);
+	assertEqual (0x00, m2);
+
+	rumble.getRumble (1250, m1, m2);
+	assertEqual (0x00, m1);
+	assertEqual (0x7F, m2);
+
+	rumble.getRumble (1500, m1, m2);
+	assertEqual (0xFF, m2);
+
+	rumble.getRumble (1750, m1, m2);
+	assertEqual (0x80, m2);
+
+	rumble.getRumble (1999, m1, m2);
+	assertEqual (0x01, m2);
+	assertTrue (rumble.isPlaying (h));
+
+	rumble.getRumble (2000, m1, m2);
+	assertEqual (0x00, m1);
+	assertEqual (0x00, m2);
+	assertFalse (rumble.isPlaying (h));
+	assertFalse (rumble.isPlaying ());
+}
+
+unittest (priorities) {
+	PsxRumbleEngine<> rumble;
+	byte m1, m2;
+
+	int8_t heart = rumble.play (PSX_RUMBLE_HEARTBEAT, 1, 0);
+	rumble.getRumble (0, m1, m2);
+	assertEqual (0x00, m1);
+	assertEqual (0xC0, m2);
+
+	// Second time round, between the beats
+	rumble.getRumble (1000, m1, m2);
+	assertEqual (0x00, m2);
+
+	int8_t pulse = rumble.play (PSX_RUMBLE_PULSE, 2);
+	assertNotEqual (heart, pulse);
+	rumble.getRumble (1000, m1, m2);
+	assertEqual (0xFF, m1);
+	assertEqual (0xFF, m2);
+	rumble.getRumble (1099, m1, m2);
+	assertEqual (0xFF, m1);
+	assertEqual (0xFF, m2);
+
+	// The heartbeat kept going underneath, it's now on the second beat
+	rumble.getRumble (1100, m1, m2);
+	assertEqual (0x00, m1);
+	assertEqual (0xFF, m2);
+	assertFalse (rumble.isPlaying (pulse));
+	assertTrue (rumble.isPlaying (heart));
+}
+
+unittest (play_refused_when_full) {
+	PsxRumbleEngine<2> rumble;
+
+	int8_t first = rumble.play (PSX_RUMBLE_HEARTBEAT, 3, 0);
+	int8_t second = rumble.play (PSX_RUMBLE_IMPACT, 3);
+	assertNotEqual (PSX_RUMBLE_NONE, first);
+	assertNotEqual (PSX_RUMBLE_NONE, second);
+
+	assertEqual (PSX_RUMBLE_NONE, rumble.play (PSX_RUMBLE_PULSE, 2));
+	assertTrue (rumble.isPlaying (first));
+	assertTrue (rumble.isPlaying (second));
+
+	// The same priority is enough to replace the oldest
+	assertEqual (first, rumble.play (PSX_RUMBLE_PULSE, 3));
+}
+
+unittest_main ()
@@ -0,0 +1,72 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file scheduler.cpp
+ * \brief Tests of PsxPollScheduler against the simulated controller
+ */
+
+#include <ArduinoUnitTests.h>
+#include <PsxControllerSim.h>
+#include <PsxPollScheduler.h>
+
+unittest (polls_from_timer) {
+	PsxControllerSim psx;
+	psx.setModel (PSSIM_DUALSHOCK);
+	assertTrue (psx.begin ());
+
+	PsxPollScheduler scheduler (psx, 4000);
+	assertEqual (0UL, scheduler.getSequence ());
+
+	psx.setButtons (PSB_CIRCLE);
+	scheduler.onTimer ();
+	assertTrue (scheduler.isLatestValid ());
+	assertEqual (1UL, scheduler.getSequence ());
+	assertFalse (scheduler.service ());
+
+	PsxState state;
+	assertTrue (scheduler.getLatest (state));
+	assertEqual (PSB_CIRCLE, static_cast<PsxButtons> (~state.buttonWord));
+	assertEqual (PSPROTO_DIGITAL, state.protocol);
+	assertFalse (scheduler.getLatest (state));		// Nothing new
+}
+
+unittest (config_recovery_left_to_service) {
+	PsxControllerSim psx;
+	psx.setModel (PSSIM_DUALSHOCK);
+	assertTrue (psx.begin ());
+	assertTrue (psx.enterConfigMode ());
+
+	// The poll must not try to get the controller out of Configuration Mode
+	PsxPollScheduler scheduler (psx, 4000);
+	scheduler.onTimer ();
+	assertFalse (scheduler.isLatestValid ());
+	assertTrue (psx.isInConfigMode ());
+	assertTrue (psx.isConfigStuck ());
+
+	// That's up to service()
+	assertTrue (scheduler.service ());
+	assertFalse (psx.isInConfigMode ());
+	assertFalse (psx.isConfigStuck ());
+	assertFalse (scheduler.service ());
+
+	scheduler.onTimer ();
+	assertTrue (scheduler.isLatestValid ());
+}
+
+unittest_main ()
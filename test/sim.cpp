@@ -0,0 +1,373 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file sim.cpp
+ * \brief Tests of PsxController against the simulated controller
+ */
+
+#include <ArduinoUnitTests.h>
+#include <PsxControllerSim.h>
+
+unittest (nothing_plugged_in) {
+	PsxControllerSim psx;
+	psx.setModel (PSSIM_NONE);
+
+	assertFalse (psx.begin ());
+	assertFalse (psx.read ());
+}
+
+unittest (digital_buttons) {
+	PsxControllerSim psx;
+	psx.setModel (PSSIM_DIGITAL);
+
+	assertTrue (psx.begin ());
+	assertEqual (PSPROTO_DIGITAL, psx.getProtocol ());
+	assertEqual (PSB_NONE, psx.getButtonWord ());
+
+	psx.setButtons (PSB_CROSS | PSB_PAD_UP);
+	assertTrue (psx.read ());
+	assertTrue (psx.buttonPressed (PSB_CROSS));
+	assertTrue (psx.buttonJustPressed (PSB_PAD_UP));
+	assertFalse (psx.buttonPressed (PSB_CIRCLE));
+
+	byte x, y;
+	assertFalse (psx.getLeftAnalog (x, y));
+}
+
+unittest (dualshock2_configuration) {
+	PsxControllerSim psx;
+	psx.setModel (PSSIM_DUALSHOCK2);
+
+	assertTrue (psx.begin ());
+	assertEqual (PSPROTO_DIGITAL, psx.getProtocol ());
+
+	assertTrue (psx.configure (PsxConfigProfile (true, true, true)));
+	assertFalse (psx.isInConfigMode ());
+	assertEqual (PSPROTO_DUALSHOCK2, psx.getProtocol ());
+
+	psx.setLeftAnalog (0x10, 0xF0);
+	psx.setAnalogButton (PSAB_CROSS, 0x80);
+	assertTrue (psx.read ());
+
+	byte x, y;
+	assertTrue (psx.getLeftAnalog (x, y));
+	assertEqual (0x10, x);
+	assertEqual (0xF0, y);
+	assertEqual (0x80, psx.getAnalogButton (PSAB_CROSS));
+
+	// Locked, so the user can't switch analog mode off
+	psx.setAnalogMode (false);
+	assertTrue (psx.read ());
+	assertEqual (PSPROTO_DUALSHOCK2, psx.getProtocol ());
+}
+
+unittest (single_configuration_functions) {
+	PsxControllerSim psx;
+	psx.setModel (PSSIM_DUALSHOCK2);
+
+	assertTrue (psx.begin ());
+	assertTrue (psx.enterConfigMode ());
+	assertTrue (psx.isInConfigMode ());
+	assertEqual (PSCTRL_DUALSHOCK, psx.getControllerType ());
+	assertTrue (psx.enableAnalogSticks ());
+	assertTrue (psx.enableRumble ());
+	assertTrue (psx.exitConfigMode ());
+	assertFalse (psx.isInConfigMode ());
+
+	psx.setRumble (true, 0x40);
+	assertTrue (psx.read ());
+	assertEqual (PSPROTO_DUALSHOCK, psx.getProtocol ());
+
+	byte m1, m2;
+	psx.getMotorLevels (m1, m2);
+	assertEqual (0xFF, m1);
+	assertEqual (0x40, m2);
+}
+
+unittest (stuck_in_configuration_mode) {
+	PsxControllerSim psx;
+	psx.setModel (PSSIM_DUALSHOCK);
+
+	assertTrue (psx.begin ());
+	assertTrue (psx.enterConfigMode ());
+
+	// The first poll finds it in Configuration Mode and gets it out
+	assertFalse (psx.read ());
+	assertFalse (psx.isInConfigMode ());
+	assertTrue (psx.read ());
+}
+
+unittest (non_blocking_poll) {
+	PsxControllerSim psx;
+	psx.setModel (PSSIM_DUALSHOCK2);
+
+	assertTrue (psx.begin ());
+	assertTrue (psx.beginConfig (PsxConfigProfile (true)));
+	while (!psx.tick ()) {
+		psx.advanceClock (1);
+	}
+	assertTrue (psx.configSucceeded ());
+	assertEqual (PSPROTO_DUALSHOCK, psx.getProtocol ());
+
+	psx.setButtons (PSB_TRIANGLE);
+	assertTrue (psx.beginPoll ());
+	assertFalse (psx.beginPoll ());
+	while (!psx.tick ()) {
+		psx.advanceClock (1);
+	}
+	assertTrue (psx.pollSucceeded ());
+	assertTrue (psx.buttonPressed (PSB_TRIANGLE));
+}
+
+unittest (non_blocking_poll_with_ack) {
+	PsxControllerSim psx;
+	psx.setModel (PSSIM_DUALSHOCK);
+	assertTrue (psx.begin ());
+
+	unsigned long duration[2];
+	for (byte i = 0; i < 2; ++i) {
+		psx.setAckLatency (i == 0 ? 0 : 10);
+		unsigned long start = psx.getClock ();
+		assertTrue (psx.beginPoll ());
+		while (!psx.tick ()) {
+			psx.advanceClock (1);
+		}
+		assertTrue (psx.pollSucceeded ());
+		duration[i] = psx.getClock () - start;
+	}
+
+	// 4 bytes are acknowledged, each 40 us earlier than the fixed delay
+	/* 5 bytes are exchanged: the simulator acknowledges the 2nd to 4th 10 us
+	 * into the fixed delay, which is not waited at all after the last one
+	 */
+	unsigned long saved = 3 * (INTER_CMD_BYTE_DELAY - 10) + INTER_CMD_BYTE_DELAY;
+	assertLessOrEqual (duration[1], duration[0] - saved + 1);		// Ticks go in 1 us steps
+}
+
+unittest (clock_calibration) {
+	PsxControllerSim psx;
+	psx.setModel (PSSIM_DUALSHOCK);
+	psx.setMinClockPeriod (2);
+
+	assertTrue (psx.begin ());
+	assertEqual (2, psx.calibrateClock ());
+	assertTrue (psx.read ());
+}
+
+unittest (clock_survives_unplugging) {
+	PsxControllerSim psx;
+	psx.setModel (PSSIM_DUALSHOCK);
+	psx.setMinClockPeriod (2);
+	assertTrue (psx.begin ());
+	assertEqual (2, psx.calibrateClock ());
+
+	// Nobody answering is no reason to slow down
+	psx.setModel (PSSIM_NONE);
+	for (byte i = 0; i < 20; ++i) {
+		assertFalse (psx.read ());
+	}
+	assertEqual (2, psx.getClockLevel ());
+
+	psx.setModel (PSSIM_DUALSHOCK);
+	assertTrue (psx.read ());
+	assertEqual (2, psx.getClockLevel ());
+}
+
+unittest (clock_fallback_and_recovery) {
+	PsxControllerSim psx;
+	psx.setModel (PSSIM_DUALSHOCK);
+	psx.setMinClockPeriod (2);
+	assertTrue (psx.begin ());
+	assertEqual (2, psx.calibrateClock ());
+
+	// A single glitch is tolerated
+	psx.setMinClockPeriod (3);
+	assertFalse (psx.read ());
+	psx.setMinClockPeriod (2);
+	assertTrue (psx.read ());
+	assertEqual (2, psx.getClockLevel ());
+
+	// A few in a row are not
+	psx.setMinClockPeriod (3);
+	for (byte i = 0; i < CLOCK_FALLBACK_ERRORS; ++i) {
+		assertFalse (psx.read ());
+	}
+	assertEqual (1, psx.getClockLevel ());
+	assertTrue (psx.read ());
+
+	// Once things get better, the calibrated speed is restored
+	psx.setMinClockPeriod (2);
+	for (byte i = 0; i < CLOCK_RECOVERY_POLLS - 2; ++i) {
+		assertTrue (psx.read ());
+	}
+	assertEqual (1, psx.getClockLevel ());
+	assertTrue (psx.read ());
+	assertEqual (2, psx.getClockLevel ());
+	assertTrue (psx.read ());
+}
+
+unittest (button_events) {
+	PsxControllerSim psx;
+	psx.setModel (PSSIM_DIGITAL);
+	PsxButtonEventBuffer<4> events;
+	psx.setEventQueue (&events);
+	assertTrue (psx.begin ());
+
+	psx.setButtons (PSB_CROSS);
+	assertTrue (psx.update ());
+	assertEqual (1, events.available ());
+
+	// Buttons that change at the same poll are queued in order
+	psx.advanceClock (1000);
+	psx.setButtons (PSB_CROSS | PSB_START | PSB_PAD_UP);
+	assertTrue (psx.update ());
+	assertEqual (3, events.available ());
+
+	// Only the first of these fits
+	psx.setButtons (PSB_PAD_UP);
+	assertTrue (psx.update ());
+	assertEqual (4, events.available ());
+	assertEqual (1, events.getOverflows ());
+
+	const PsxButton buttons[] = {PSB_CROSS, PSB_START, PSB_PAD_UP, PSB_START};
+	const boolean pressed[] = {true, true, true, false};
+	PsxButtonEvent ev[4];
+	for (byte i = 0; i < 4; ++i) {
+		assertTrue (events.pop (ev[i]));
+		assertEqual (buttons[i], ev[i].button);
+		assertEqual (pressed[i], ev[i].pressed);
+	}
+	assertFalse (events.pop (ev[0]));
+	assertLess (ev[0].time, ev[1].time);
+	assertEqual (ev[1].time, ev[2].time);
+
+	// Whatever is held is released when the controller goes away
+	psx.setModel (PSSIM_NONE);
+	for (byte i = 0; i < DISCONNECT_THRESHOLD - 1; ++i) {
+		assertFalse (psx.update ());
+		assertEqual (0, events.available ());
+	}
+	assertFalse (psx.update ());
+	assertEqual (1, events.available ());
+	assertTrue (events.pop (ev[0]));
+	assertEqual (PSB_PAD_UP, ev[0].button);
+	assertFalse (ev[0].pressed);
+	assertEqual (1, events.getOverflows ());
+}
+
+unittest (change_tracking) {
+	PsxControllerSim psx;
+	psx.setModel (PSSIM_DUALSHOCK);
+	assertTrue (psx.begin ());
+
+	assertTrue (psx.read ());
+	assertEqual (PSCH_NONE, psx.getChanges ());
+
+	psx.setButtons (PSB_CIRCLE);
+	assertTrue (psx.read ());
+	assertEqual (PSCH_BUTTONS, psx.getChanges ());
+
+	// Switching to analog mode changes the protocol, sticks are still idle
+	psx.setAnalogMode (true);
+	assertTrue (psx.read ());
+	assertEqual (PSPROTO_DUALSHOCK, psx.getProtocol ());
+	assertEqual (PSCH_PROTOCOL, psx.getChanges ());
+
+	psx.setAxisThresholds (8);
+	psx.setLeftAnalog (0x85, 0x80);
+	assertTrue (psx.read ());
+	assertEqual (PSCH_NONE, psx.getChanges ());
+
+	// Moves add up until they cross the threshold
+	psx.setLeftAnalog (0x88, 0x80);
+	assertTrue (psx.read ());
+	assertEqual (PSCH_LX, psx.getChanges ());
+	assertTrue (psx.changed (PSCH_STICKS));
+	assertFalse (psx.changed (PSCH_BUTTONS));
+
+	psx.setLeftAnalog (0x8C, 0x7C);
+	assertTrue (psx.read ());
+	assertEqual (PSCH_NONE, psx.getChanges ());
+
+	// Either end of the range is always reported
+	psx.setLeftAnalog (0x8C, 0x00);
+	assertTrue (psx.read ());
+	assertEqual (PSCH_LY, psx.getChanges ());
+
+	psx.setButtons (PSB_NONE);
+	psx.setAnalogMode (false);
+	assertTrue (psx.read ());
+	assertEqual (PSPROTO_DIGITAL, psx.getProtocol ());
+	assertEqual (PSCH_BUTTONS | PSCH_PROTOCOL, psx.getChanges ());
+}
+
+unittest (analog_button_selection) {
+	PsxControllerSim psx;
+	psx.setModel (PSSIM_DUALSHOCK2);
+	assertTrue (psx.begin ());
+	assertTrue (psx.configure (PsxConfigProfile (true)));
+	for (byte i = 0; i < PSX_ANALOG_BTN_DATA_SIZE; ++i) {
+		psx.setAnalogButton (static_cast<PsxAnalogButton> (i), 0x10 + i);
+	}
+
+	// Only the selected buttons are reported, all others read as released
+	assertTrue (psx.enterConfigMode ());
+	assertTrue (psx.selectAnalogButtons (PSAB_BIT (PSAB_CROSS) | PSAB_BIT (PSAB_L2)));
+	assertTrue (psx.exitConfigMode ());
+	assertTrue (psx.read ());
+	assertEqual (PSPROTO_DUALSHOCK2, psx.getProtocol ());
+	for (byte i = 0; i < PSX_ANALOG_BTN_DATA_SIZE; ++i) {
+		byte expected = i == PSAB_CROSS || i == PSAB_L2 ? 0x10 + i : 0x00;
+		assertEqual (expected, psx.getAnalogButton (static_cast<PsxAnalogButton> (i)));
+	}
+
+	// An odd number of buttons gets the first unselected one added
+	assertTrue (psx.enterConfigMode ());
+	assertTrue (psx.selectAnalogButtons (PSAB_BIT (PSAB_CIRCLE)));
+	assertTrue (psx.exitConfigMode ());
+	assertTrue (psx.read ());
+	assertEqual (PSPROTO_DUALSHOCK2, psx.getProtocol ());
+	for (byte i = 0; i < PSX_ANALOG_BTN_DATA_SIZE; ++i) {
+		byte expected = i == PSAB_PAD_RIGHT || i == PSAB_CIRCLE ? 0x10 + i : 0x00;
+		assertEqual (expected, psx.getAnalogButton (static_cast<PsxAnalogButton> (i)));
+	}
+
+	// Disabling them altogether leaves a plain DualShock reply
+	for (byte n = 0; n < 2; ++n) {
+		assertTrue (psx.enterConfigMode ());
+		assertTrue (psx.enableAnalogButtons (false));
+		assertTrue (psx.exitConfigMode ());
+		assertTrue (psx.read ());
+		assertEqual (PSPROTO_DUALSHOCK, psx.getProtocol ());
+		for (byte i = 0; i < PSX_ANALOG_BTN_DATA_SIZE; ++i) {
+			assertEqual (0x00, psx.getAnalogButton (static_cast<PsxAnalogButton> (i)));
+		}
+
+		assertTrue (psx.enterConfigMode ());
+		assertTrue (psx.enableAnalogButtons (true));
+		assertTrue (psx.exitConfigMode ());
+		assertTrue (psx.read ());
+		assertEqual (PSPROTO_DUALSHOCK2, psx.getProtocol ());
+		for (byte i = 0; i < PSX_ANALOG_BTN_DATA_SIZE; ++i) {
+			assertEqual (0x10 + i, psx.getAnalogButton (static_cast<PsxAnalogButton> (i)));
+		}
+	}
+}
+
+unittest_main ()
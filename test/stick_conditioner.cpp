@@ -0,0 +1,127 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file stick_conditioner.cpp
+ * \brief Tests of PsxAnalogStick and PsxStickConditioner
+ */
+
+#include <ArduinoUnitTests.h>
+#include <PsxStickConditioner.h>
+
+const unsigned int HOLD_POLLS = 500;
+
+unittest (held_deflection_keeps_value) {
+	PsxAnalogStick stick;
+	int8_t x, y, x0, y0;
+
+	stick.process (150, ANALOG_IDLE_VALUE, x0, y0);
+	assertMore (x0, 0);
+	assertEqual (0, y0);
+	for (unsigned int i = 0; i < HOLD_POLLS; ++i) {
+		stick.process (150, ANALOG_IDLE_VALUE, x, y);
+		assertEqual (x0, x);
+	}
+
+	// Same with a dead zone smaller than the deflection
+	PsxAnalogStick stick2;
+	stick2.setDeadZone (10);
+	stick2.process (150, ANALOG_IDLE_VALUE, x0, y0);
+	assertMore (x0, 0);
+	for (unsigned int i = 0; i < HOLD_POLLS; ++i) {
+		stick2.process (150, ANALOG_IDLE_VALUE, x, y);
+		assertEqual (x0, x);
+	}
+
+	PsxStickCalibration cal;
+	stick2.getCalibration (cal);
+	assertEqual (ANALOG_IDLE_VALUE, cal.x.center);
+}
+
+unittest (rest_offset_is_tracked) {
+	PsxAnalogStick stick;
+	int8_t x, y;
+
+	// A worn stick resting off-center, within the dead zone
+	stick.setDeadZone (16);
+	for (unsigned int i = 0; i < HOLD_POLLS; ++i) {
+		stick.process (131, 126, x, y);
+		assertEqual (0, x);
+		assertEqual (0, y);
+	}
+
+	PsxStickCalibration cal;
+	stick.getCalibration (cal);
+	assertEqual (131, cal.x.center);
+	assertEqual (126, cal.y.center);
+
+	// Same, with an axial dead zone
+	PsxAnalogStick stick2;
+	stick2.setDeadZone (16, PSDZ_AXIAL);
+	for (unsigned int i = 0; i < HOLD_POLLS; ++i) {
+		stick2.process (131, 126, x, y);
+	}
+	stick2.getCalibration (cal);
+	assertEqual (131, cal.x.center);
+	assertEqual (126, cal.y.center);
+
+	// Full travel is still full travel
+	stick.process (255, 126, x, y);
+	assertEqual (PSX_STICK_MAX, x);
+}
+
+unittest (recenter) {
+	PsxAnalogStick stick;
+	int8_t x, y;
+
+	stick.process (140, 120, x, y);
+	assertMore (x, 0);
+	assertLess (y, 0);
+
+	stick.setAutoCalibration (false);
+	stick.recenter ();
+	stick.process (140, 120, x, y);
+	assertEqual (0, x);
+	assertEqual (0, y);
+
+	PsxStickCalibration cal;
+	stick.getCalibration (cal);
+	assertEqual (140, cal.x.center);
+	assertEqual (120, cal.y.center);
+	assertMoreOrEqual (cal.x.max - cal.x.center, PSX_STICK_MIN_RANGE);
+	assertMoreOrEqual (cal.y.center - cal.y.min, PSX_STICK_MIN_RANGE);
+
+	// Only the next reading is taken
+	stick.process (150, 120, x, y);
+	assertMore (x, 0);
+}
+
+unittest (conditioner_recenter) {
+	PsxStickConditioner sticks;
+	sticks.recenter ();
+
+	int8_t x, y;
+	sticks.getLeft ().process (100, 160, x, y);
+	assertEqual (0, x);
+	assertEqual (0, y);
+	sticks.getRight ().process (90, 170, x, y);
+	assertEqual (0, x);
+	assertEqual (0, y);
+}
+
+unittest_main ()
@@ -0,0 +1,98 @@
+/*******************************************************************************
+ * This file is part of PsxNewLib.                                             *
+ *                                                                             *
+ * Copyright (C) 2019-2020 by SukkoPera <software@sukkology.net>               *
+ *                                                                             *
+ * PsxNewLib is free software: you can redistribute it and/or                  *
+ * modify it under the terms of the GNU General Public License as published by *
+ * the Free Software Foundation, either version 3 of the License, or           *
+ * (at your option) any later version.                                         *
+ *                                                                             *
+ * PsxNewLib is distributed in the hope that it will be useful,                *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with PsxNewLib. If not, see http://www.gnu.org/licenses.              *
+ ******************************************************************************/
+/**
+ * \file stick_hat.cpp
+ * \brief Tests of PsxStickHat
+ */
+
+#include <ArduinoUnitTests.h>
+#include <PsxStickHat.h>
+
+unittest (angles) {
+	assertEqual (0, PsxStickHat::getAngle (0, -127));
+	assertEqual (45, PsxStickHat::getAngle (127, -127));
+	assertEqual (90, PsxStickHat::getAngle (127, 0));
+	assertEqual (180, PsxStickHat::getAngle (0, 127));
+	assertEqual (270, PsxStickHat::getAngle (-128, 0));
+	assertEqual (315, PsxStickHat::getAngle (-100, -100));
+	assertEqual (0, PsxStickHat::getAngle (0, 0));
+}
+
+unittest (angles_match_atan2) {
+	// Table and rounding errors add up to a little more than a degree
+	for (int x = -128; x < 128; x += 3) {
+		for (int y = -128; y < 128; y += 3) {
+			if (x != 0 || y != 0) {
+				double d = atan2 (x, -y) * 180 / M_PI;
+				if (d < 0) {
+					d += 360;
+				}
+				double e = fabs (PsxStickHat::getAngle (x, y) - d);
+				if (e > 180) {
+					e = 360 - e;
+				}
+				assertLessOrEqual (e, 1.1);
+			}
+		}
+	}
+}
+
+unittest (dead_zone) {
+	PsxStickHat hat (PSHAT_8WAY, 50);
+
+	assertEqual (PSX_HAT_RELEASED, hat.update (0, 0));
+	assertEqual (PSX_HAT_RELEASED, hat.update (0, -50));
+	assertEqual (0, hat.update (0, -60));
+
+	// Must get a little closer to be released again
+	assertEqual (0, hat.update (0, -48));
+	assertEqual (PSX_HAT_RELEASED, hat.update (0, -40));
+
+	assertEqual (180, hat.updateRaw (0x80, 0xFF));
+	assertEqual (PSX_HAT_RELEASED, hat.updateRaw (0x80, 0x80));
+}
+
+unittest (sectors_with_hysteresis) {
+	PsxStickHat hat (PSHAT_4WAY, 10, 5);
+
+	assertEqual (90, hat.update (100, 0));
+
+	// Right on the boundary with down, at 135 degrees
+	assertEqual (90, hat.update (100, 100));
+	assertEqual (90, hat.update (90, 100));
+
+	// Well past it
+	assertEqual (180, hat.update (70, 100));
+	assertEqual (180, hat.update (100, 100));
+
+	hat.setMode (PSHAT_8WAY);
+	assertEqual (135, hat.update (100, 100));
+	assertEqual (135, hat.update (100, 60));
+	assertEqual (90, hat.update (100, 30));
+}
+
+unittest (full_circle_with_hysteresis) {
+	PsxStickHat hat (PSHAT_360, 10, 3);
+
+	assertEqual (90, hat.update (127, 0));
+	assertEqual (90, hat.update (127, 4));
+	assertEqual (100, hat.update (127, 22));
+}
+
+unittest_main ()